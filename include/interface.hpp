@@ -32,6 +32,53 @@ enum class smearing_type
 };
 
 
+/// reason for the termination of the solver
+enum class nlcg_status
+{
+  /// |slope| < tol
+  converged,
+  /// maximal number of iterations reached
+  maxiter,
+  /// no progress: repeated backtracking searches or changes of F below round-off
+  stagnated,
+  /// the forecast convergence rate cannot reach tol within maxiter
+  too_slow,
+  /// no descent direction found
+  no_descent
+};
+
+
+/// cost structure of a solver run (local to the calling rank)
+struct nlcg_stats
+{
+  /// EnergyBase::compute calls
+  long evaluations{0};
+  /// line searches finished by the quadratic line search / by backtracking
+  long qline{0};
+  long btsearch{0};
+  /// applications of the overlap and of the preconditioner, per k-point
+  long overlap_applications{0};
+  long precond_applications{0};
+  /// restarts of the search direction with steepest descent, the initial direction excluded
+  long restarts{0};
+  /// bytes copied between memory spaces (host <-> device)
+  long bytes_copied{0};
+  /// bytes passed to allreduce / allgather on communicators with more than one rank
+  long bytes_allreduced{0};
+  long bytes_allgathered{0};
+  /// wall time [s] of the line searches, of the search directions and of the whole run
+  double time_linesearch{0};
+  double time_direction{0};
+  double time_total{0};
+  /// wall time [s] of the occupation search, the allgathers, the output and the nbands x nbands
+  /// factorizations (eigh, Cholesky, η-gradient), included in the times above where they happen
+  double time_occupation{0};
+  double time_allgather{0};
+  double time_logging{0};
+  double time_small_matrices{0};
+};
+
+
 struct nlcg_info
 {
   double tolerance;
@@ -39,6 +86,21 @@ struct nlcg_info
   double S;
   int iter;
   bool converged{false};
+  nlcg_status status{nlcg_status::maxiter};
+  /// estimated number of iterations left at termination, -1 if unknown
+  int iter_forecast{-1};
+  nlcg_stats stats;
+};
+
+
+/// Hints passed from the solver to EnergyBase::compute_hinted, implementations are free to ignore
+/// them.
+struct eval_hints
+{
+  /// requested absolute accuracy of the total energy, 0 means full accuracy
+  double energy_tol{0};
+  /// true for line-search trial points which are never accepted as next iterate
+  bool is_trial{false};
 };
 
 
@@ -130,6 +192,16 @@ class EnergyBase
 public:
   EnergyBase() = default;
   virtual void compute() = 0;
+  /// evaluate with accuracy hints, defaults to a full accuracy evaluation
+  virtual void compute_hinted(const eval_hints&) { this->compute(); }
+  /// start an evaluation, results must not be accessed before wait(), defaults to
+  /// compute_hinted(hints)
+  virtual void compute_async(const eval_hints& hints) { this->compute_hinted(hints); }
+  /// block until the evaluation started by compute_async is finished
+  virtual void wait() {}
+  /// true if compute_async returns before the evaluation is finished, the solver then prepares
+  /// its next point while the evaluation is outstanding
+  virtual bool is_async() const { return false; }
   /// return the number of electrons
   virtual int nelectrons() = 0;
   /// maximum number of electrons per orbital
@@ -157,15 +229,41 @@ public:
   virtual void apply(const key_t&,
                      MatrixBaseZ::buffer_t& out,
                      MatrixBaseZ::buffer_t& in) const = 0;
+  /// apply to several (key, out, in) triples in one call, default loops over apply
+  virtual void apply_batch(const std::vector<key_t>& keys,
+                           std::vector<MatrixBaseZ::buffer_t>& out,
+                           std::vector<MatrixBaseZ::buffer_t>& in) const
+  {
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      this->apply(keys[i], out[i], in[i]);
+    }
+  }
   virtual std::vector<key_t> get_keys() const = 0;
 };
 
 class OverlapBase : public OpBase
 {
+public:
+  /**
+   * Optional ultrasoft structure S = 1 + B Q B^H. If provided, nlcglib applies S and S^-1
+   * itself (NLCGLIB_OVERLAP=auto|lowrank). Per k-point: projectors B (npw x nproj) and
+   * Hermitian Q (nproj x nproj). The default, nullptr, means not provided.
+   */
+  virtual std::shared_ptr<MatrixBaseZ> get_projectors(memory_type) const { return nullptr; }
+  virtual std::shared_ptr<MatrixBaseZ> get_q(memory_type) const { return nullptr; }
 };
 
 class UltrasoftPrecondBase : public OpBase
 {
+public:
+  /**
+   * Optional low-rank ultrasoft correction for the in-library preconditioner
+   * P = K + K B C B^H K, K the Teter diagonal (NLCGLIB_US_PRECOND=teter_lowrank).
+   * Per k-point: projectors B (npw x nproj) and Hermitian C (nproj x nproj). The default,
+   * nullptr, means not provided.
+   */
+  virtual std::shared_ptr<MatrixBaseZ> get_projectors(memory_type) const { return nullptr; }
+  virtual std::shared_ptr<MatrixBaseZ> get_correction(memory_type) const { return nullptr; }
 };
 
 }  // namespace nlcglib
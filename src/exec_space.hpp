@@ -2,6 +2,8 @@
 
 #include <Kokkos_Core.hpp>
 #include <Kokkos_HIP_Space.hpp>
+#include <string>
+#include <type_traits>
 
 namespace nlcglib {
 
@@ -39,5 +41,30 @@ struct exec<Kokkos::HostSpace>
 template <class SPACE>
 using exec_t = typename exec<SPACE>::type;
 
+/**
+ * parallel_for over the entries (i, j) of a column major (LayoutLeft) m x n matrix.
+ *
+ * On the host the columns are distributed over the threads and each thread runs over the rows of
+ * a column in the inner loop, i.e. over contiguous memory, which the compiler vectorizes. The
+ * MDRange policy iterates the right-most index fastest on the host (strided access for column
+ * major storage), it is kept for the device where consecutive i are coalesced.
+ */
+template <class SPACE, class F>
+void
+parallel_for_columns(const std::string& label, int m, int n, const F& f)
+{
+  if constexpr (std::is_same<SPACE, Kokkos::HostSpace>::value) {
+    Kokkos::parallel_for(
+        label, Kokkos::RangePolicy<exec_t<SPACE>>(0, n), KOKKOS_LAMBDA(int j) {
+          for (int i = 0; i < m; ++i) {
+            f(i, j);
+          }
+        });
+  } else {
+    Kokkos::parallel_for(
+        label, Kokkos::MDRangePolicy<Kokkos::Rank<2>, exec_t<SPACE>>({{0, 0}}, {{m, n}}), f);
+  }
+}
+
 
 }  // nlcglib
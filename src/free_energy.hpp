@@ -4,6 +4,7 @@
 #include "constants.hpp"
 #include "interface.hpp"
 #include "smearing.hpp"
+#include "utils/solver_stats.hpp"
 
 namespace nlcglib {
 
@@ -14,7 +15,24 @@ public:
   virtual ~FreeEnergy() {}
 
   template <class tF, class tX, class tE>
-  void compute(const mvector<tX>& X, const mvector<tF>& fn, const mvector<tE>& en, double mu);
+  void compute(const mvector<tX>& X,
+               const mvector<tF>& fn,
+               const mvector<tE>& en,
+               double mu,
+               const eval_hints& hints = eval_hints{});
+
+  /// start the evaluation, get_F() etc. are valid after wait()
+  template <class tF, class tX, class tE>
+  void compute_async(const mvector<tX>& X,
+                     const mvector<tF>& fn,
+                     const mvector<tE>& en,
+                     double mu,
+                     const eval_hints& hints = eval_hints{});
+
+  /// finish the evaluation started by compute_async
+  void wait();
+  /// true if compute_async overlaps with the energy evaluation (EnergyBase::is_async)
+  bool is_async() const { return energy.is_async(); }
 
   void compute();
 
@@ -35,12 +53,19 @@ public:
   const auto& ehandle() const { return energy; }
 
   Smearing& get_smearing() { return smearing; }
+  /// change the temperature, get_F() etc. are valid after the next compute
+  void set_temperature(double T)
+  {
+    this->T = T;
+    smearing.set_temperature(T);
+  }
   double get_chemical_potential() const { return energy.get_chemical_potential(); }
 
 private:
   double T;
   double free_energy;
   double entropy;
+  double mu_pending;
   EnergyBase& energy;
   Smearing smearing;
 };
@@ -60,12 +85,29 @@ FreeEnergy::FreeEnergy(double T, EnergyBase& energy, smearing_type smear)
 
 template <class tF, class tX, class tE>
 void
-FreeEnergy::compute(const mvector<tX>& X, const mvector<tF>& fn, const mvector<tE>& en, double mu)
+FreeEnergy::compute(const mvector<tX>& X,
+                    const mvector<tF>& fn,
+                    const mvector<tE>& en,
+                    double mu,
+                    const eval_hints& hints)
+{
+  this->compute_async(X, fn, en, mu, hints);
+  this->wait();
+}
+
+template <class tF, class tX, class tE>
+void
+FreeEnergy::compute_async(const mvector<tX>& X,
+                          const mvector<tF>& fn,
+                          const mvector<tE>& en,
+                          double mu,
+                          const eval_hints& hints)
 {
   // convert fn to std::vector
   auto map_fn = tapply(
       [](auto fi) {
-        auto fi_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), fi);
+        auto fi_host =
+            copies::create_mirror_view_and_copy("FreeEnergy::compute", Kokkos::HostSpace(), fi);
         int n = fi_host.size();
         std::vector<double> vec_fi(n);
         std::copy(fi_host.data(), fi_host.data() + n, vec_fi.data());
@@ -83,22 +125,31 @@ FreeEnergy::compute(const mvector<tX>& X, const mvector<tF>& fn, const mvector<t
         auto xh = Kokkos::create_mirror(x.array());
         // copy to Kokkos owned host mirror,
         // since  Kokkos refuses to copy device, managed -> host, unmanaged
-        Kokkos::deep_copy(xh, x.array());
-        Kokkos::deep_copy(x_sirius.array(), xh);
+        copies::deep_copy("FreeEnergy::compute", xh, x.array());
+        copies::deep_copy("FreeEnergy::compute", x_sirius.array(), xh);
       },
       Xsirius,
       X));
 
   energy.set_fn(key_fn, vec_fn);
-  energy.compute();
+  SolverStats::add(SolverStats::GetInstance().evaluations, 1);
+  energy.compute_async(hints);
+
+  // the entropy does not depend on the energy evaluation
+  double S = smearing.entropy(fn, en, mu);
+  entropy = physical_constants::kb * T * S;
+  mu_pending = mu;
+}
+
+void
+FreeEnergy::wait()
+{
+  energy.wait();
 
   // update fermi energy in SIRIUS (no effect here, but make sure to leave SIRIUS in a consistent state)
-  energy.set_chemical_potential(mu);
+  energy.set_chemical_potential(mu_pending);
 
   double etot = energy.get_total_energy();
-  double S = smearing.entropy(fn, en, mu);
-
-  entropy = physical_constants::kb * T * S;
   free_energy = etot + entropy;
 }
 
@@ -167,6 +218,7 @@ FreeEnergy::ks_energy_components()
 void
 FreeEnergy::compute()
 {
+  SolverStats::add(SolverStats::GetInstance().evaluations, 1);
   energy.compute();
 }
 
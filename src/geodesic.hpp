@@ -4,6 +4,8 @@
 
 #include "la/lapack.hpp"
 #include "la/utils.hpp"
+#include "operator.hpp"
+#include "overlap.hpp"
 
 namespace nlcglib {
 
@@ -23,7 +25,7 @@ struct advance_eta
   operator()(eta_t&& eta, d_eta_t&& d_eta)
   {
     auto eta_next = empty_like()(d_eta);
-    deep_copy(eta_next, eta);
+    deep_copy(eta_next, eta, "geodesic");
     add(eta_next, eval(d_eta), t);
     return eta_next;
   }
@@ -49,6 +51,7 @@ struct advance_x_eta
   double t;
 };
 
+/// eigen-decomposition of η + t Zη, Jacobi sweeps if it is nearly diagonal (host), else eigh
 struct eigvals_and_vectors
 {
   template <class eta_t>
@@ -59,6 +62,11 @@ struct eigvals_and_vectors
     auto Ul = empty_like()(eta);
     using memspace = typename decltype(Ul)::storage_t::memory_space;
     Kokkos::View<double*, memspace> ek("eigvals, eta", Ul.map().ncols());
+    if constexpr (std::is_same<memspace, Kokkos::HostSpace>::value) {
+      if (eigh_jacobi(Ul, ek, eta)) {
+        return std::make_tuple(ek, Ul);
+      }
+    }
     eigh(Ul, ek, eta);
     return std::make_tuple(ek, Ul);
   }
@@ -77,7 +85,7 @@ struct advance_x
   {
     // pp<to_layout_left_t<dx_t>>::foo;
     auto x_next = empty_like()(x);
-    deep_copy(x_next, x);
+    deep_copy(x_next, x, "geodesic");
     add(x_next, eval(dx), t);
     x_next = loewdin(x_next);
     return transform_alloc(x_next, eval(ul));
@@ -92,7 +100,7 @@ struct advance_x
   {
     // pp<to_layout_left_t<dx_t>>::foo;
     auto x_next = empty_like()(x);
-    deep_copy(x_next, x);
+    deep_copy(x_next, x, "geodesic");
     add(x_next, eval(dx), t);
     x_next = loewdin(x_next, eval(s(x_next)));
     return transform_alloc(x_next, eval(ul));
@@ -150,61 +158,163 @@ struct advance_x
 
 
 namespace impl {
-template <class X_t, class eta_t, class g_x_t, class g_eta_t, class Op_t>
-auto
-geodesic_us(
-    X_t& X, const eta_t& eta, const g_x_t& z_x, const g_eta_t& z_eta, const Op_t& S, double t)
-{
-  // compute eta_next <- eta + t* g_eta
-  auto eta_next = local::advance_eta(t)(eta, z_eta);
-  // get eigenvalues and eigenvectors of next eta
-  auto ek_Ul = local::eigvals_and_vectors()(eta_next);
-  // grab results
-  auto ek = std::get<0>(ek_Ul);
-  auto Ul = std::get<1>(ek_Ul);
-
-  // X <- ortho((X + t*g_X) @ Ul)
-  auto x_next = local::advance_x(t)(X, z_x, Ul, S);
-
-  return std::make_tuple(ek, Ul, x_next);
-}
-
 
+/// eta + t * z_eta, its eigen-decomposition and X + t * z_x (not yet orthogonal), on mem_space
 template <class mem_space_t>
-struct geodesic_us_functor
+struct geodesic_advance_functor
 {
-  geodesic_us_functor(const mem_space_t& mem_space, double t)
+  geodesic_advance_functor(const mem_space_t& mem_space, double t)
       : mem_space(mem_space)
       , t(t)
   {
   }
 
-  template <class X_t, class eta_t, class z_x_t, class z_eta_t, class Op_t>
-  auto operator()(
-      const X_t& X_h, const eta_t& eta_h, const z_x_t& z_x_h, const z_eta_t& z_eta_h, const Op_t& S)
+  template <class X_t, class eta_t, class z_x_t, class z_eta_t>
+  auto operator()(const X_t& X_h, const eta_t& eta_h, const z_x_t& z_x_h, const z_eta_t& z_eta_h)
+  {
+    return (*this)(X_h, eta_h, z_x_h, z_eta_h, X_h.map().ncols());
+  }
 
+  /// only the leading nx columns of z_x are nonzero, the others are not updated
+  template <class X_t, class eta_t, class z_x_t, class z_eta_t>
+  auto operator()(
+      const X_t& X_h, const eta_t& eta_h, const z_x_t& z_x_h, const z_eta_t& z_eta_h, int nx)
   {
-    // todo
-    auto X = create_mirror_view_and_copy(mem_space, X_h);
-    auto eta = create_mirror_view_and_copy(mem_space, eta_h);
-    auto z_x = create_mirror_view_and_copy(mem_space, z_x_h);
-    auto z_eta = create_mirror_view_and_copy(mem_space, z_eta_h);
+    auto X = create_mirror_view_and_copy(mem_space, X_h, "geodesic");
+    auto eta = create_mirror_view_and_copy(mem_space, eta_h, "geodesic");
+    auto z_x = create_mirror_view_and_copy(mem_space, z_x_h, "geodesic");
+    auto z_eta = create_mirror_view_and_copy(mem_space, z_eta_h, "geodesic");
+
+    // compute eta_next <- eta + t* g_eta
+    auto eta_next = local::advance_eta(t)(eta, z_eta);
+    // get eigenvalues and eigenvectors of next eta
+    auto ek_Ul = local::eigvals_and_vectors()(eta_next);
+    // X + t * z_x
+    auto x_next = empty_like()(X);
+    deep_copy(x_next, X, "geodesic");
+    if (nx < X.map().ncols()) {
+      auto x_lead = leading_columns(x_next, nx);
+      add(x_lead, leading_columns(z_x, nx), t);
+    } else {
+      add(x_next, z_x, t);
+    }
+
+    // eigenvalues are needed on host for the occupation numbers
+    auto ek_h =
+        copies::create_mirror_view_and_copy("geodesic", Kokkos::HostSpace(), std::get<0>(ek_Ul));
+    return std::make_tuple(ek_h, std::get<1>(ek_Ul), x_next);
+  }
 
-    auto result = eval(impl::geodesic_us(X, eta, z_x, z_eta, S, t));
+  mem_space_t mem_space;
+  double t;
+};
+
+/// X <- ortho(X) @ Ul, given S·X, results are copied to host
+struct geodesic_orth_functor
+{
+  template <class ul_t, class x_t, class sx_t>
+  auto operator()(const ul_t& Ul, const x_t& x, const sx_t& sx)
+  {
+    auto x_next = transform_alloc(loewdin(x, sx), Ul);
 
     // copy results to host
-    auto ek = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), std::get<0>(result));
-    auto Ul = create_mirror_view_and_copy(Kokkos::HostSpace(), std::get<1>(result));
-    auto x_next_h = create_mirror_view_and_copy(Kokkos::HostSpace(), std::get<2>(result));
-    return std::make_tuple(ek, Ul, x_next_h);
+    auto Ul_h = create_mirror_view_and_copy(Kokkos::HostSpace(), Ul, "geodesic");
+    auto x_next_h = create_mirror_view_and_copy(Kokkos::HostSpace(), x_next, "geodesic");
+    return std::make_tuple(Ul_h, x_next_h);
   }
 
-  mem_space_t mem_space;
-  double t;
+  /// S = I
+  template <class ul_t, class x_t>
+  auto operator()(const ul_t& Ul, const x_t& x)
+  {
+    auto x_next = transform_alloc(loewdin(x), Ul);
+
+    // copy results to host
+    auto Ul_h = create_mirror_view_and_copy(Kokkos::HostSpace(), Ul, "geodesic");
+    auto x_next_h = create_mirror_view_and_copy(Kokkos::HostSpace(), x_next, "geodesic");
+    return std::make_tuple(Ul_h, x_next_h);
+  }
 };
 
 }  // namespace impl
 
+/// First part of the geodesic, touches neither S nor the energy.
+/// returns tuple<ek (host), Ul, X + t * z_x> where the latter two reside in mem_space
+template <class mem_space_t, class X_t, class eta_t, class z_x_t, class z_eta_t>
+auto
+geodesic_prepare(const mem_space_t& mem_space,
+                 const X_t& X_h,
+                 const eta_t& eta_h,
+                 const z_x_t& z_x_h,
+                 const z_eta_t& z_eta_h,
+                 double t)
+{
+  impl::geodesic_advance_functor<mem_space_t> advance(mem_space, t);
+  return unzip(eval_threaded(tapply_async(advance, X_h, eta_h, z_x_h, z_eta_h)));
+}
+
+/// Same as above, only the leading nx columns of z_x are nonzero (frozen bands)
+template <class mem_space_t, class X_t, class eta_t, class z_x_t, class z_eta_t>
+auto
+geodesic_prepare(const mem_space_t& mem_space,
+                 const X_t& X_h,
+                 const eta_t& eta_h,
+                 const z_x_t& z_x_h,
+                 const z_eta_t& z_eta_h,
+                 const mvector<int>& nx,
+                 double t)
+{
+  impl::geodesic_advance_functor<mem_space_t> advance(mem_space, t);
+  return unzip(eval_threaded(tapply_async(advance, X_h, eta_h, z_x_h, z_eta_h, nx)));
+}
+
+/// Second part of the geodesic, orthogonalizes w.r.t. S
+/// returns tuple<ek, Ul, X> (host), sx_ws is a caller-owned workspace for S(X + t * z_x), it is
+/// not used for S = IdentityOverlap
+template <class prepared_t, class Op_t, class ws_t>
+auto
+geodesic_finalize(const prepared_t& ek_ul_x, const Op_t& S, mvector<ws_t>& sx_ws)
+{
+  auto& x_next = std::get<2>(ek_ul_x);
+
+  auto res = [&]() {
+    if constexpr (is_identity_overlap<Op_t>::value) {
+      return unzip(
+          eval_threaded(tapply_async(impl::geodesic_orth_functor(), std::get<1>(ek_ul_x), x_next)));
+    } else {
+      // S(X + t * z_x) for all k-points in a single batch
+      auto& sx_next = apply_op_batch(S, x_next, sx_ws);
+      return unzip(eval_threaded(
+          tapply_async(impl::geodesic_orth_functor(), std::get<1>(ek_ul_x), x_next, sx_next)));
+    }
+  }();
+
+  return std::make_tuple(std::get<0>(ek_ul_x), std::get<0>(res), std::get<1>(res));
+}
+
+/// Geodesic for Ultrasoft PP formulation
+/// returns tuple<ek, Ul, X>, sx_ws is a caller-owned workspace for S(X + t * z_x)
+template <class mem_space_t,
+          class X_t,
+          class eta_t,
+          class z_x_t,
+          class z_eta_t,
+          class Op_t,
+          class ws_t>
+auto
+geodesic(const mem_space_t& mem_space,
+         const X_t& X_h,
+         const eta_t& eta_h,
+         const z_x_t& z_x_h,
+         const z_eta_t& z_eta_h,
+         const Op_t& S,
+         double t,
+         mvector<ws_t>& sx_ws)
+{
+  auto ek_ul_x = geodesic_prepare(mem_space, X_h, eta_h, z_x_h, z_eta_h, t);
+  return geodesic_finalize(ek_ul_x, S, sx_ws);
+}
+
 /// Geodesic for Ultrasoft PP formulation
 /// returns tuple<ek, Ul, X>
 template <class mem_space_t, class X_t, class eta_t, class z_x_t, class z_eta_t, class Op_t>
@@ -217,11 +327,12 @@ geodesic(const mem_space_t& mem_space,
          const Op_t& S,
          double t)
 {
-  impl::geodesic_us_functor<mem_space_t> functor(mem_space, t);
-
-  auto res = tapply_async(functor, X_h, eta_h, z_x_h, z_eta_h, S);
-
-  return unzip(eval_threaded(res));
+  using matrix_t = KokkosDVector<Kokkos::complex<double>**,
+                                 SlabLayoutV,
+                                 Kokkos::LayoutLeft,
+                                 mem_space_t>;
+  mvector<matrix_t> sx_ws;
+  return geodesic(mem_space, X_h, eta_h, z_x_h, z_eta_h, S, t, sx_ws);
 }
 
 
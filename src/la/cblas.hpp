@@ -11,6 +11,7 @@
 
 #include <Kokkos_Core.hpp>
 #include <complex>
+#include "la/thread_budget.hpp"
 
 
 #ifdef __USE_MKL
@@ -220,6 +221,7 @@ struct gemm<std::complex<double>> : blas_base
                           std::complex<double> *C,
                           const int ldc)
   {
+    blas_threads_guard threads(M, N, K);
     cblas_zgemm(Order,
                 TransA,
                 TransB,
@@ -257,6 +259,7 @@ struct gemm<Kokkos::complex<double>> : blas_base
                           Kokkos::complex<double> *C,
                           const int ldc)
   {
+    blas_threads_guard threads(M, N, K);
     cblas_zgemm(Order,
                 TransA,
                 TransB,
@@ -294,6 +297,7 @@ struct gemm<double> : blas_base
                           double *C,
                           const int ld)
   {
+    blas_threads_guard threads(M, N, K);
     cblas_dgemm(Order, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ld);
   }
 };
@@ -377,8 +381,24 @@ struct geam<Kokkos::complex<double>> : blas_base
     std::complex<double> alpha_{alpha.real(), alpha.imag()};
     std::complex<double> beta_{beta.real(), beta.imag()};
 
+    bool real_coeffs = alpha.imag() == 0 && beta.imag() == 0;
     if (TransA == CBLAS_TRANSPOSE::CblasNoTrans && TransB == CBLAS_TRANSPOSE::CblasNoTrans &&
-        Order == CblasColMajor) {
+        Order == CblasColMajor && real_coeffs) {
+      // real coefficients: a column is a stream of 2 * M doubles, no shuffles of the interleaved
+      // real and imaginary parts
+      double a = alpha.real();
+      double b = beta.real();
+#pragma omp parallel for
+      for (auto j = 0ul; j < N; ++j) {
+        auto dA = reinterpret_cast<const double *>(A + lda * j);
+        auto dB = reinterpret_cast<const double *>(B + ldb * j);
+        auto dC = reinterpret_cast<double *>(C + ldc * j);
+        for (auto i = 0ul; i < 2 * M; ++i) {
+          dC[i] = a * dA[i] + b * dB[i];
+        }
+      }
+    } else if (TransA == CBLAS_TRANSPOSE::CblasNoTrans &&
+               TransB == CBLAS_TRANSPOSE::CblasNoTrans && Order == CblasColMajor) {
 #pragma omp parallel for
       for (auto j = 0ul; j < N; ++j) {
         for (auto i = 0ul; i < M; ++i) {
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "csingleton.hpp"
+#include "la/counter_table.hpp"
+#include "utils/env.hpp"
+#include "utils/solver_stats.hpp"
+
+namespace nlcglib {
+
+/**
+ * Accounting of deep copies and mirror creations by call site (NLCGLIB_COPY_COUNTERS=1).
+ *
+ * Every copy goes through copies::deep_copy / copies::create_mirror_view_and_copy (or
+ * copies::record for raw memcpys) with a label of the call site. Counts are accumulated per
+ * (site, source space -> destination space) for the current iteration and for the whole run;
+ * create_mirror_view_and_copy into the space the data already lives in returns an alias, these
+ * calls are counted as aliases without bytes. Copies between different memory spaces are always
+ * added to SolverStats::bytes_copied.
+ */
+struct copy_counter_entry
+{
+  long calls{0};
+  long aliases{0};
+  double bytes{0};
+};
+
+class CopyCounters : public CSingleton<CopyCounters>, public counter_table<copy_counter_entry>
+{
+public:
+  CopyCounters()
+      : enabled(env::get_copy_counters())
+  {
+  }
+
+  void add(const char* site, const char* src, const char* dst, double bytes, bool alias)
+  {
+    update(std::string(site) + " " + src + "->" + dst, [&](entry& e) {
+      e.calls++;
+      if (alias) {
+        e.aliases++;
+      } else {
+        e.bytes += bytes;
+      }
+    });
+  }
+
+  /// one line per (site, spaces), ranked by the copied volume
+  static std::string format(const table_t& table)
+  {
+    std::vector<std::pair<std::string, entry>> ranked(table.begin(), table.end());
+    std::stable_sort(ranked.begin(), ranked.end(), [](auto& a, auto& b) {
+      return a.second.bytes > b.second.bytes;
+    });
+    double sum{0};
+    for (auto& e : ranked) sum += e.second.bytes;
+
+    std::stringstream out;
+    out << std::left << std::setw(44) << "site src->dst" << std::right << std::setw(8) << "calls"
+        << std::setw(8) << "alias" << std::setw(12) << "MB" << std::setw(8) << "%"
+        << "\n";
+    out << std::fixed;
+    for (auto& [key, e] : ranked) {
+      out << std::left << std::setw(44) << key << std::right << std::setw(8) << e.calls
+          << std::setw(8) << e.aliases << std::setprecision(3) << std::setw(12) << e.bytes * 1e-6
+          << std::setprecision(1) << std::setw(8) << (sum > 0 ? 100 * e.bytes / sum : 0.0)
+          << "\n";
+    }
+    return out.str();
+  }
+
+public:
+  bool enabled{false};
+};
+
+namespace copies {
+
+template <class SPACE>
+constexpr const char*
+space_name()
+{
+  return std::is_same<typename SPACE::memory_space, Kokkos::HostSpace>::value ? "host" : "device";
+}
+
+/// account a copy of bytes from src to dst (space names), alias: no data was moved
+inline void
+record(const char* site, const char* src, const char* dst, double bytes, bool alias = false)
+{
+  if (!alias && std::strcmp(src, dst) != 0) stats::count_copy(bytes);
+  auto& counters = CopyCounters::GetInstance();
+  if (counters.enabled) counters.add(site, src, dst, bytes, alias);
+}
+
+template <class V>
+double
+bytes(const V& v)
+{
+  return double(v.size()) * sizeof(typename V::value_type);
+}
+
+/// Kokkos::deep_copy(dst, src) of views
+template <class DST, class SRC>
+void
+deep_copy(const char* site, const DST& dst, const SRC& src)
+{
+  record(site,
+         space_name<typename SRC::memory_space>(),
+         space_name<typename DST::memory_space>(),
+         bytes(src),
+         static_cast<const void*>(dst.data()) == static_cast<const void*>(src.data()));
+  Kokkos::deep_copy(dst, src);
+}
+
+/// Kokkos::create_mirror_view_and_copy(space, src) of views
+template <class SPACE, class SRC>
+auto
+create_mirror_view_and_copy(const char* site, const SPACE& space, const SRC& src)
+{
+  auto dst = Kokkos::create_mirror_view_and_copy(space, src);
+  record(site,
+         space_name<typename SRC::memory_space>(),
+         space_name<typename SPACE::memory_space>(),
+         bytes(src),
+         static_cast<const void*>(dst.data()) == static_cast<const void*>(src.data()));
+  return dst;
+}
+
+}  // namespace copies
+
+}  // namespace nlcglib
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace nlcglib {
+
+/**
+ * Counters keyed by a label, accumulated both for the current iteration and for the whole run.
+ * Updates are serialized by a mutex. Base of LaCounters and CopyCounters, ENTRY is the record of
+ * a single label.
+ */
+template <class ENTRY>
+class counter_table
+{
+public:
+  using entry = ENTRY;
+  using table_t = std::map<std::string, ENTRY>;
+
+public:
+  /// calls f(entry&) on the entry of key, in the iteration and in the run table
+  template <class F>
+  void update(const std::string& key, F&& f)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto* table : {&iteration_, &total_}) {
+      f((*table)[key]);
+    }
+  }
+
+  /// counts since the last call, starts a new iteration
+  table_t next_iteration()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    table_t out;
+    std::swap(out, iteration_);
+    return out;
+  }
+
+  const table_t& total() const { return total_; }
+
+  void reset()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    iteration_.clear();
+    total_.clear();
+  }
+
+private:
+  std::mutex mutex_;
+  table_t iteration_;
+  table_t total_;
+};
+
+}  // namespace nlcglib
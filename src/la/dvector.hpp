@@ -10,6 +10,7 @@
 #include <utility>
 #include "map.hpp"
 #include "nlcglib.hpp"
+#include "copy_counters.hpp"
 
 namespace nlcglib {
 
@@ -255,27 +256,33 @@ KokkosDVector<T, LAYOUT, KOKKOS_ARGS...>::copy(std::string label) const
 
   KokkosDVector Result(this->map_, Kokkos::view_alloc(Kokkos::WithoutInitializing, label));
 
-  Kokkos::deep_copy(Result.array(), this->array());
+  copies::deep_copy("KokkosDVector::copy", Result.array(), this->array());
   return Result;
 }
 
 
+/// site: call site label for the copy accounting (copy_counters.hpp)
 template <class T1, class L1, class... KOKKOS1, class T2, class L2, class... KOKKOS2>
 inline void
-deep_copy(KokkosDVector<T1, L1, KOKKOS1...>& dst, const KokkosDVector<T2, L2, KOKKOS2...>& src)
+deep_copy(KokkosDVector<T1, L1, KOKKOS1...>& dst,
+          const KokkosDVector<T2, L2, KOKKOS2...>& src,
+          const char* site = "deep_copy")
 {
   static_assert(std::is_same<L1, L2>::value, "deep_copy requires identical layouts");
-  Kokkos::deep_copy(dst.array(), src.array());
+  copies::deep_copy(site, dst.array(), src.array());
 }
 
 
+/// site: call site label for the copy accounting (copy_counters.hpp)
 template <class KokkosSpace, class T2, class L2, class... KOKKOS2>
 inline auto
-create_mirror_view_and_copy(const KokkosSpace& Space, const KokkosDVector<T2, L2, KOKKOS2...>& src)
+create_mirror_view_and_copy(const KokkosSpace& Space,
+                            const KokkosDVector<T2, L2, KOKKOS2...>& src,
+                            const char* site = "create_mirror_view_and_copy")
 {
   // TODO: we are hardcoding LayoutLeft for return type here.
   using ret = KokkosDVector<T2, L2, Kokkos::LayoutLeft, KokkosSpace>;
-  auto dst = Kokkos::create_mirror_view_and_copy(Space, src.array());
+  auto dst = copies::create_mirror_view_and_copy(site, Space, src.array());
   return ret(src.map(), dst);
 }
 
@@ -302,7 +309,7 @@ create_host_mirror(KokkosDVector<T**, LAYOUT, KOKKOS_ARGS...>& other)
 {
   using return_t = KokkosDVector<T**, LAYOUT, Kokkos::LayoutLeft, Kokkos::HostSpace>;
   return_t out(other.map());
-  deep_copy(out, other);
+  deep_copy(out, other, "create_host_mirror");
   return out;
 }
 
@@ -313,7 +320,7 @@ create_host_mirror(const KokkosDVector<T*, LAYOUT, KOKKOS_ARGS...>& other)
 {
   using return_t = KokkosDVector<T*, LAYOUT, Kokkos::HostSpace>;
   return_t out(other.map());
-  deep_copy(out, other);
+  deep_copy(out, other, "create_host_mirror");
   return out;
 }
 
@@ -324,7 +331,7 @@ create_mirror_view_and_copy(const KokkosDVector<T*, LAYOUT, KOKKOS_ARGS...>& oth
 {
   using return_t = KokkosDVector<T*, LAYOUT, Kokkos::HostSpace>;
   return_t out(other.map());
-  deep_copy(out, other);
+  deep_copy(out, other, "create_mirror_view_and_copy");
   return out;
 }
 
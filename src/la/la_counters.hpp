@@ -0,0 +1,172 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+#include <chrono>
+#include <complex>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include "csingleton.hpp"
+#include "la/counter_table.hpp"
+#include "utils/env.hpp"
+
+namespace nlcglib {
+
+/**
+ * Analytic flop and byte counts of the LA wrappers for roofline analysis (NLCGLIB_LA_COUNTERS=1).
+ *
+ * Each instrumented wrapper opens an la_counter with the flops and bytes of the call (the bytes
+ * are the compulsory traffic: every operand read once, every result written once). The wall time
+ * of the call is measured with a Kokkos::fence at the end, the counters therefore serialize
+ * asynchronous device kernels and are disabled by default. Counts are accumulated per
+ * (phase, kernel), the phase is set by la_phase in the caller (e.g. line search, descent
+ * direction), both for the current iteration and for the whole run.
+ */
+struct la_counter_entry
+{
+  long calls{0};
+  double flops{0};
+  double bytes{0};
+  double seconds{0};
+};
+
+class LaCounters : public CSingleton<LaCounters>, public counter_table<la_counter_entry>
+{
+public:
+  LaCounters()
+      : enabled(env::get_la_counters())
+  {
+  }
+
+  void add(const char* kernel, double flops, double bytes, double seconds)
+  {
+    update(phase + "/" + kernel, [&](entry& e) {
+      e.calls++;
+      e.flops += flops;
+      e.bytes += bytes;
+      e.seconds += seconds;
+    });
+  }
+
+  /// one line per (phase, kernel): calls, GFLOP, GB, seconds, GFLOP/s, GB/s, arithmetic intensity
+  static std::string format(const table_t& table)
+  {
+    std::stringstream out;
+    out << std::left << std::setw(32) << "phase/kernel" << std::right << std::setw(8) << "calls"
+        << std::setw(11) << "GFLOP" << std::setw(11) << "GB" << std::setw(11) << "time [s]"
+        << std::setw(11) << "GFLOP/s" << std::setw(11) << "GB/s" << std::setw(11) << "flop/B"
+        << "\n";
+    out << std::fixed;
+    for (auto& [key, e] : table) {
+      double t = std::max(e.seconds, 1e-12);
+      out << std::left << std::setw(32) << key << std::right << std::setw(8) << e.calls
+          << std::setprecision(3) << std::setw(11) << e.flops * 1e-9 << std::setw(11)
+          << e.bytes * 1e-9 << std::setw(11) << e.seconds << std::setw(11) << e.flops * 1e-9 / t
+          << std::setw(11) << e.bytes * 1e-9 / t << std::setw(11)
+          << (e.bytes > 0 ? e.flops / e.bytes : 0.0) << "\n";
+    }
+    return out.str();
+  }
+
+public:
+  bool enabled{false};
+  /// label of the current phase, set by la_phase
+  std::string phase{"other"};
+};
+
+/// RAII: counts a single call of an LA wrapper
+class la_counter
+{
+public:
+  la_counter(const char* kernel, double flops, double bytes)
+      : counters_(LaCounters::GetInstance())
+  {
+    if (!counters_.enabled) return;
+    kernel_ = kernel;
+    flops_ = flops;
+    bytes_ = bytes;
+    t_ = std::chrono::high_resolution_clock::now();
+  }
+
+  ~la_counter()
+  {
+    if (!counters_.enabled) return;
+    Kokkos::fence();
+    auto now = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(now - t_).count();
+    counters_.add(kernel_, flops_, bytes_, seconds);
+  }
+
+  la_counter(const la_counter&) = delete;
+  la_counter& operator=(const la_counter&) = delete;
+
+private:
+  LaCounters& counters_;
+  const char* kernel_{nullptr};
+  double flops_{0};
+  double bytes_{0};
+  std::chrono::high_resolution_clock::time_point t_;
+};
+
+/// RAII: sets the phase of the LA counters, restores the previous phase
+class la_phase
+{
+public:
+  la_phase(const char* phase)
+      : prev_(LaCounters::GetInstance().phase)
+  {
+    LaCounters::GetInstance().phase = phase;
+  }
+
+  ~la_phase() { LaCounters::GetInstance().phase = prev_; }
+
+  la_phase(const la_phase&) = delete;
+  la_phase& operator=(const la_phase&) = delete;
+
+private:
+  std::string prev_;
+};
+
+/// flops of scalar operations in T (double or complex double: mul 6, add 2, multiply-add 8)
+namespace flops {
+
+template <class T>
+constexpr bool
+is_complex()
+{
+  return sizeof(T) == 2 * sizeof(double);
+}
+
+template <class T>
+constexpr double
+fma()
+{
+  return is_complex<T>() ? 8 : 2;
+}
+
+template <class T>
+constexpr double
+mul()
+{
+  return is_complex<T>() ? 6 : 1;
+}
+
+template <class T>
+constexpr double
+add()
+{
+  return is_complex<T>() ? 2 : 1;
+}
+
+/// multiplication by a real scalar
+template <class T>
+constexpr double
+scal()
+{
+  return is_complex<T>() ? 2 : 1;
+}
+
+}  // namespace flops
+
+}  // namespace nlcglib
@@ -2,7 +2,10 @@
 
 #include <Kokkos_HIP_Space.hpp>
 #include <functional>
+#include <type_traits>
 #include <utility>
+#include <vector>
+#include "la/la_counters.hpp"
 #include "la/map.hpp"
 #include "lapack_cpu.hpp"
 #ifdef __NLCGLIB__CUDA
@@ -83,18 +86,19 @@ scale(M0& dst, const M1& src, const Kokkos::View<T2*, KOKKOS2...>& x, double alp
 
   using vector_t = M0;
   using memspace = typename vector_t::storage_t::memory_space;
-  typedef Kokkos::MDRangePolicy<Kokkos::Rank<2>, exec_t<memspace>> mdrange_policy;
+  using numeric_t = typename vector_t::numeric_t;
+  la_counter counter("scale",
+                     (beta == 0 ? 1 : 2) * flops::scal<numeric_t>() * m * double(n),
+                     (beta == 0 ? 2 : 3) * sizeof(numeric_t) * m * double(n));
   if (src.array().stride(0) == 1) {
     if (beta == 0)
-      Kokkos::parallel_for(
-          "scale", mdrange_policy({{0, 0}}, {{m, n}}), KOKKOS_LAMBDA(int i, int j) {
-            mDST(i, j) = alpha * x(j) * mSRC(i, j);
-          });
+      parallel_for_columns<memspace>("scale", m, n, KOKKOS_LAMBDA(int i, int j) {
+        mDST(i, j) = alpha * x(j) * mSRC(i, j);
+      });
     else
-      Kokkos::parallel_for(
-          "scale", mdrange_policy({{0, 0}}, {{m, n}}), KOKKOS_LAMBDA(int i, int j) {
-            mDST(i, j) = mDST(i, j) * beta + alpha * x(j) * mSRC(i, j);
-          });
+      parallel_for_columns<memspace>("scale", m, n, KOKKOS_LAMBDA(int i, int j) {
+        mDST(i, j) = mDST(i, j) * beta + alpha * x(j) * mSRC(i, j);
+      });
   } else {
     throw std::runtime_error("invalid stride");
   }
@@ -121,19 +125,19 @@ scale(M1& dst, const M2& src, double alpha, double beta)
 
   using vector_t = M1;
   using memspace = typename vector_t::storage_t::memory_space;
-  typedef Kokkos::MDRangePolicy<Kokkos::Rank<2>, exec_t<memspace>> mdrange_policy;
+  using numeric_t = typename vector_t::numeric_t;
+  la_counter counter("scale",
+                     (beta == 0 ? 1 : 2) * flops::scal<numeric_t>() * m * double(n),
+                     (beta == 0 ? 2 : 3) * sizeof(numeric_t) * m * double(n));
   if (src.array().stride(0) == 1) {
     if (beta == 0)
-      Kokkos::parallel_for(
-          "scale", mdrange_policy({{0, 0}}, {{m, n}}), KOKKOS_LAMBDA(int i, int j) {
-            mDST(i, j) = alpha * mSRC(i, j);
-          });
-
+      parallel_for_columns<memspace>("scale", m, n, KOKKOS_LAMBDA(int i, int j) {
+        mDST(i, j) = alpha * mSRC(i, j);
+      });
     else
-      Kokkos::parallel_for(
-          "scale", mdrange_policy({{0, 0}}, {{m, n}}), KOKKOS_LAMBDA(int i, int j) {
-            mDST(i, j) = mDST(i, j) * beta + alpha * mSRC(i, j);
-          });
+      parallel_for_columns<memspace>("scale", m, n, KOKKOS_LAMBDA(int i, int j) {
+        mDST(i, j) = mDST(i, j) * beta + alpha * mSRC(i, j);
+      });
   } else {
     throw std::runtime_error("no suitable ExecutionSpace found.");
   }
@@ -159,12 +163,13 @@ scale(M1& dst, const M2& src, double alpha)
 
   using vector_t = M1;
   using memspace = typename vector_t::storage_t::memory_space;
-  typedef Kokkos::MDRangePolicy<Kokkos::Rank<2>, exec_t<memspace>> mdrange_policy;
+  using numeric_t = typename vector_t::numeric_t;
+  la_counter counter(
+      "scale", flops::scal<numeric_t>() * m * double(n), 2 * sizeof(numeric_t) * m * double(n));
   if (src.array().stride(0) == 1) {
-    Kokkos::parallel_for(
-        "scale", mdrange_policy({{0, 0}}, {{m, n}}), KOKKOS_LAMBDA(int i, int j) {
-          mDST(i, j) = alpha * mSRC(i, j);
-        });
+    parallel_for_columns<memspace>("scale", m, n, KOKKOS_LAMBDA(int i, int j) {
+      mDST(i, j) = alpha * mSRC(i, j);
+    });
   } else {
     throw std::runtime_error("invalid strides.");
   }
@@ -216,17 +221,59 @@ _add(KokkosDVector<T1**, LAYOUT0, KOKKOS0...>& dst,
   int n = mSRC.extent(1);
   assert(mSRC.extent(0) == mDST.extent(0));
   assert(mSRC.extent(1) == mDST.extent(1));
-  typedef Kokkos::MDRangePolicy<Kokkos::Rank<2>, exec_t<memspace>> mdrange_policy;
+  la_counter counter("add",
+                     (beta == T1{0} ? flops::mul<T>()
+                                    : 2 * flops::mul<T>() + flops::add<T>()) * m * double(n),
+                     (beta == T1{0} ? 2 : 3) * sizeof(T) * m * double(n));
   if (beta == T1{0})
-    Kokkos::parallel_for(
-        "add", mdrange_policy({0, 0}, {m, n}), KOKKOS_LAMBDA(int i, int j) {
-          mDST(i, j) = alpha * mSRC(i, j);
-        });
+    parallel_for_columns<memspace>("add", m, n, KOKKOS_LAMBDA(int i, int j) {
+      mDST(i, j) = alpha * mSRC(i, j);
+    });
   else
-    Kokkos::parallel_for(
-        "add", mdrange_policy({0, 0}, {m, n}), KOKKOS_LAMBDA(int i, int j) {
-          mDST(i, j) = mDST(i, j) * beta + alpha * mSRC(i, j);
-        });
+    parallel_for_columns<memspace>("add", m, n, KOKKOS_LAMBDA(int i, int j) {
+      mDST(i, j) = mDST(i, j) * beta + alpha * mSRC(i, j);
+    });
+}
+
+/// dst <- α * src + Σ_l c_l * v_l, single pass over dst, at most MAX_TERMS matrices v_l
+template <int MAX_TERMS, class T1, class M2, class M3, class LAYOUT0, class... KOKKOS0>
+void
+lincomb(KokkosDVector<T1**, LAYOUT0, KOKKOS0...>& dst,
+        const M2& src,
+        const identity_t<T1>& alpha,
+        const std::vector<const M3*>& v,
+        const std::vector<T1>& c)
+{
+  using vector_t = KokkosDVector<T1**, LAYOUT0, KOKKOS0...>;
+  using memspace = typename vector_t::storage_t::memory_space;
+
+  if (v.size() > MAX_TERMS || v.size() != c.size()) {
+    throw std::runtime_error("lincomb: invalid number of terms");
+  }
+  auto mDST = dst.array();
+  auto mSRC = src.array();
+  int m = mSRC.extent(0);
+  int n = mSRC.extent(1);
+  int nt = v.size();
+  Kokkos::Array<const T1*, MAX_TERMS> ptr;
+  Kokkos::Array<int, MAX_TERMS> ld;
+  Kokkos::Array<T1, MAX_TERMS> coeff;
+  for (int l = 0; l < nt; ++l) {
+    assert(v[l]->array().extent(0) == m && v[l]->array().extent(1) == n);
+    ptr[l] = v[l]->array().data();
+    ld[l] = v[l]->array().stride(1);
+    coeff[l] = c[l];
+  }
+  la_counter counter("lincomb",
+                     (nt + 1) * (flops::mul<T1>() + flops::add<T1>()) * m * double(n),
+                     (nt + 2) * sizeof(T1) * m * double(n));
+  parallel_for_columns<memspace>("lincomb", m, n, KOKKOS_LAMBDA(int i, int j) {
+    T1 z = alpha * mSRC(i, j);
+    for (int l = 0; l < nt; ++l) {
+      z += coeff[l] * ptr[l][i + ld[l] * j];
+    }
+    mDST(i, j) = z;
+  });
 }
 
 struct inner_
@@ -271,6 +318,9 @@ struct innerh_tr
     auto y = Y.array();
 
     T sum{0};
+    la_counter counter("innerh_tr",
+                       flops::fma<T>() * nrows * double(ncols),
+                       2 * sizeof(T) * nrows * double(ncols));
 
     // inner_reduce along rows
     Kokkos::parallel_for(
@@ -303,29 +353,94 @@ struct innerh_tr
 
     using memory_space = typename matrix_t::storage_t::memory_space;
 
-    Kokkos::View<T*, memory_space> tmp("", nrows);
+    Kokkos::View<T*, memory_space> tmp("", ncols);
 
     auto x = X.array();
     auto y = Y.array();
 
     T sum{0};
-    // compute on host
+    la_counter counter("innerh_tr",
+                       flops::fma<T>() * nrows * double(ncols),
+                       2 * sizeof(T) * nrows * double(ncols));
+    // compute on host, a column per iteration (contiguous rows)
     Kokkos::parallel_for(
-        "", Kokkos::RangePolicy<exec_t<memory_space>>(0, nrows), KOKKOS_LAMBDA(int i) {
-          for (int j = 0; j < ncols; ++j) {
-            tmp(i) += x(i, j) * Kokkos::conj(y(i, j));
+        "innerh_tr", Kokkos::RangePolicy<exec_t<memory_space>>(0, ncols), KOKKOS_LAMBDA(int j) {
+          if constexpr (std::is_same<T, Kokkos::complex<double>>::value) {
+            // real and imaginary part of x conj(y) in separate partial sums: the lanes vectorize
+            // without reassociation of the sum and without shuffles of the interleaved storage
+            constexpr int lanes = 8;
+            double re[lanes] = {};
+            double im[lanes] = {};
+            int i0 = nrows - nrows % lanes;
+            for (int i = 0; i < i0; i += lanes) {
+              for (int l = 0; l < lanes; ++l) {
+                auto a = x(i + l, j);
+                auto b = y(i + l, j);
+                re[l] += a.real() * b.real() + a.imag() * b.imag();
+                im[l] += a.imag() * b.real() - a.real() * b.imag();
+              }
+            }
+            for (int i = i0; i < nrows; ++i) {
+              auto a = x(i, j);
+              auto b = y(i, j);
+              re[0] += a.real() * b.real() + a.imag() * b.imag();
+              im[0] += a.imag() * b.real() - a.real() * b.imag();
+            }
+            for (int l = 1; l < lanes; ++l) {
+              re[0] += re[l];
+              im[0] += im[l];
+            }
+            tmp(j) = T(re[0], im[0]);
+          } else {
+            T s{0};
+            for (int i = 0; i < nrows; ++i) {
+              s += x(i, j) * Kokkos::conj(y(i, j));
+            }
+            tmp(j) = s;
           }
         });
     Kokkos::parallel_reduce(
         "",
-        Kokkos::RangePolicy<Kokkos::Serial>(0, nrows),
-        KOKKOS_LAMBDA(int i, T& lsum) { lsum += tmp(i); },
+        Kokkos::RangePolicy<Kokkos::Serial>(0, ncols),
+        KOKKOS_LAMBDA(int j, T& lsum) { lsum += tmp(j); },
         sum);
 
     return sum;
   }
 };
 
+/// Real part of the Hermitian inner product of each column, res(j) = Re <X(:, j), Y(:, j)>
+struct innerh_cols
+{
+  template <class M1, class M2>
+  Kokkos::View<double*, typename M1::storage_t::memory_space> operator()(const M1& X, const M2& Y)
+  {
+    int nrows = X.array().extent(0);
+    int ncols = X.array().extent(1);
+
+    using memory_space = typename M1::storage_t::memory_space;
+    Kokkos::View<double*, memory_space> res("innerh_cols", ncols);
+
+    auto x = X.array();
+    auto y = Y.array();
+    using T = typename M1::numeric_t;
+    // Re(conj(x) y): 2 multiply-adds (real)
+    la_counter counter("innerh_cols",
+                       4.0 * nrows * double(ncols),
+                       2 * sizeof(T) * nrows * double(ncols));
+
+    Kokkos::parallel_for(
+        "innerh_cols", Kokkos::RangePolicy<exec_t<memory_space>>(0, ncols), KOKKOS_LAMBDA(int j) {
+          double s{0};
+          for (int i = 0; i < nrows; ++i) {
+            s += (Kokkos::conj(x(i, j)) * y(i, j)).real();
+          }
+          res(j) = s;
+        });
+    return res;
+  }
+};
+
 template <class X, class Y>
 Kokkos::complex<double>
 innerh_reduce(const mvector<X>& x, const mvector<Y>& y)
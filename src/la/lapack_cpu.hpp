@@ -6,9 +6,18 @@
 #include <lapacke.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <numeric>
+#include <string>
 #include <type_traits>
+#include <vector>
 #include "la/cblas.hpp"
 #include "la/dvector.hpp"
+#include "la/la_counters.hpp"
+#include "la/small_kernels.hpp"
+#include "utils/solver_stats.hpp"
 
 #ifdef __USE_MKL
 #define CPX MKL_Complex16
@@ -30,21 +39,32 @@ eigh(KokkosDVector<T, LAYOUT, KOKKOS...>& U,
 {
   static_assert(std::is_same<decltype(S.array().layout()), Kokkos::LayoutLeft>::value,
                 "must be col-major layout");
+  stats::phase_timer timer(SolverStats::GetInstance().ns_small_matrices);
   int lda = U.array().stride(1);
 
   // check number of MPI ranks in communicator
   if (S.map().is_local()) {
     int n = U.map().ncols();
-    Kokkos::deep_copy(U.array(), S.array());
-    lapack_int info = LAPACKE_zheevd(
-        LAPACK_COL_MAJOR,                                           /* matrix layout */
-        'V',                                                        /* jobz */
-        'U',                                                        /* uplot */
-        n,                                                          /* matrix size */
-        reinterpret_cast<lapack_complex_double*>(U.array().data()), /* Complex double */
-        lda,                                                        /* lda */
-        w.data()                                                    /* eigenvalues */
-    );
+    using numeric_t = typename KokkosDVector<T, LAYOUT, KOKKOS...>::numeric_t;
+    lapack_int info{0};
+    {
+      // ~9 n^3 operations for the eigenvalues and vectors (Golub & Van Loan), each charged as a
+      // complex multiplication (flops::mul, 6 flops), the counter covers the local LAPACK call only
+      la_counter counter("eigh",
+                         9 * flops::mul<numeric_t>() * n * n * double(n),
+                         2 * sizeof(numeric_t) * double(n) * n);
+      copies::deep_copy("eigh", U.array(), S.array());
+      blas_threads_guard threads(n, n, n);
+      info = LAPACKE_zheevd(
+          LAPACK_COL_MAJOR,                                           /* matrix layout */
+          'V',                                                        /* jobz */
+          'U',                                                        /* uplot */
+          n,                                                          /* matrix size */
+          reinterpret_cast<lapack_complex_double*>(U.array().data()), /* Complex double */
+          lda,                                                        /* lda */
+          w.data()                                                    /* eigenvalues */
+      );
+    }
     if (info != 0) throw std::runtime_error("cblas zheevd failed");
   } else {
     throw std::runtime_error("not yet implemented");
@@ -52,12 +72,138 @@ eigh(KokkosDVector<T, LAYOUT, KOKKOS...>& U,
 }
 
 
+/**
+ * Hermitian eigenvalue problem for a nearly diagonal matrix S by cyclic Jacobi sweeps (CPU).
+ *
+ * Intended for η + t Zη along the line search, where η is diagonal and t Zη is a perturbation:
+ * rotations with |s_pq| below tol * |S|_F / n are skipped (e.g. the zero blocks of Zη), U stays close
+ * to the identity. A sweep costs O(n) per rotated entry, it beats zheevd only if few off-diagonal
+ * entries are significant. Returns false without touching U, w if there are more than
+ * max_density * n significant entries (upper triangle), if the off-diagonal part exceeds
+ * max_off * |S|_F or if the sweeps do not converge, the caller falls back to eigh.
+ * Eigenvalues are returned in ascending order (as eigh).
+ */
+template <class T, class LAYOUT, class... KOKKOS>
+std::enable_if_t<std::is_same<typename KokkosDVector<T, LAYOUT, KOKKOS...>::storage_t::memory_space,
+                              Kokkos::HostSpace>::value,
+                 bool>
+eigh_jacobi(KokkosDVector<T, LAYOUT, KOKKOS...>& U,
+            Kokkos::View<double*, Kokkos::HostSpace>& w,
+            const KokkosDVector<T, LAYOUT, KOKKOS...>& S,
+            double max_density = 1,
+            double max_off = 0.1,
+            int max_sweeps = 10,
+            double tol = 1e-14)
+{
+  stats::phase_timer timer(SolverStats::GetInstance().ns_small_matrices);
+  using cpx = std::complex<double>;
+  if (!S.map().is_local()) return false;
+  int n = S.map().ncols();
+  auto S_arr = S.array();
+
+  // column-major copy of S
+  std::vector<cpx> a(n * n);
+  double norm2{0}, off2{0};
+  for (int j = 0; j < n; ++j) {
+    for (int i = 0; i < n; ++i) {
+      cpx v(S_arr(i, j).real(), S_arr(i, j).imag());
+      a[i + n * j] = v;
+      norm2 += std::norm(v);
+      if (i != j) off2 += std::norm(v);
+    }
+  }
+  if (off2 > max_off * max_off * norm2) return false;
+  // converged if |offdiag(A)|_F < thr, entries below thr / n are not rotated
+  double thr = tol * std::sqrt(norm2);
+  double thr_el = thr / n;
+  int nsignificant{0};
+  for (int j = 0; j < n; ++j) {
+    for (int i = 0; i < j; ++i) {
+      nsignificant += std::abs(a[i + n * j]) > thr_el;
+    }
+  }
+  if (nsignificant > max_density * n) return false;
+
+  std::vector<cpx> v(n * n, cpx{0});
+  for (int i = 0; i < n; ++i) v[i + n * i] = 1;
+  bool converged = off2 <= thr * thr;
+  for (int sweep = 0; sweep < max_sweeps && !converged; ++sweep) {
+    for (int p = 0; p < n - 1; ++p) {
+      for (int q = p + 1; q < n; ++q) {
+        cpx apq = a[p + n * q];
+        double r = std::abs(apq);
+        if (r <= thr_el) continue;
+        // J = D R D^H, D = diag(1, e^{-iφ}) makes the (p, q) entry real, R is a real rotation
+        cpx e = apq / r;
+        double theta = (a[q + n * q].real() - a[p + n * p].real()) / (2 * r);
+        double t = (theta >= 0 ? 1. : -1.) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+        double c = 1 / std::sqrt(t * t + 1);
+        double s = t * c;
+        cpx sp = s * std::conj(e);
+        cpx sq = s * e;
+        double app = a[p + n * p].real() - t * r;
+        double aqq = a[q + n * q].real() + t * r;
+        // A <- J^H A J: columns p, q (contiguous), rows p, q follow from hermiticity
+        cpx* ap = &a[n * p];
+        cpx* aq = &a[n * q];
+        for (int k = 0; k < n; ++k) {
+          cpx akp = ap[k], akq = aq[k];
+          ap[k] = c * akp - sp * akq;
+          aq[k] = sq * akp + c * akq;
+        }
+        for (int k = 0; k < n; ++k) {
+          a[p + n * k] = std::conj(ap[k]);
+          a[q + n * k] = std::conj(aq[k]);
+        }
+        a[p + n * p] = app;
+        a[q + n * q] = aqq;
+        a[p + n * q] = 0;
+        a[q + n * p] = 0;
+        // V <- V J
+        cpx* vp = &v[n * p];
+        cpx* vq = &v[n * q];
+        for (int k = 0; k < n; ++k) {
+          cpx vkp = vp[k], vkq = vq[k];
+          vp[k] = c * vkp - sp * vkq;
+          vq[k] = sq * vkp + c * vkq;
+        }
+      }
+    }
+    off2 = 0;
+    for (int j = 0; j < n; ++j) {
+      for (int i = 0; i < n; ++i) {
+        if (i != j) off2 += std::norm(a[i + n * j]);
+      }
+    }
+    converged = off2 <= thr * thr;
+  }
+  if (!converged) return false;
+
+  // ascending order
+  std::vector<int> perm(n);
+  std::iota(perm.begin(), perm.end(), 0);
+  std::stable_sort(perm.begin(), perm.end(), [&](int i, int j) {
+    return a[i + n * i].real() < a[j + n * j].real();
+  });
+  auto U_arr = U.array();
+  for (int j = 0; j < n; ++j) {
+    int pj = perm[j];
+    w(j) = a[pj + n * pj].real();
+    for (int i = 0; i < n; ++i) {
+      U_arr(i, j) = typename decltype(U_arr)::value_type(v[i + n * pj].real(), v[i + n * pj].imag());
+    }
+  }
+  return true;
+}
+
+
 /// stores result in RHS, after the call A will contain the cholesky factorization of a
 template <class T, class LAYOUT, class... KOKKOS>
 std::enable_if_t<std::is_same<typename KokkosDVector<T, LAYOUT, KOKKOS...>::storage_t::memory_space,
                               Kokkos::HostSpace>::value>
 solve_sym(KokkosDVector<T, LAYOUT, KOKKOS...>& A, KokkosDVector<T, LAYOUT, KOKKOS...>& RHS)
 {
+  stats::phase_timer timer(SolverStats::GetInstance().ns_small_matrices);
   if (A.map().is_local() && RHS.map().is_local()) {
     typedef KokkosDVector<T**, LAYOUT, KOKKOS...> vector_t;
     typedef typename vector_t::storage_t::value_type numeric_t;
@@ -75,8 +221,20 @@ solve_sym(KokkosDVector<T, LAYOUT, KOKKOS...>& A, KokkosDVector<T, LAYOUT, KOKKO
 
     char uplo = 'U';
     auto order = CBLAS_ORDER::CblasColMajor;
-    potrf_t::call(order, uplo, n, ptr_A, lda);
     int nrhs = RHS.array().extent(1);
+    // potrf n^3 / 6 and potrs n^2 nrhs multiply-adds
+    la_counter counter("solve_sym",
+                       flops::fma<numeric_t>() * (n * double(n) * n / 6 + n * double(n) * nrhs),
+                       sizeof(numeric_t) * (n * double(n) + 2 * double(n) * nrhs));
+    // few bands: fixed size kernels
+    int info{0};
+    if (!small_kernels::potrf(n, ptr_A, lda, info)) {
+      info = potrf_t::call(order, uplo, n, ptr_A, lda);
+    }
+    if (info != 0) {
+      throw std::runtime_error("solve_sym: potrf failed, info = " + std::to_string(info));
+    }
+    if (small_kernels::potrs(n, nrhs, ptr_A, lda, ptr_B, ldb)) return;
 
     typedef cblas::potrs<numeric_t> potrs_t;
     potrs_t::call(order, uplo, n, nrhs, ptr_A, lda, ptr_B, ldb);
@@ -135,6 +293,9 @@ inner(KokkosDVector<T0**, LAYOUT0, KOKKOS0...>& C,
     int ldb = B.array().stride(1);
     int ldc = C.array().stride(1);
 
+    la_counter counter("inner",
+                       flops::fma<numeric_t>() * m * n * double(k),
+                       sizeof(numeric_t) * (double(m) * k + double(k) * n + double(m) * n));
     // single rank inner product
     cblas::gemm<numeric_t>::call(CblasColMajor,
                                  cblas::gemm<numeric_t>::H,
@@ -204,6 +365,9 @@ outer(KokkosDVector<T0**, LAYOUT0, KOKKOS0...>& C,
     int ldb = B.array().stride(1);
     int ldc = C.array().stride(1);
 
+    la_counter counter("outer",
+                       flops::fma<numeric_t>() * m * n * double(k),
+                       sizeof(numeric_t) * (double(m) * k + double(k) * n + double(m) * n));
     // single rank inner product
     cblas::gemm<numeric_t>::call(CblasColMajor,
                                  CblasNoTrans,
@@ -273,6 +437,9 @@ transform(KokkosDVector<T0**, LAYOUT0, KOKKOS0...>& C,
     int ldb = B.array().stride(1);
     int ldc = C.array().stride(1);
 
+    la_counter counter("transform",
+                       flops::fma<numeric_t>() * m * n * double(k),
+                       sizeof(numeric_t) * (double(m) * k + double(k) * n + double(m) * n));
     // single rank inner product
     cblas::gemm<numeric_t>::call(CblasColMajor,
                                  cblas::gemm<numeric_t>::N,
@@ -324,6 +491,9 @@ add(M0& C,
     int lda = A.array().stride(1);
     int ldc = C.array().stride(1);
 
+    la_counter counter("add",
+                       (2 * flops::mul<numeric_t>() + flops::add<numeric_t>()) * m * double(n),
+                       3 * sizeof(numeric_t) * m * double(n));
     using geam = cblas::geam<numeric_t>;
     geam::call(
         CblasColMajor, geam::N, geam::N, m, n, alpha, A_ptr, lda, beta, C_ptr, ldc, C_ptr, ldc);
@@ -2,6 +2,8 @@
 #include <type_traits>
 #include "la/cuda.hpp"
 #include "la/dvector.hpp"
+#include "la/la_counters.hpp"
+#include "utils/solver_stats.hpp"
 
 namespace nlcglib {
 
@@ -15,14 +17,19 @@ eigh(KokkosDVector<T, LAYOUT, KOKKOS...>& U,
      Kokkos::View<double*, Kokkos::CudaSpace>& w,
      const KokkosDVector<T, LAYOUT, KOKKOS...>& S)
 {
+  stats::phase_timer timer(SolverStats::GetInstance().ns_small_matrices);
   if (U.map().is_local() && S.map().is_local()) {
     typedef KokkosDVector<T**, LAYOUT, KOKKOS...> vector_t;
     typedef typename vector_t::storage_t::value_type numeric_t;
 
-    deep_copy(U, S);
+    int n = U.map().nrows();
+    // ~9 n^3 operations (Golub & Van Loan), each charged as a complex multiplication (6 flops)
+    la_counter counter("eigh",
+                       9 * flops::mul<numeric_t>() * n * n * double(n),
+                       2 * sizeof(numeric_t) * double(n) * n);
+    deep_copy(U, S, "eigh");
 
     // assert status_create == CUSOLVER_STATUS_SUCCESS
-    int n = U.map().nrows();
     int lda = U.array().stride(1);
     typedef cuda::zheevd<numeric_t> zheevd_t;
     int Info;
@@ -60,6 +67,7 @@ std::enable_if_t<std::is_same<typename KokkosDVector<T, LAYOUT, KOKKOS...>::stor
 solve_sym(KokkosDVector<T, LAYOUT, KOKKOS...>& A,
           KokkosDVector<T, LAYOUT, KOKKOS...>& RHS)
 {
+  stats::phase_timer timer(SolverStats::GetInstance().ns_small_matrices);
   if (A.map().is_local() && RHS.map().is_local()) {
     typedef KokkosDVector<T**, LAYOUT, KOKKOS...> vector_t;
     typedef typename vector_t::storage_t::value_type numeric_t;
@@ -72,9 +80,12 @@ solve_sym(KokkosDVector<T, LAYOUT, KOKKOS...>& A,
     auto ptr_A = A.array().data();
 
     auto uplo = potrf_t::UPPER;
+    int nrhs = RHS.array().extent(1);
+    la_counter counter("solve_sym",
+                       flops::fma<numeric_t>() * (n * double(n) * n / 6 + n * double(n) * nrhs),
+                       sizeof(numeric_t) * (n * double(n) + 2 * double(n) * nrhs));
     int info_potrf;
     potrf_t::call(uplo, n, ptr_A, lda, info_potrf);
-    int nrhs = RHS.array().extent(1);
 
     typedef cuda::potrs<numeric_t> potrs_t;
     potrs_t::call(uplo, n, nrhs, ptr_A, lda, ptr_B, ldb);
@@ -117,6 +128,9 @@ inner(M0& c,
     int ldb = b.array().stride(1);
     int ldc = c.array().stride(1);
 
+    la_counter counter("inner",
+                       flops::fma<numeric_t>() * m * n * double(k),
+                       sizeof(numeric_t) * (double(m) * k + double(k) * n + double(m) * n));
     using gemm = cuda::gemm<numeric_t>;
     gemm::call(gemm::H, gemm::N, m, n, k, alpha, A_ptr, lda, B_ptr, ldb, beta, C_ptr, ldc);
 
@@ -167,6 +181,9 @@ outer(M0& c,
     int ldb = b.array().stride(1);
     int ldc = c.array().stride(1);
 
+    la_counter counter("outer",
+                       flops::fma<numeric_t>() * m * n * double(k),
+                       sizeof(numeric_t) * (double(m) * k + double(k) * n + double(m) * n));
     using gemm = cuda::gemm<numeric_t>;
     gemm::call(gemm::N, gemm::H, m, n, k, alpha, A_ptr, lda, B_ptr, ldb, beta, C_ptr, ldc);
 
@@ -214,6 +231,9 @@ transform(M0& C,
     int ldb = B.array().stride(1);
     int ldc = C.array().stride(1);
 
+    la_counter counter("transform",
+                       flops::fma<numeric_t>() * m * n * double(k),
+                       sizeof(numeric_t) * (double(m) * k + double(k) * n + double(m) * n));
     using gemm = cuda::gemm<numeric_t>;
     gemm::call(gemm::N, gemm::N, m, n, k, alpha, A_ptr, lda, B_ptr, ldb, beta, C_ptr, ldc);
   } else {
@@ -252,6 +272,9 @@ add(M0& C,
     int lda = A.array().stride(1);
     int ldc = C.array().stride(1);
 
+    la_counter counter("add",
+                       (2 * flops::mul<numeric_t>() + flops::add<numeric_t>()) * m * double(n),
+                       3 * sizeof(numeric_t) * m * double(n));
     using geam = cuda::geam<numeric_t>;
     geam::call(geam::N, geam::N, m, n, alpha, A_ptr, lda, beta, C_ptr, ldc, C_ptr, ldc);
   } else {
@@ -7,6 +7,8 @@
 #include "rocblas.hpp"
 #include "rocsolver.hpp"
 #include "la/dvector.hpp"
+#include "la/la_counters.hpp"
+#include "utils/solver_stats.hpp"
 
 #ifdef __NLCGLIB__MAGMA
 #include "magma.hpp"
@@ -24,11 +26,17 @@ eigh(KokkosDVector<T, LAYOUT, KOKKOS...>& U,
      Kokkos::View<double*, Kokkos::Experimental::HIPSpace>& w,
      const KokkosDVector<T, LAYOUT, KOKKOS...>& S)
 {
+  stats::phase_timer timer(SolverStats::GetInstance().ns_small_matrices);
   if (U.map().is_local() && S.map().is_local()) {
 
-    deep_copy(U, S);
-
+    typedef typename KokkosDVector<T, LAYOUT, KOKKOS...>::numeric_t numeric_t;
     int n = U.map().nrows();
+    // ~9 n^3 operations (Golub & Van Loan), each charged as a complex multiplication (6 flops)
+    la_counter counter("eigh",
+                       9 * flops::mul<numeric_t>() * n * n * double(n),
+                       2 * sizeof(numeric_t) * double(n) * n);
+    deep_copy(U, S, "eigh");
+
     int lda = U.array().stride(1);
 
     // performance of Hermitian eigensolver in rocm is bad! use magma instead.
@@ -66,6 +74,7 @@ std::enable_if_t<std::is_same<typename KokkosDVector<T, LAYOUT, KOKKOS...>::stor
 solve_sym(KokkosDVector<T, LAYOUT, KOKKOS...>& A,
           KokkosDVector<T, LAYOUT, KOKKOS...>& RHS)
 {
+  stats::phase_timer timer(SolverStats::GetInstance().ns_small_matrices);
   if (A.map().is_local() && RHS.map().is_local()) {
     // first call potrf
     int n = A.map().nrows();
@@ -81,8 +90,12 @@ solve_sym(KokkosDVector<T, LAYOUT, KOKKOS...>& A,
 
     // rocm::potrs(uplo, n, nrhs, ptr_A, lda, ptr_B, ldb);
 
-    zpotrf_magma(n, ptr_A, lda);
+    typedef typename KokkosDVector<T, LAYOUT, KOKKOS...>::numeric_t numeric_t;
     int nrhs = RHS.array().extent(1);
+    la_counter counter("solve_sym",
+                       flops::fma<numeric_t>() * (n * double(n) * n / 6 + n * double(n) * nrhs),
+                       sizeof(numeric_t) * (n * double(n) + 2 * double(n) * nrhs));
+    zpotrf_magma(n, ptr_A, lda);
     zpotrs_magma(n, nrhs, ptr_A, lda, ptr_B, ldb);
   } else {
     throw std::runtime_error("distributed solve_sym not implemented");
@@ -123,6 +136,9 @@ inner(M0& c,
     int ldb = b.array().stride(1);
     int ldc = c.array().stride(1);
 
+    la_counter counter("inner",
+                       flops::fma<numeric_t>() * m * n * double(k),
+                       sizeof(numeric_t) * (double(m) * k + double(k) * n + double(m) * n));
     auto H = rocblas_operation::rocblas_operation_conjugate_transpose;
     auto N = rocblas_operation::rocblas_operation_none;
     rocm::gemm(H, N, m, n, k, alpha, A_ptr, lda, B_ptr, ldb, beta, C_ptr, ldc);
@@ -172,6 +188,9 @@ outer(M0& c,
     int lda = a.array().stride(1);
     int ldb = b.array().stride(1);
     int ldc = c.array().stride(1);
+    la_counter counter("outer",
+                       flops::fma<numeric_t>() * m * n * double(k),
+                       sizeof(numeric_t) * (double(m) * k + double(k) * n + double(m) * n));
     auto H = rocblas_operation::rocblas_operation_conjugate_transpose;
     auto N = rocblas_operation::rocblas_operation_none;
 
@@ -221,6 +240,9 @@ transform(M0& C,
     int ldb = B.array().stride(1);
     int ldc = C.array().stride(1);
 
+    la_counter counter("transform",
+                       flops::fma<numeric_t>() * m * n * double(k),
+                       sizeof(numeric_t) * (double(m) * k + double(k) * n + double(m) * n));
     auto N = rocblas_operation::rocblas_operation_none;
     rocm::gemm(N, N, m, n, k, alpha, A_ptr, lda, B_ptr, ldb, beta, C_ptr, ldc);
   } else {
@@ -259,6 +281,9 @@ add(M0& C,
     int lda = A.array().stride(1);
     int ldc = C.array().stride(1);
 
+    la_counter counter("add",
+                       (2 * flops::mul<numeric_t>() + flops::add<numeric_t>()) * m * double(n),
+                       3 * sizeof(numeric_t) * m * double(n));
     // using geam = rocm::geam<numeric_t>;
     auto N = rocblas_operation::rocblas_operation_none;
     // rocm::geam(N, N, m, n, alpha, A_ptr, lda, beta, B_ptr, ldb, C, ldc);
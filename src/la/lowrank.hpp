@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+#include <memory>
+#include "interface.hpp"
+#include "la/dvector.hpp"
+#include "la/mvector.hpp"
+#include "la/utils.hpp"
+
+namespace nlcglib {
+
+/**
+ * Building blocks of the low-rank operators applied inside nlcglib, x -> d x + B M B^H x with
+ * B the (npw x nproj) projectors exported by the host code (ultrasoft overlap, its Woodbury
+ * inverse, preconditioner correction).
+ */
+template <class SPACE>
+using lowrank_matrix_t =
+    KokkosDVector<Kokkos::complex<double>**, SlabLayoutV, Kokkos::LayoutLeft, SPACE>;
+
+/// column major copy of matrices provided by the host code (in host memory) on SPACE
+template <class SPACE>
+mvector<lowrank_matrix_t<SPACE>>
+make_owned_mmatrix(std::shared_ptr<MatrixBaseZ> matrix_base)
+{
+  mvector<lowrank_matrix_t<SPACE>> out;
+  auto host = make_mmatrix<Kokkos::HostSpace>(matrix_base);
+  for (auto& elem : host) {
+    auto h = copy(elem.second);
+    out[elem.first] = create_mirror_view_and_copy(SPACE(), h, "make_owned_mmatrix");
+  }
+  return out;
+}
+
+/**
+ * B^H x and M B^H x (nproj x ncols) of one k-point. Shared between the per k-point operator
+ * objects, which are created on every access, grows with the number of columns.
+ */
+template <class SPACE>
+struct lowrank_workspace
+{
+  using matrix_t = lowrank_matrix_t<SPACE>;
+
+  /// leading ncols columns of bx and mbx
+  std::tuple<matrix_t, matrix_t> get(const Communicator& comm, int nproj, int ncols)
+  {
+    if (bx.map().ncols() < ncols) {
+      Map<SlabLayoutV> map(comm, SlabLayoutV({{0, 0, nproj, ncols}}));
+      bx = matrix_t(map, Kokkos::view_alloc(Kokkos::WithoutInitializing, "bx"));
+      mbx = matrix_t(map, Kokkos::view_alloc(Kokkos::WithoutInitializing, "mbx"));
+    }
+    return std::make_tuple(leading_columns(bx, ncols), leading_columns(mbx, ncols));
+  }
+
+  matrix_t bx;
+  matrix_t mbx;
+};
+
+}  // namespace nlcglib
@@ -237,7 +237,7 @@ mvector<T>::allgather(Communicator comm) const
     for (auto& elem : data_) {
       auto arr = elem.second;
       auto host_view = Kokkos::create_mirror_view(arr);
-      Kokkos::deep_copy(host_view, arr);
+      copies::deep_copy("mvector::allgather", host_view, arr);
       assert(offsets[rank][i] < send_recv_buffer.size());
       std::copy(host_view.data(), host_view.data() + host_view.size(),
                 send_recv_buffer.data() + offsets[rank][i]);
@@ -263,7 +263,7 @@ mvector<T>::allgather(Communicator comm) const
       std::copy(send_recv_buffer.data() + offset, send_recv_buffer.data() + offset + lsize, tmp.data());
       T dst(Kokkos::view_alloc(Kokkos::WithoutInitializing, ""),
             lsize);
-      Kokkos::deep_copy(dst, tmp);
+      copies::deep_copy("mvector::allgather", dst, tmp);
       auto key = global_keys[rank][block_id];
       result[key] = dst;
     }
@@ -371,6 +371,10 @@ make_mmatrix(std::shared_ptr<MatrixBaseZ> matrix_base, std::enable_if_t<!std::is
     matrix_t mat(Map<>(comm, SlabLayoutV({{0, 0, buffer.size[0], buffer.size[1]}})));
     // issue memcpy
     acc::copy(mat.array().data(), buffer.data, buffer.size[0]*buffer.size[1]);
+    copies::record("make_mmatrix",
+                   memory_names.at(buffer.memtype).c_str(),
+                   copies::space_name<X>(),
+                   double(sizeof(*buffer.data)) * buffer.size[0] * buffer.size[1]);
     mvector[kindex] = mat;
   }
   return mvector;
@@ -391,7 +395,7 @@ auto make_mmvector(std::shared_ptr<VectorBaseZ> vector_base)
 #ifdef __NLCGLIB__CUDA
       Kokkos::View<double*, Kokkos::CudaSpace, Kokkos::MemoryUnmanaged> src(buffer.data, buffer.size[0]);
       vector_t dst("vector", buffer.size[0]);
-      Kokkos::deep_copy(dst, src);
+      copies::deep_copy("make_mmvector", dst, src);
       auto kindex = vector_base->kpoint_index(i);
       mvector[kindex] = dst;
 #else
@@ -401,7 +405,7 @@ auto make_mmvector(std::shared_ptr<VectorBaseZ> vector_base)
       Kokkos::View<double*, Kokkos::HostSpace, Kokkos::MemoryUnmanaged> src(buffer.data,
                                                                             buffer.size[0]);
       vector_t dst("vector", buffer.size[0]);
-      Kokkos::deep_copy(dst, src);
+      copies::deep_copy("make_mmvector", dst, src);
       auto kindex = vector_base->kpoint_index(i);
       mvector[kindex] = dst;
     }
@@ -453,7 +457,7 @@ auto sum(const Kokkos::View<numeric_t*, ARGS...>& x)
                 "KokkosView");
 
   auto host_mirror = Kokkos::create_mirror_view(x);
-  Kokkos::deep_copy(host_mirror, x);
+  copies::deep_copy("sum", host_mirror, x);
 
   return std::accumulate(host_mirror.data(), host_mirror.data()+ host_mirror.size(), 0.0);
 }
@@ -499,7 +503,7 @@ print(const mvector<Kokkos::View<numeric_t*, ARGS...>>& vec)
   for (auto& elem : vec) {
     auto key = elem.first;
     auto& array = elem.second;
-    auto host_array = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), array);
+    auto host_array = copies::create_mirror_view_and_copy("print", Kokkos::HostSpace(), array);
     std::cout << "kindex: " << key.first << ", " << key.second << "\n";
     for (auto i = 0ul; i < host_array.size(); ++i) {
       std::cout << std::setprecision(10) << host_array(i) << " ";
@@ -514,7 +518,7 @@ struct do_copy {
   to_layout_left_t<std::remove_reference_t<X>> operator()(X&& x)
   {
     auto copy = empty_like()(x);
-    deep_copy(copy, x);
+    deep_copy(copy, x, "do_copy");
     return copy;
   }
 };
@@ -527,6 +531,22 @@ auto copy(const mvector<X>& x)
 }
 
 
+/// allocate entries of the workspace ws which are missing or differ in shape from x
+template <class R, class X>
+void resize_like(mvector<R>& ws, const mvector<X>& x)
+{
+  for (auto& elem : x) {
+    auto key = elem.first;
+    auto& xi = elem.second;
+    auto it = ws.data().find(key);
+    if (it == ws.end() || it->second.array().extent(0) != xi.array().extent(0) ||
+        it->second.array().extent(1) != xi.array().extent(1)) {
+      ws[key] = empty_like()(xi);
+    }
+  }
+}
+
+
 template <class... T>
 auto unzip(const mvector<std::tuple<T...>>& V) {
   std::tuple<mvector<T>...> U;
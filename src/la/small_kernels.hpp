@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <type_traits>
+#include <utility>
+#include <Kokkos_Complex.hpp>
+
+namespace nlcglib {
+
+/**
+ * Fixed size Cholesky kernels for nbands x nbands matrices (nbands <= 64).
+ *
+ * For few bands the cost of potrf/potrs is dominated by the call overhead of the LAPACK library
+ * (argument checks, blocking). The kernels below take the size as template parameter and copy the
+ * operands into split real/imaginary arrays on the stack, such that the compiler fully unrolls
+ * and vectorizes the inner loops. Storage of the arguments is column major (interleaved complex)
+ * with leading dimension. Sizes n in between the instantiated sizes N are padded with the
+ * identity, only the leading n x n block is written.
+ *
+ * There are no gemm kernels: OpenBLAS zgemm is 2-4x faster than fixed size loops for n = 4 ... 32
+ * (with and without AVX), the products stay with BLAS.
+ *
+ * The dispatchers return false if the size (or type) is not covered, the caller falls back to
+ * LAPACK.
+ */
+namespace small_kernels {
+
+/**
+ * Largest n for which the kernels are used by default. Measured against OpenBLAS (single
+ * thread): with 256 bit vectors potrf + potrs are faster up to n = 32 (2.5x for n = 8), with
+ * SSE2 only up to n = 16.
+ */
+#ifdef __AVX__
+constexpr int max_cholesky = 32;
+#else
+constexpr int max_cholesky = 16;
+#endif
+
+template <class T>
+struct is_complex_double
+    : std::integral_constant<bool,
+                             std::is_same<T, std::complex<double>>::value ||
+                                 std::is_same<T, Kokkos::complex<double>>::value>
+{
+};
+
+/**
+ * Cholesky factorization A = U^H U, upper triangle as LAPACK (uplo = 'U'), returns LAPACK info.
+ *
+ * Right-looking on L = U^H in split storage: the trailing update is a sequence of contiguous
+ * axpy's.
+ */
+template <int N>
+inline int
+potrf_kernel(int n, double* A, int lda)
+{
+  alignas(64) double l_re[N * N];
+  alignas(64) double l_im[N * N];
+  // L(i, j) = conj(A(j, i)), i >= j, padded with the identity
+  for (int j = 0; j < N; ++j) {
+    for (int i = j; i < N; ++i) {
+      if (i >= n) {
+        l_re[i + j * N] = i == j ? 1 : 0;
+        l_im[i + j * N] = 0;
+        continue;
+      }
+      l_re[i + j * N] = A[2 * (j + i * lda)];
+      l_im[i + j * N] = -A[2 * (j + i * lda) + 1];
+    }
+  }
+  int info{0};
+  for (int j = 0; j < N; ++j) {
+    double d = l_re[j + j * N];
+    if (!(d > 0)) {
+      info = j + 1;
+      break;
+    }
+    d = std::sqrt(d);
+    double dinv = 1 / d;
+    l_re[j + j * N] = d;
+    l_im[j + j * N] = 0;
+    for (int i = j + 1; i < N; ++i) {
+      l_re[i + j * N] *= dinv;
+      l_im[i + j * N] *= dinv;
+    }
+    // L(i, k) -= L(i, j) conj(L(k, j)), i >= k > j
+    for (int k = j + 1; k < N; ++k) {
+      double lk_re = l_re[k + j * N];
+      double lk_im = -l_im[k + j * N];
+      for (int i = k; i < N; ++i) {
+        l_re[i + k * N] -= l_re[i + j * N] * lk_re - l_im[i + j * N] * lk_im;
+        l_im[i + k * N] -= l_re[i + j * N] * lk_im + l_im[i + j * N] * lk_re;
+      }
+    }
+  }
+  // U(j, i) = conj(L(i, j))
+  for (int j = 0; j < n; ++j) {
+    for (int i = j; i < n; ++i) {
+      A[2 * (j + i * lda)] = l_re[i + j * N];
+      A[2 * (j + i * lda) + 1] = -l_im[i + j * N];
+    }
+  }
+  return info;
+}
+
+/// solve U^H U X = B for nrhs columns, U (n x n) from potrf_kernel
+template <int N>
+inline void
+potrs_kernel(int n, const double* U, int lda, double* B, int ldb, int nrhs)
+{
+  // L = U^H, split storage, padded with the identity
+  alignas(64) double l_re[N * N];
+  alignas(64) double l_im[N * N];
+  for (int j = 0; j < N; ++j) {
+    for (int i = j; i < N; ++i) {
+      if (i >= n) {
+        l_re[i + j * N] = i == j ? 1 : 0;
+        l_im[i + j * N] = 0;
+        continue;
+      }
+      l_re[i + j * N] = U[2 * (j + i * lda)];
+      l_im[i + j * N] = -U[2 * (j + i * lda) + 1];
+    }
+  }
+  // blocks of N right-hand sides, transposed: the right-hand sides are contiguous
+  alignas(64) double x_re[N * N];
+  alignas(64) double x_im[N * N];
+  for (int r0 = 0; r0 < nrhs; r0 += N) {
+    int nr = std::min(N, nrhs - r0);
+    for (int r = 0; r < nr; ++r) {
+      for (int i = 0; i < N; ++i) {
+        x_re[r + i * N] = i < n ? B[2 * (i + (r0 + r) * ldb)] : 0;
+        x_im[r + i * N] = i < n ? B[2 * (i + (r0 + r) * ldb) + 1] : 0;
+      }
+    }
+    // L y = b
+    for (int k = 0; k < N; ++k) {
+      double dinv = 1 / l_re[k + k * N];
+      double* yk_re = x_re + k * N;
+      double* yk_im = x_im + k * N;
+      for (int r = 0; r < nr; ++r) {
+        yk_re[r] *= dinv;
+        yk_im[r] *= dinv;
+      }
+      for (int i = k + 1; i < N; ++i) {
+        double lr = l_re[i + k * N];
+        double li = l_im[i + k * N];
+        for (int r = 0; r < nr; ++r) {
+          x_re[r + i * N] -= lr * yk_re[r] - li * yk_im[r];
+          x_im[r + i * N] -= lr * yk_im[r] + li * yk_re[r];
+        }
+      }
+    }
+    // L^H x = y
+    for (int k = N - 1; k >= 0; --k) {
+      double* xk_re = x_re + k * N;
+      double* xk_im = x_im + k * N;
+      for (int i = k + 1; i < N; ++i) {
+        double lr = l_re[i + k * N];
+        double li = -l_im[i + k * N];
+        for (int r = 0; r < nr; ++r) {
+          xk_re[r] -= lr * x_re[r + i * N] - li * x_im[r + i * N];
+          xk_im[r] -= lr * x_im[r + i * N] + li * x_re[r + i * N];
+        }
+      }
+      double dinv = 1 / l_re[k + k * N];
+      for (int r = 0; r < nr; ++r) {
+        xk_re[r] *= dinv;
+        xk_im[r] *= dinv;
+      }
+    }
+    for (int r = 0; r < nr; ++r) {
+      for (int i = 0; i < n; ++i) {
+        B[2 * (i + (r0 + r) * ldb)] = x_re[r + i * N];
+        B[2 * (i + (r0 + r) * ldb) + 1] = x_im[r + i * N];
+      }
+    }
+  }
+}
+
+/// calls F<N>(n, args...) for the smallest N in {8, 16, 24, 32, 48, 64} with n <= N, false if
+/// n > 64
+template <template <int> class F, class... ARGS>
+inline bool
+dispatch(int n, ARGS&&... args)
+{
+  if (n <= 0 || n > 64) return false;
+  if (n <= 8) {
+    F<8>::call(n, std::forward<ARGS>(args)...);
+  } else if (n <= 16) {
+    F<16>::call(n, std::forward<ARGS>(args)...);
+  } else if (n <= 24) {
+    F<24>::call(n, std::forward<ARGS>(args)...);
+  } else if (n <= 32) {
+    F<32>::call(n, std::forward<ARGS>(args)...);
+  } else if (n <= 48) {
+    F<48>::call(n, std::forward<ARGS>(args)...);
+  } else {
+    F<64>::call(n, std::forward<ARGS>(args)...);
+  }
+  return true;
+}
+
+template <int N>
+struct potrf_f
+{
+  static void call(int n, double* A, int lda, int& info) { info = potrf_kernel<N>(n, A, lda); }
+};
+
+template <int N>
+struct potrs_f
+{
+  static void call(int n, const double* U, int lda, double* B, int ldb, int nrhs)
+  {
+    potrs_kernel<N>(n, U, lda, B, ldb, nrhs);
+  }
+};
+
+/// Cholesky factorization (upper), info as LAPACK
+template <class T>
+inline bool
+potrf(int n, T* A, int lda, int& info, int max_n = max_cholesky)
+{
+  if constexpr (!is_complex_double<T>::value) {
+    return false;
+  } else {
+    if (n > max_n) return false;
+    return dispatch<potrf_f>(n, reinterpret_cast<double*>(A), lda, info);
+  }
+}
+
+/// solve with the Cholesky factor (upper) from potrf
+template <class T>
+inline bool
+potrs(int n, int nrhs, const T* A, int lda, T* B, int ldb, int max_n = max_cholesky)
+{
+  if constexpr (!is_complex_double<T>::value) {
+    return false;
+  } else {
+    if (n > max_n) return false;
+    return dispatch<potrs_f>(
+        n, reinterpret_cast<const double*>(A), lda, reinterpret_cast<double*>(B), ldb, nrhs);
+  }
+}
+
+}  // namespace small_kernels
+}  // namespace nlcglib
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include "csingleton.hpp"
+#include "utils/env.hpp"
+
+#ifdef __USE_OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __USE_MKL
+#include <mkl_service.h>
+#else
+// OpenBLAS extensions, weak: not available for other BLAS vendors
+extern "C" {
+void openblas_set_num_threads(int num_threads) __attribute__((weak));
+int openblas_get_num_threads(void) __attribute__((weak));
+}
+#endif
+
+namespace nlcglib {
+
+/**
+ * Thread budget shared between k-point tasks and BLAS.
+ *
+ * total: number of threads available to nlcglib (NLCGLIB_NUM_THREADS, default: OpenMP max threads)
+ * concurrent_tasks: number of k-point tasks running at the same time (eval_threaded runs the
+ *                   k-points one after the other, i.e. 1), each task gets total / concurrent_tasks
+ * grain: minimal work (m * n * k) per BLAS thread (NLCGLIB_BLAS_GRAIN), small nbands x nbands
+ *        products run on fewer threads.
+ */
+class ThreadBudget : public CSingleton<ThreadBudget>
+{
+public:
+  ThreadBudget()
+  {
+    total = env::get_num_threads();
+    if (total <= 0) {
+#ifdef __USE_OPENMP
+      total = omp_get_max_threads();
+#else
+      total = std::max(1, blas_get_num_threads());
+#endif
+    }
+    grain = env::get_blas_grain();
+  }
+
+  /// threads available to a single k-point task
+  int per_task() const { return std::max(1, total / std::max(1, concurrent_tasks)); }
+
+  /// number of BLAS threads for a product of size m x k times k x n
+  int blas_threads(std::int64_t m, std::int64_t n, std::int64_t k) const
+  {
+    std::int64_t work = m * n * k;
+    std::int64_t nthreads = grain > 0 ? work / grain : per_task();
+    return static_cast<int>(std::clamp<std::int64_t>(nthreads, 1, per_task()));
+  }
+
+  /// threads of the BLAS library, -1 if it cannot be queried
+  static int blas_get_num_threads()
+  {
+#ifdef __USE_MKL
+    return mkl_get_max_threads();
+#else
+    return openblas_get_num_threads ? openblas_get_num_threads() : -1;
+#endif
+  }
+
+  /// set threads of the BLAS library (calling thread), returns the previous value, -1 if
+  /// unsupported (MKL: previous thread-local value, 0 if the global setting was in effect)
+  static int blas_set_num_threads(int n)
+  {
+#ifdef __USE_MKL
+    return mkl_set_num_threads_local(n);
+#else
+    if (!openblas_set_num_threads || !openblas_get_num_threads) return -1;
+    int prev = openblas_get_num_threads();
+    if (prev != n) openblas_set_num_threads(n);
+    return prev;
+#endif
+  }
+
+public:
+  int total{1};
+  int concurrent_tasks{1};
+  std::int64_t grain{1 << 18};
+};
+
+
+/// RAII: BLAS threads for a single call, restores the previous setting
+class blas_threads_guard
+{
+public:
+  blas_threads_guard(std::int64_t m, std::int64_t n, std::int64_t k)
+  {
+    int nthreads = ThreadBudget::GetInstance().blas_threads(m, n, k);
+    prev = ThreadBudget::blas_set_num_threads(nthreads);
+    changed = prev >= 0 && prev != nthreads;
+  }
+
+  ~blas_threads_guard()
+  {
+    if (changed) ThreadBudget::blas_set_num_threads(prev);
+  }
+
+  blas_threads_guard(const blas_threads_guard&) = delete;
+  blas_threads_guard& operator=(const blas_threads_guard&) = delete;
+
+private:
+  int prev{-1};
+  bool changed{false};
+};
+
+}  // namespace nlcglib
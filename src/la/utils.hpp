@@ -170,11 +170,64 @@ auto
 copy(const KokkosDVector<T, LAYOUT, ARGS...>& other)
 {
   auto ret = empty_like()(other);
-  deep_copy(ret, other);
+  deep_copy(ret, other, "copy");
   return ret;
 }
 
 
+/// the first ncols columns of x, shares memory with x (column major, local matrices only)
+template <class T, class... ARGS>
+KokkosDVector<T, SlabLayoutV, ARGS...>
+leading_columns(const KokkosDVector<T, SlabLayoutV, ARGS...>& x, int ncols)
+{
+  if (!x.map().is_local()) {
+    throw std::runtime_error("leading_columns: distributed matrix not supported");
+  }
+  Map<SlabLayoutV> map(x.map().comm(), SlabLayoutV({{0, 0, x.map().nrows(), ncols}}));
+  return KokkosDVector<T, SlabLayoutV, ARGS...>(
+      map, Kokkos::subview(x.array(), Kokkos::ALL, std::make_pair(0, ncols)));
+}
+
+/// the columns idx(0), idx(1), ... of x, in this order (column major, local matrices only)
+template <class T, class... ARGS, class... IARGS>
+KokkosDVector<T, SlabLayoutV, ARGS...>
+gather_columns(const KokkosDVector<T, SlabLayoutV, ARGS...>& x,
+               const Kokkos::View<int*, IARGS...>& idx)
+{
+  if (!x.map().is_local()) {
+    throw std::runtime_error("gather_columns: distributed matrix not supported");
+  }
+  using memspace = typename KokkosDVector<T, SlabLayoutV, ARGS...>::storage_t::memory_space;
+  int m = x.map().nrows();
+  int n = idx.extent(0);
+  Map<SlabLayoutV> map(x.map().comm(), SlabLayoutV({{0, 0, m, n}}));
+  KokkosDVector<T, SlabLayoutV, ARGS...> y(map);
+  auto mX = x.array();
+  auto mY = y.array();
+  parallel_for_columns<memspace>("gather_columns", m, n, KOKKOS_LAMBDA(int i, int j) {
+    mY(i, j) = mX(i, idx(j));
+  });
+  return y;
+}
+
+/// y(:, idx(j)) <- x(:, j), the remaining columns of y are not touched
+template <class T, class... ARGS, class M2, class... IARGS>
+void
+scatter_columns(KokkosDVector<T, SlabLayoutV, ARGS...>& y,
+                const M2& x,
+                const Kokkos::View<int*, IARGS...>& idx)
+{
+  using memspace = typename KokkosDVector<T, SlabLayoutV, ARGS...>::storage_t::memory_space;
+  int m = x.array().extent(0);
+  int n = idx.extent(0);
+  auto mX = x.array();
+  auto mY = y.array();
+  parallel_for_columns<memspace>("scatter_columns", m, n, KOKKOS_LAMBDA(int i, int j) {
+    mY(i, idx(j)) = mX(i, j);
+  });
+}
+
+
 template <class T, class... ARGS>
 void
 print(const Kokkos::View<T*, ARGS...>& x)
@@ -182,7 +235,7 @@ print(const Kokkos::View<T*, ARGS...>& x)
   using vector_t = Kokkos::View<T*, ARGS...>;
   static_assert(vector_t::dimension::rank == 1, "1d array expected");
   auto xh = Kokkos::create_mirror_view(x);
-  Kokkos::deep_copy(xh, x);
+  copies::deep_copy("print", xh, x);
   for (int i = 0; i < xh.extent(0); ++i) {
     std::cout << x(i) << "\t";
   }
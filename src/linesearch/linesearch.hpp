@@ -1,9 +1,13 @@
 #pragma once
 
 #include "exceptions.hpp"
+#include "interface.hpp"
 #include "utils/logger.hpp"
+#include "utils/solver_stats.hpp"
+#include <cmath>
 #include <iomanip>
 #include <tuple>
+#include <type_traits>
 
 namespace nlcglib {
 
@@ -13,6 +17,37 @@ struct line_search_info
   std::string type; // the ls-type used
 };
 
+
+/**
+ * Geodesic evaluation split into
+ *   prepare(t):            nlcglib-local work only, no call into EnergyBase
+ *   submit(prepared, hints): finish the point and start the energy evaluation, returns the point
+ *   wait():                block until the energy evaluation is finished
+ * so that the line search can overlap its own work with an outstanding energy evaluation.
+ */
+template <class PREPARE, class SUBMIT, class WAIT>
+struct async_geodesic
+{
+  PREPARE prepare;
+  SUBMIT submit;
+  WAIT wait;
+
+  auto operator()(double t, const eval_hints& hints)
+  {
+    auto point = submit(prepare(t), hints);
+    wait();
+    return point;
+  }
+};
+
+template <class PREPARE, class SUBMIT, class WAIT>
+auto
+make_async_geodesic(PREPARE&& prepare, SUBMIT&& submit, WAIT&& wait)
+{
+  return async_geodesic<std::decay_t<PREPARE>, std::decay_t<SUBMIT>, std::decay_t<WAIT>>{
+      prepare, submit, wait};
+}
+
 class line_search
 {
 private:
@@ -33,12 +68,17 @@ public:
     }
     Logger::GetInstance() << "line search t_trial = " << std::scientific << t_trial << "\n";
     double F0 = FE.get_F();
+    auto& stats = SolverStats::GetInstance();
     try {
-      return std::tuple_cat(qline(G, FE, slope, force_restart), std::make_tuple(line_search_info{"qline"}));
+      auto res = std::tuple_cat(qline(G, FE, slope, force_restart), std::make_tuple(line_search_info{"qline"}));
+      SolverStats::add(stats.qline, 1);
+      return res;
     } catch (StepError& step_error) {
       Logger::GetInstance() << "\t"
                             << "quadratic line search failed -> backtracking search\n";
-      return std::tuple_cat(bt_search(G, FE, F0, force_restart), std::make_tuple(line_search_info{"btsearch"}));
+      auto res = std::tuple_cat(bt_search(G, FE, F0, force_restart), std::make_tuple(line_search_info{"btsearch"}));
+      SolverStats::add(stats.btsearch, 1);
+      return res;
     }
   }
 
@@ -46,6 +86,10 @@ public:
   double t_trial{0.2};
   /// parameter for backtracking search
   double tau{0.1};
+  /// accuracy requested for qline trial points, relative to the predicted decrease |slope| * t
+  double trial_rtol{0.1};
+  /// step length of the point returned by the last call
+  double t_accepted{0};
 };
 
 
@@ -61,18 +105,32 @@ line_search::bt_search(GEODESIC& G, FREE_ENERGY& FE, double F0, bool& force_rest
     throw std::runtime_error("invalid value");
   }
 
+  // prepare the next backtracking point while the energy is being evaluated, only if the host
+  // evaluates asynchronously: otherwise it is wasted whenever t is accepted
+  bool ahead = FE.is_async();
   double t = t_trial;
+  auto next = G.prepare(t);
   while (t > 1e-8) {
-    auto ek_ul = G(t);
+    // every point might be accepted -> full accuracy
+    auto ek_ul = G.submit(next, eval_hints{});
+    double t_next = t * tau;
+    if (ahead && t_next > 1e-8) {
+      next = G.prepare(t_next);
+    }
+    G.wait();
     double Fp = FE.get_F();
     Logger::GetInstance() << "fd slope: " << std::scientific << std::setprecision(3) << (Fp - F0) / t << " t: " << t
                           << " F:" << std::fixed << std::setprecision(13) << Fp << "\n";
     if (Fp < F0) {
       Logger::GetInstance() << "fd slope: " << std::scientific << std::setprecision(3) << (Fp - F0)/t << "\n";
       force_restart = false;
+      t_accepted = t;
       return ek_ul;
     }
-    t *= tau;
+    t = t_next;
+    if (!ahead && t > 1e-8) {
+      next = G.prepare(t);
+    }
     Logger::GetInstance() << "\tbacktracking search tau = " << std::scientific << std::setprecision(5) << t << "\n";
   }
   // TODO: let logger print state
@@ -81,7 +139,8 @@ line_search::bt_search(GEODESIC& G, FREE_ENERGY& FE, double F0, bool& force_rest
     throw DescentError();
   } else {
     force_restart = true;
-    return G(0);  // reset gradient
+    t_accepted = 0;
+    return G(0, eval_hints{});  // reset gradient
   }
 }
 
@@ -113,8 +172,15 @@ line_search::qline(GEODESIC& G, FREE_ENERGY& FE, double slope, bool& force_resta
     c = F0;
     b = slope;
 
-    // evaluate at trial point and obtain new F
-    G(tsearch);
+    // evaluate at trial point and obtain new F, the parabola fit only needs F1 up to a
+    // fraction of the expected decrease, i.e. loose far from convergence.
+    // Unlike bt_search there is nothing to prepare while this evaluation is outstanding: the next
+    // point t_min depends on F1 (and the retry with 5 * tsearch on the sign of a), a speculative
+    // prepare would be wasted in the common case.
+    eval_hints trial_hints;
+    trial_hints.is_trial = true;
+    trial_hints.energy_tol = trial_rtol * std::abs(slope) * tsearch;
+    G(tsearch, trial_hints);
     F1 = FE.get_F();
 
     a = (F1 - b * tsearch - c) / (tsearch * tsearch);
@@ -133,7 +199,7 @@ line_search::qline(GEODESIC& G, FREE_ENERGY& FE, double slope, bool& force_resta
   double F_pred = -b * b / (4 * a) + c;
 
   // evaluate FE at predicted minimum
-  auto ek_ul = G(t_min);
+  auto ek_ul = G(t_min, eval_hints{});
   double F_min = FE.get_F();
   Logger::GetInstance() << "\t t_min = " << t_min
                         << " q line prediction error: " << std::scientific << std::setprecision(8) << (F_pred - F_min)
@@ -149,6 +215,7 @@ line_search::qline(GEODESIC& G, FREE_ENERGY& FE, double slope, bool& force_resta
 
   // reset force_restart
   force_restart = false;
+  t_accepted = t_min;
 
   return ek_ul;
 }
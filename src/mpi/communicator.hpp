@@ -5,6 +5,7 @@
 #include <numeric>
 #include <vector>
 #include "mpi_type.hpp"
+#include "utils/solver_stats.hpp"
 
 #define CALL_MPI(func__, args__)                                                  \
   {                                                                               \
@@ -110,6 +111,10 @@ public:
   template <class T>
   T allreduce(T val, enum mpi_op op) const;
 
+  /// in-place allreduce of count elements
+  template <class T>
+  void allreduce(T* buffer, int count, enum mpi_op op) const;
+
   void barrier() const { CALL_MPI(MPI_Barrier, (mpicomm_)); }
 
   ~Communicator()
@@ -121,6 +126,13 @@ public:
 
   MPI_Comm raw() const { return mpicomm_; }
 
+private:
+  /// bytes passed to a collective, only communicators with more than one rank are counted
+  void count_bytes(std::atomic<long>& counter, long bytes) const
+  {
+    if (this->size() > 1) SolverStats::add(counter, bytes);
+  }
+
 private:
   MPI_Comm mpicomm_;
 };
@@ -133,6 +145,9 @@ Communicator::allgather(T* buffer, const std::vector<int>& recvcounts) const
   assert(recvcounts.size() == nranks);
   std::vector<int> displs(nranks, 0);
   std::partial_sum(recvcounts.begin(), recvcounts.end() - 1, displs.begin() + 1);
+  stats::phase_timer timer(SolverStats::GetInstance().ns_allgather);
+  this->count_bytes(SolverStats::GetInstance().bytes_allgathered,
+              std::accumulate(recvcounts.begin(), recvcounts.end(), 0l) * sizeof(T));
 
   CALL_MPI(MPI_Allgatherv,
            (MPI_IN_PLACE,
@@ -152,6 +167,9 @@ Communicator::allgather(T* buffer,
                         const std::vector<int>& displs) const
 {
   // put assert statements
+  stats::phase_timer timer(SolverStats::GetInstance().ns_allgather);
+  this->count_bytes(SolverStats::GetInstance().bytes_allgathered,
+              std::accumulate(recvcounts.begin(), recvcounts.end(), 0l) * sizeof(T));
   CALL_MPI(MPI_Allgatherv,
            (MPI_IN_PLACE,
             0,
@@ -167,6 +185,9 @@ template <class T>
 void
 Communicator::allgather(T* buffer, int recvcount) const
 {
+  stats::phase_timer timer(SolverStats::GetInstance().ns_allgather);
+  this->count_bytes(SolverStats::GetInstance().bytes_allgathered,
+              static_cast<long>(recvcount) * this->size() * sizeof(T));
   CALL_MPI(MPI_Allgather,
            (MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, buffer, recvcount, mpi_type<T>::type(), mpicomm_));
 }
@@ -200,6 +221,7 @@ T
 Communicator::allreduce(T val, enum mpi_op op) const
 {
   T result{0};
+  this->count_bytes(SolverStats::GetInstance().bytes_allreduced, sizeof(T));
   switch (op) {
     case mpi_op::sum: {
       CALL_MPI(MPI_Allreduce,
@@ -224,4 +246,32 @@ Communicator::allreduce(T val, enum mpi_op op) const
   return result;
 }
 
+template <class T>
+void
+Communicator::allreduce(T* buffer, int count, enum mpi_op op) const
+{
+  this->count_bytes(SolverStats::GetInstance().bytes_allreduced,
+                    static_cast<long>(count) * sizeof(T));
+  switch (op) {
+    case mpi_op::sum: {
+      CALL_MPI(MPI_Allreduce,
+               (MPI_IN_PLACE, buffer, count, mpi_type<T>::type(), mpi_op_<mpi_op::sum>::value(), mpicomm_));
+      break;
+    }
+    case mpi_op::min: {
+      CALL_MPI(MPI_Allreduce,
+               (MPI_IN_PLACE, buffer, count, mpi_type<T>::type(), mpi_op_<mpi_op::min>::value(), mpicomm_));
+      break;
+    }
+    case mpi_op::max: {
+      CALL_MPI(MPI_Allreduce,
+               (MPI_IN_PLACE, buffer, count, mpi_type<T>::type(), mpi_op_<mpi_op::max>::value(), mpicomm_));
+      break;
+    }
+    default: {
+      throw std::runtime_error("Error: invalid MPI_Op given.");
+    }
+  }
+}
+
 }  // namespace nlcglib
@@ -1,16 +1,123 @@
 #pragma once
 
+#include <algorithm>
+#include <string>
+#include <utility>
 #include "descent_direction_impl.hpp"
+#include "operator.hpp"
+#include "overlap.hpp"
+#include "utils/env.hpp"
 
 namespace nlcglib {
 
+/// parse CG update formula, fr | pr | hs | dy
+inline cg_type
+make_cg_type(const std::string& name)
+{
+  if (name == "fr") return cg_type::FLETCHER_REEVES;
+  if (name == "pr") return cg_type::POLAK_RIBIERE;
+  if (name == "hs") return cg_type::HESTENES_STIEFEL;
+  if (name == "dy") return cg_type::DAI_YUAN;
+  throw std::runtime_error("invalid CG type: " + name + " (expected fr, pr, hs or dy)");
+}
+
+inline const char*
+cg_type_name(cg_type cg)
+{
+  switch (cg) {
+    case cg_type::FLETCHER_REEVES:
+      return "Fletcher-Reeves";
+    case cg_type::POLAK_RIBIERE:
+      return "Polak-Ribiere+";
+    case cg_type::HESTENES_STIEFEL:
+      return "Hestenes-Stiefel";
+    case cg_type::DAI_YUAN:
+      return "Dai-Yuan";
+  }
+  return "unknown";
+}
+
+/// buffers reused across CG iterations, owned by the caller
+template <class matrix_t>
+struct descent_workspace
+{
+  /// S·X, also used by the geodesic for S·X(t)
+  mvector<matrix_t> sx;
+  /// P·SX, overwritten by X @ ll
+  mvector<matrix_t> psx;
+  /// P·HX
+  mvector<matrix_t> phx;
+
+  using host_matrix_t =
+      decltype(create_mirror_view_and_copy(Kokkos::HostSpace(), std::declval<matrix_t>()));
+  /// preconditioned gradient of the previous iteration (Δx, Δη) on host, needed by PR, HS and DY
+  mvector<host_matrix_t> delta_x;
+  mvector<host_matrix_t> delta_eta;
+};
+
+namespace local {
+
+/// copy X to memspc and compute S·X for all k-points in a single batch, S·X is stored in ws.sx
+template <class mem_t, class x_t, class op_t, class ws_t>
+auto
+mirror_and_apply_batch(const mem_t& memspc,
+                       const mvector<x_t>& X_h,
+                       const op_t& S,
+                       descent_workspace<ws_t>& ws)
+{
+  auto X = eval_threaded(
+      tapply([memspc](
+                 auto x) { return create_mirror_view_and_copy(memspc, x, "descent_direction"); },
+             X_h));
+  apply_op_batch(S, X, ws.sx);
+  resize_like(ws.psx, X);
+  resize_like(ws.phx, X);
+  return X;
+}
+
+/// S = I: copy X to memspc, ws.sx is left untouched
+template <class mem_t, class x_t, class ws_t>
+auto
+mirror_and_apply_batch(const mem_t& memspc,
+                       const mvector<x_t>& X_h,
+                       const IdentityOverlap&,
+                       descent_workspace<ws_t>& ws)
+{
+  auto X = eval_threaded(
+      tapply([memspc](
+                 auto x) { return create_mirror_view_and_copy(memspc, x, "descent_direction"); },
+             X_h));
+  resize_like(ws.psx, X);
+  resize_like(ws.phx, X);
+  return X;
+}
+
+/// S·X as computed by mirror_and_apply_batch
+template <class x_t, class op_t, class ws_t>
+const auto&
+overlap_applied(const mvector<x_t>& X, const op_t&, const descent_workspace<ws_t>& ws)
+{
+  return ws.sx;
+}
+
+/// S = I: S·X is X
+template <class x_t, class ws_t>
+const auto&
+overlap_applied(const mvector<x_t>& X, const IdentityOverlap&, const descent_workspace<ws_t>&)
+{
+  return X;
+}
+
+}  // namespace local
+
 template <enum smearing_type SMEARING_TYPE>
 class descent_direction
 {
 public:
-  descent_direction(double T, double kappa)
+  descent_direction(double T, double kappa, cg_type cg = cg_type::FLETCHER_REEVES)
       : T(T)
       , kappa(kappa)
+      , cg(cg)
   {
   }
 
@@ -24,7 +131,8 @@ public:
             class ul_t,
             class op_t,
             class prec_t,
-            class F>
+            class F,
+            class ws_t>
   auto conjugated(const mem_t& memspc,
                   double fr_old,
                   const mvector<x_t>& X,
@@ -38,7 +146,8 @@ public:
                   double mu,
                   op_t&& S,
                   prec_t&& P,
-                  F&& free_energy);
+                  F&& free_energy,
+                  descent_workspace<ws_t>& ws);
 
   /// restarted CG step or steepest descent
   template <class mem_t,
@@ -48,7 +157,8 @@ public:
             class hx_t,
             class op_t,
             class prec_t,
-            class F>
+            class F,
+            class ws_t>
   std::tuple<double, mvector<to_layout_left_t<x_t>>, mvector<to_layout_left_t<x_t>>> restarted(
       const mem_t& memspc,
       const mvector<x_t>& X,
@@ -59,13 +169,180 @@ public:
       double mu,
       op_t&& S,
       prec_t&& P,
-      F&& free_energy);
+      F&& free_energy,
+      descent_workspace<ws_t>& ws);
+
+  /**
+   * Enable band locking once the residual |<g, Δ>| has dropped below 100 * tol. Bands whose
+   * contribution to <g, Δ> is below fraction * tol / (total number of bands) are locked, i.e. at
+   * the moment of locking they make up at most fraction * tol of the residual in total.
+   * Locked bands are permuted to the back, their gradient and search direction are not computed
+   * in the following iterations. X and η keep moving, hence all bands are unlocked and re-checked
+   * every recheck iterations (0: only on CG restarts), the solver does not report convergence
+   * while bands are locked (see partial).
+   * The subspace rotation Ul of the line search mixes the bands, a lock follows its band to the
+   * column with the largest |Ul(i, j)| and is dropped if the band is mixed (|Ul(i, j)|^2 < 0.9).
+   */
+  void set_band_locking(double tol, double fraction, int recheck = 10)
+  {
+    late_tol = tol;
+    lock_budget = fraction * tol;
+    lock_recheck = recheck;
+  }
+
+  /**
+   * Freeze the trailing bands with eigenvalues above mu + c * kT once the residual has dropped
+   * below 100 * tol, their X-gradient is not computed and their columns of X are held fixed.
+   * Frozen bands constrain the occupied subspace, hence they are not frozen before the empty
+   * states are reasonably converged.
+   */
+  void set_freeze_empty(double tol, double c)
+  {
+    late_tol = tol;
+    freeze_c = c;
+  }
+
+  /**
+   * Number of leading columns of the last Zx per k-point, the remaining columns belong to frozen
+   * bands and are zero, the line search does not update them.
+   */
+  template <class x_t>
+  mvector<int> updated_columns(const mvector<x_t>& X) const
+  {
+    mvector<int> nx(X.commk());
+    for (auto& elem : X) {
+      auto key = elem.first;
+      int n = elem.second.map().ncols();
+      auto it = band_state.data().find(key);
+      if (it != band_state.data().end() && it->second.size() == static_cast<size_t>(n)) {
+        while (n > 1 && it->second(n - 1) == 2) --n;
+      }
+      nx[key] = n;
+    }
+    return nx;
+  }
+
+  /**
+   * True if the slope of the last direction is taken over part of the bands only (locked or
+   * frozen bands), it is not the full residual then.
+   */
+  bool partial() const { return partial_; }
+
+  /// change the temperature, the next direction must be a restart
+  void set_temperature(double T) { this->T = T; }
+
+  /// change the η-preconditioner, the next direction must be a restart
+  void set_kappa(double kappa) { this->kappa = kappa; }
+  double get_kappa() const { return kappa; }
+
+  /**
+   * Secant estimate of the factor by which kappa should be scaled, available after conjugated.
+   *
+   * Along the previous direction Z the slopes of the X and η blocks decay as s(t) = s(0)(1 - t/t*)
+   * for a quadratic model, i.e. ρ = s(t) / s(0) gives the optimal step t* = t / (1 - ρ) of each
+   * block. The η-step scales with kappa, hence kappa * t*_η / t*_x balances both blocks.
+   * Returns 1 if the estimate is not reliable.
+   */
+  double kappa_factor() const { return kappa_factor_; }
+
+private:
+  /// CG parameter γ, g_dp = <g, Δ(n-1)>, slope_zp = <g, Z(n-1)>
+  double gamma(double fr, double fr_old, double g_dp, double slope_zp) const;
+
+  /// total number of bands (all k-points)
+  template <class x_t>
+  static int num_bands(const mvector<x_t>& X);
+
+  /// band states of the columns of X Ul, see set_band_locking
+  template <class ul_t>
+  static Kokkos::View<int*, Kokkos::HostSpace> rotate_locks(
+      const Kokkos::View<int*, Kokkos::HostSpace>& state, const ul_t& ul);
 
 private:
   double T;
   double kappa;
+  cg_type cg;
+  /// band locking and freezing are enabled once the residual is below 100 * late_tol
+  double late_tol{0};
+  double lock_budget{0};
+  int lock_recheck{0};
+  /// conjugated directions since all bands were last active
+  int lock_iter{0};
+  bool partial_{false};
+  double freeze_c{0};
+  /// per k-point band states of the last direction: 0 active, 1 locked, 2 frozen
+  mvector<Kokkos::View<int*, Kokkos::HostSpace>> band_state;
+  /// slope <g(n-1), Z(n-1)> along the previous search direction and its η-contribution
+  double slope_prev{0};
+  double slope_prev_eta{0};
+  double kappa_factor_{1};
 };
 
+template <enum smearing_type SMEARING_TYPE>
+template <class x_t>
+int
+descent_direction<SMEARING_TYPE>::num_bands(const mvector<x_t>& X)
+{
+  int nbands{0};
+  for (auto& elem : X) {
+    nbands += elem.second.map().ncols();
+  }
+  return X.commk().allreduce(nbands, mpi_op::sum);
+}
+
+template <enum smearing_type SMEARING_TYPE>
+template <class ul_t>
+Kokkos::View<int*, Kokkos::HostSpace>
+descent_direction<SMEARING_TYPE>::rotate_locks(const Kokkos::View<int*, Kokkos::HostSpace>& state,
+                                               const ul_t& ul)
+{
+  auto u = create_mirror_view_and_copy(Kokkos::HostSpace(), ul, "descent_direction");
+  int n = state.size();
+  Kokkos::View<int*, Kokkos::HostSpace> out("band states", n);
+  for (int j = 0; j < n; ++j) {
+    // column j of X Ul is dominated by band i
+    int i = 0;
+    double uij = 0;
+    for (int l = 0; l < n; ++l) {
+      double a = Kokkos::abs(u.array()(l, j));
+      if (a > uij) {
+        uij = a;
+        i = l;
+      }
+    }
+    out(j) = state(i) == 1 && uij * uij > 0.9;
+  }
+  return out;
+}
+
+template <enum smearing_type SMEARING_TYPE>
+double
+descent_direction<SMEARING_TYPE>::gamma(double fr,
+                                        double fr_old,
+                                        double g_dp,
+                                        double slope_zp) const
+{
+  // with Δ = -P g: fr = -<g, P g>, g_dp = -<g, P g(n-1)>
+  switch (cg) {
+    case cg_type::FLETCHER_REEVES:
+      return fr / fr_old;
+    case cg_type::POLAK_RIBIERE:
+      return std::max(0.0, (fr - g_dp) / fr_old);
+    case cg_type::HESTENES_STIEFEL:
+    case cg_type::DAI_YUAN: {
+      // <Z(n-1), g - g(n-1)>
+      double dy = slope_zp - slope_prev;
+      if (!(dy > 0)) {
+        Logger::GetInstance() << " CG denominator " << dy << " <= 0, reset gamma\n";
+        return 0;
+      }
+      if (cg == cg_type::HESTENES_STIEFEL) return (g_dp - fr) / dy;
+      return -fr / dy;
+    }
+  }
+  throw std::runtime_error("invalid CG type");
+}
+
 template <enum smearing_type SMEARING_TYPE>
 template <class mem_t,
           class x_t,
@@ -77,7 +354,8 @@ template <class mem_t,
           class ul_t,
           class op_t,
           class prec_t,
-          class F>
+          class F,
+          class ws_t>
 auto
 descent_direction<SMEARING_TYPE>::conjugated(const mem_t& memspc,
                                              double fr_old,
@@ -92,7 +370,8 @@ descent_direction<SMEARING_TYPE>::conjugated(const mem_t& memspc,
                                              double mu,
                                              op_t&& S,
                                              prec_t&& P,
-                                             F&& free_energy)
+                                             F&& free_energy,
+                                             descent_workspace<ws_t>& ws)
 {
   double mo = free_energy.occupancy();
   /* always executed on CPU */
@@ -101,30 +380,91 @@ descent_direction<SMEARING_TYPE>::conjugated(const mem_t& memspc,
 
   auto commk = wk.commk();
 
-  descent_direction_impl<mem_t, SMEARING_TYPE> functor(memspc, mu, dFdmu, sumfn, T, kappa, mo);
+  // band locking and freezing, only late in the run
+  bool late = std::abs(fr_old) < 100 * late_tol;
+  bool lock = late && lock_budget > 0;
+  bool freeze = late && freeze_c > 0;
+  int nbands = lock || freeze ? num_bands(X) : 0;
+  double lock_thr = lock ? lock_budget / nbands : 0;
+  descent_direction_impl<mem_t, SMEARING_TYPE, std::decay_t<op_t>> functor(
+      memspc, mu, dFdmu, sumfn, T, kappa, mo, cg, lock_thr, freeze ? freeze_c : 0);
+
+  // unlock all bands every lock_recheck iterations, their contributions are re-evaluated
+  bool recheck = !lock || (lock_recheck > 0 && ++lock_iter % lock_recheck == 0);
+  if (recheck) lock_iter = 0;
 
-  auto res = eval_threaded(tapply_async(functor, X, en, fn, hx, zxp, zetap, ul, S, P, wk));
+  auto Xm = local::mirror_and_apply_batch(memspc, X, S, ws);
+  const auto& SXm = local::overlap_applied(Xm, S, ws);
+  mvector<Kokkos::View<int*, Kokkos::HostSpace>> locked_in(commk);
+  for (auto& elem : Xm) {
+    auto key = elem.first;
+    auto it = band_state.data().find(key);
+    if (!recheck && it != band_state.data().end() && it->second.size() > 0) {
+      locked_in[key] = rotate_locks(it->second, eval(ul.at(key)));
+    } else {
+      locked_in[key] = Kokkos::View<int*, Kokkos::HostSpace>();
+    }
+  }
+  auto res = eval_threaded(tapply_async(functor,
+                                        Xm,
+                                        en,
+                                        fn,
+                                        hx,
+                                        zxp,
+                                        zetap,
+                                        ul,
+                                        ws.delta_x,
+                                        ws.delta_eta,
+                                        locked_in,
+                                        SXm,
+                                        P,
+                                        ws.psx,
+                                        ws.phx,
+                                        wk));
 
   auto ures = unzip(res);
 
   double fr = sum(std::get<0>(ures), commk);
 
-  double gamma = fr / fr_old;
-
-  Logger::GetInstance() << " CG gamma " << std::setprecision(3) << gamma << "\n";
-
   auto delta_x = std::get<1>(ures);
   auto delta_eta = std::get<2>(ures);
 
   auto z_x = std::get<3>(ures);
   auto z_eta = std::get<4>(ures);
   double slope_zp = sum(std::get<5>(ures), commk);
+  double g_dp = sum(std::get<6>(ures), commk);
+  double fr_eta = sum(std::get<8>(ures), commk);
+  double slope_zp_eta = sum(std::get<9>(ures), commk);
+  band_state = std::as_const(std::get<10>(ures));
+
+  // ratio of the slopes along Z(n-1) after and before the step, for the X and η blocks
+  kappa_factor_ = 1;
+  double slope_prev_x = slope_prev - slope_prev_eta;
+  if (std::abs(slope_prev_x) > 1e-3 * std::abs(slope_prev) &&
+      std::abs(slope_prev_eta) > 1e-3 * std::abs(slope_prev)) {
+    double rho_x = (slope_zp - slope_zp_eta) / slope_prev_x;
+    double rho_eta = slope_zp_eta / slope_prev_eta;
+    if (rho_x < 1 && rho_eta < 1) {
+      kappa_factor_ = (1 - rho_x) / (1 - rho_eta);
+    }
+  }
+  partial_ = false;
+  if (nbands > 0) {
+    int nactive = sum(std::get<7>(ures), commk);
+    partial_ = nactive < nbands;
+    Logger::GetInstance() << " active bands: " << nactive << " / " << nbands << "\n";
+  }
+
+  double gamma = this->gamma(fr, fr_old, g_dp, slope_zp);
+
+  Logger::GetInstance() << " CG gamma " << std::setprecision(3) << gamma << "\n";
 
   /* this is tr{<Z|g>} = tr{<Δ + γ*Z(n-1)|g>} = tr{<Δ |g>} + γ * tr{<Z(n-1)|g>}
    *            ^                                   ^                  ^
    *          slope  =                             fr    + γ *     slope_zp
    */
   double slope = fr + gamma * slope_zp;
+  double slope_eta = fr_eta + gamma * slope_zp_eta;
 
   eval_threaded(
       // note: this operation is in-place and overwrites z_x, z_eta
@@ -140,6 +480,12 @@ descent_direction<SMEARING_TYPE>::conjugated(const mem_t& memspc,
           z_x,
           z_eta));
 
+  // note: std::as_const selects the copy assignment (not the key-wise assignment of mvector)
+  ws.delta_x = std::as_const(delta_x);
+  ws.delta_eta = std::as_const(delta_eta);
+  slope_prev = slope;
+  slope_prev_eta = slope_eta;
+
   return std::make_tuple(fr, slope, z_x, z_eta);
 }
 
@@ -151,7 +497,8 @@ template <class mem_t,
           class hx_t,
           class op_t,
           class prec_t,
-          class F>
+          class F,
+          class ws_t>
 std::tuple<double, mvector<to_layout_left_t<x_t>>, mvector<to_layout_left_t<x_t>>>
 descent_direction<SMEARING_TYPE>::restarted(const mem_t& memspc,
                                             const mvector<x_t>& X,
@@ -162,7 +509,8 @@ descent_direction<SMEARING_TYPE>::restarted(const mem_t& memspc,
                                             double mu,
                                             op_t&& S,
                                             prec_t&& P,
-                                            F&& free_energy)
+                                            F&& free_energy,
+                                            descent_workspace<ws_t>& ws)
 {
   double mo = free_energy.occupancy();
   double dFdmu = GradEtaHelper<SMEARING_TYPE>::dFdmu(free_energy.get_ek(), en, fn, wk, mu, T, mo);
@@ -170,15 +518,27 @@ descent_direction<SMEARING_TYPE>::restarted(const mem_t& memspc,
 
   auto commk = wk.commk();
 
-  descent_direction_impl<mem_t, SMEARING_TYPE> functor(memspc, mu, dFdmu, sumfn, T, kappa, mo);
+  descent_direction_impl<mem_t, SMEARING_TYPE, std::decay_t<op_t>> functor(
+      memspc, mu, dFdmu, sumfn, T, kappa, mo, cg);
 
-  auto res = eval_threaded(tapply_async(functor, X, en, fn, hx, S, P, wk));
+  auto Xm = local::mirror_and_apply_batch(memspc, X, S, ws);
+  const auto& SXm = local::overlap_applied(Xm, S, ws);
+  auto res = eval_threaded(tapply_async(functor, Xm, en, fn, hx, SXm, P, ws.psx, ws.phx, wk));
   auto ures = unzip(res);
 
   double fr = sum(std::get<0>(ures), commk);
   auto z_x = std::get<1>(ures);
   auto z_eta = std::get<2>(ures);
 
+  // Z = Δ, note that Z is not modified in-place by conjugated
+  band_state.data().clear();
+  lock_iter = 0;
+  partial_ = false;
+  ws.delta_x = std::as_const(z_x);
+  ws.delta_eta = std::as_const(z_eta);
+  slope_prev = fr;
+  slope_prev_eta = sum(std::get<4>(ures), commk);
+
   return std::make_tuple(fr, z_x, z_eta);
 }
 
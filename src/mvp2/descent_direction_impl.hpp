@@ -1,16 +1,29 @@
 #pragma once
 
 #include <Kokkos_Core.hpp>
+#include "constants.hpp"
 #include "la/dvector.hpp"
 #include "la/mvector.hpp"
 #include "mvp2.hpp"
+#include "overlap.hpp"
 #include "pseudo_hamiltonian/grad_eta.hpp"
 #include "utils/logger.hpp"
 
 
 namespace nlcglib {
 
-template <class memspace_t, enum smearing_type smearing_t>
+/// CG update formula for γ
+enum class cg_type
+{
+  FLETCHER_REEVES,
+  /// Polak-Ribière+, γ = max(0, γ_PR)
+  POLAK_RIBIERE,
+  HESTENES_STIEFEL,
+  DAI_YUAN
+};
+
+/// overlap_t = IdentityOverlap selects the norm-conserving code path (S = I)
+template <class memspace_t, enum smearing_type smearing_t, class overlap_t = Overlap>
 class descent_direction_impl {
   public : descent_direction_impl(const memspace_t& memspc,
                                   double mu,
@@ -18,13 +31,19 @@ class descent_direction_impl {
                                   double sumfn,
                                   double T,
                                   double kappa,
-                                  double mo) : memspc(memspc),
+                                  double mo,
+                                  cg_type cg = cg_type::FLETCHER_REEVES,
+                                  double lock_thr = 0,
+                                  double freeze_c = 0) : memspc(memspc),
   mu(mu),
   dFdmu(dFdmu),
   sumfn(sumfn),
   T(T),
   kappa(kappa),
-  mo(mo){}
+  mo(mo),
+  cg(cg),
+  lock_thr(lock_thr),
+  freeze_c(freeze_c){}
 
   /* interface routine, does memory transfers if needed */
   template <class x_t,
@@ -34,8 +53,11 @@ class descent_direction_impl {
             class zxp_t,
             class zetap_t,
             class ul_t,
-            class op_t,
-            class prec_t>
+            class dp_t,
+            class lk_t,
+            class sx_t,
+            class prec_t,
+            class ws_t>
   auto
   operator()(x_t&& X,
              e_t&& en,
@@ -44,49 +66,123 @@ class descent_direction_impl {
              zxp_t&& zxp,
              zetap_t&& zetap,
              ul_t&& ul,
-             op_t&& S,
+             dp_t&& dxp,
+             dp_t&& detap,
+             lk_t&& locked,
+             sx_t&& SX,
              prec_t&& P,
+             ws_t&& psx,
+             ws_t&& phx,
              double wk);
 
   /* interface routine, does memory transfers if needed, for CG restart (steepest descent) */
-  template <class x_t, class e_t, class f_t, class hx_t, class op_t, class prec_t>
+  template <class x_t, class e_t, class f_t, class hx_t, class sx_t, class prec_t, class ws_t>
   auto
-  operator()(x_t&& X, e_t&& en, f_t&& fn, hx_t&& hx, op_t&& S, prec_t&& P, double wk);
+  operator()(x_t&& X,
+             e_t&& en,
+             f_t&& fn,
+             hx_t&& hx,
+             sx_t&& SX,
+             prec_t&& P,
+             ws_t&& psx,
+             ws_t&& phx,
+             double wk);
 
   template <class x_t,
             class e_t,
             class f_t,
             class hx_t,
-            class op_t,
+            class sx_t,
             class prec_t,
             class zxp_t,
             class zetap_t,
-            class ul_t>
+            class ul_t,
+            class dp_t,
+            class ws_t>
   std::tuple<double,
              to_layout_left_t<x_t>,
              to_layout_left_t<zetap_t>,
              to_layout_left_t<x_t>,
              to_layout_left_t<zetap_t>,
-             double> exec_spc(x_t && x,
-                              e_t&& e,
-                              f_t&& f,
-                              hx_t&& hx,
-                              op_t&& s,
-                              prec_t&& p,
-                              zxp_t&& zxp,
-                              zetap_t&& zetap,
-                              ul_t&& ul,
-                              double wk);
-
-  /* CG conjugated direction gradients */
-  template <class x_t, class sx_t, class zxp_t, class zetap_t, class ul_t, class gx_t, class geta_t>
-  std::tuple<double, to_layout_left_t<zxp_t>, to_layout_left_t<zetap_t>> exec_conjugate(
-      x_t && x, sx_t&& sx, zxp_t&& zxp, zetap_t&& zetap, ul_t&& ul, gx_t&& gx, geta_t&& geta);
+             double,
+             double,
+             int,
+             double,
+             double,
+             Kokkos::View<int*, Kokkos::HostSpace>>
+  exec_spc(x_t&& x,
+           e_t&& e,
+           f_t&& f,
+           hx_t&& hx,
+           sx_t&& sx,
+           prec_t&& p,
+           zxp_t&& zxp,
+           zetap_t&& zetap,
+           ul_t&& ul,
+           dp_t&& dxp,
+           dp_t&& detap,
+           ws_t&& psx,
+           ws_t&& phx,
+           double wk,
+           const Kokkos::View<int*, Kokkos::HostSpace>& locked);
+
+  /* CG conjugated direction gradients, dxp, detap are the previous Δ (host memory), they are
+   * transported to the current basis only if needed by the CG update formula. gx and the
+   * returned Zx hold the active columns only (see exec_gradients). */
+  template <class x_t,
+            class sx_t,
+            class zxp_t,
+            class zetap_t,
+            class ul_t,
+            class dp_t,
+            class gx_t,
+            class geta_t,
+            class act_t>
+  std::tuple<double, to_layout_left_t<zxp_t>, to_layout_left_t<zetap_t>, double, double>
+  exec_conjugate(
+      x_t && x,
+      sx_t&& sx,
+      zxp_t&& zxp,
+      zetap_t&& zetap,
+      ul_t&& ul,
+      dp_t&& dxp,
+      dp_t&& detap,
+      gx_t&& gx,
+      geta_t&& geta,
+      const act_t& active);
+
+  /* gradients g = (gx, g_eta) and preconditioned gradients Δ = (Δx, Δη), fr = <g, Δ>,
+   * returns tuple(fr, Δx, Δη, gx, g_eta, active, fr_eta), fr_eta = <g_eta, Δη>.
+   * gx and Δx are computed for the active bands only and hold their columns (active_columns):
+   * with freeze_c > 0 the trailing bands above mu + freeze_c * kT are frozen, with band locking
+   * (lock_thr > 0) the bands locked in the previous iterations (state 1 in locked) are permuted
+   * to the back. active.locked holds the band states for the next iteration, bands whose
+   * contribution to fr is below lock_thr are locked from then on. */
+  template <class x_t, class e_t, class f_t, class hx_t, class sx_t, class prec_t, class ws_t>
+  auto exec_gradients(x_t&& x,
+                      e_t&& e,
+                      f_t&& f,
+                      hx_t&& hx,
+                      sx_t&& sx,
+                      prec_t&& p,
+                      ws_t&& psx,
+                      ws_t&& phx,
+                      double wk,
+                      const Kokkos::View<int*, Kokkos::HostSpace>& locked =
+                          Kokkos::View<int*, Kokkos::HostSpace>());
 
   /* CG restart gradients */
-  template <class x_t, class e_t, class f_t, class hx_t, class op_t, class prec_t>
-  std::tuple<double, to_layout_left_t<x_t>, to_layout_left_t<x_t>> exec_spc(
-      x_t && x, e_t&& e, f_t&& f, hx_t&& hx, op_t&& s, prec_t&& p, double wk);
+  template <class x_t, class e_t, class f_t, class hx_t, class sx_t, class prec_t, class ws_t>
+  std::tuple<double, to_layout_left_t<x_t>, to_layout_left_t<x_t>, int, double> exec_spc(
+      x_t && x,
+      e_t&& e,
+      f_t&& f,
+      hx_t&& hx,
+      sx_t&& sx,
+      prec_t&& p,
+      ws_t&& psx,
+      ws_t&& phx,
+      double wk);
 
   private : memspace_t memspc;
   double mu;
@@ -95,106 +191,316 @@ class descent_direction_impl {
   double T;
   double kappa;
   double mo;
+  cg_type cg;
+  /// band locking threshold for the contribution of a single column to <g, Δ>, 0: disabled
+  double lock_thr;
+  /// bands above mu + freeze_c * kT are frozen, 0: disabled
+  double freeze_c;
 };
 
+namespace local {
+/**
+ * Active bands of a k-point, i.e. the columns for which the X-gradient is computed. The locked
+ * bands are permuted to the back: the active columns are idx(0), idx(1), ... (ascending), idx is
+ * empty if they are the leading nact columns.
+ */
+template <class memspace>
+struct active_columns
+{
+  /// total number of bands
+  int n;
+  int nact;
+  Kokkos::View<int*, memspace> idx;
+  /// band states for the next iteration: 0 active, 1 locked, 2 frozen (empty if band locking and
+  /// freezing are disabled)
+  Kokkos::View<int*, Kokkos::HostSpace> locked;
+
+  /// the active columns of v
+  template <class v_t>
+  v_t columns(const v_t& v) const
+  {
+    if (nact == n) return v;
+    if (idx.size() == 0) return leading_columns(v, nact);
+    return gather_columns(v, idx);
+  }
+
+  /// all columns, zero for the inactive bands
+  template <class v_t>
+  std::decay_t<v_t> expand(v_t&& v_a) const
+  {
+    if (nact == n) return v_a;
+    Map<> map(v_a.map().comm(), SlabLayoutV({{0, 0, v_a.map().nrows(), n}}));
+    std::decay_t<v_t> v(map);
+    if (idx.size() == 0) {
+      auto v_lead = leading_columns(v, nact);
+      deep_copy(v_lead, v_a, "descent_direction");
+    } else {
+      scatter_columns(v, v_a, idx);
+    }
+    return v;
+  }
+};
+}  // namespace local
 
-template <class memspc_t, enum smearing_type smearing_t>
+
+template <class memspc_t, enum smearing_type smearing_t, class overlap_t>
 template <class x_t,
           class e_t,
           class f_t,
           class hx_t,
-          class op_t,
+          class sx_t,
           class prec_t,
           class zxp_t,
           class zetap_t,
-          class ul_t>
+          class ul_t,
+          class dp_t,
+          class ws_t>
 std::tuple<double,
            to_layout_left_t<x_t>,
            to_layout_left_t<zetap_t>,
            to_layout_left_t<x_t>,
            to_layout_left_t<zetap_t>,
-           double>
-descent_direction_impl<memspc_t, smearing_t>::exec_spc(x_t&& x,
-                                                       e_t&& e,
-                                                       f_t&& f,
-                                                       hx_t&& hx,
-                                                       op_t&& s,
-                                                       prec_t&& p,
-                                                       zxp_t&& zxp,
-                                                       zetap_t&& zetap,
-                                                       ul_t&& ul,
-                                                       double wk)
+           double,
+           double,
+           int,
+           double,
+           double,
+           Kokkos::View<int*, Kokkos::HostSpace>>
+descent_direction_impl<memspc_t, smearing_t, overlap_t>::exec_spc(
+    x_t&& x,
+    e_t&& e,
+    f_t&& f,
+    hx_t&& hx,
+    sx_t&& sx,
+    prec_t&& p,
+    zxp_t&& zxp,
+    zetap_t&& zetap,
+    ul_t&& ul,
+    dp_t&& dxp,
+    dp_t&& detap,
+    ws_t&& psx,
+    ws_t&& phx,
+    double wk,
+    const Kokkos::View<int*, Kokkos::HostSpace>& locked)
 {
-  auto sx = s(x);
-  auto llm = local::lmult()(x, sx, hx, p);
-  auto gx = local::gradx()(sx, hx, f, llm, wk);
-  auto delta_x = local::precondgx_us()(sx, hx, p, llm);
-  auto hij = inner_()(x, hx, wk);
-  // // std::cout << dFdmu << ", " << sumfn << "\n";
-
-  GradEta<smearing_t> grad_eta(this->T, this->kappa);
-  auto g_eta = grad_eta.g_eta(hij, mu, wk, e, f, this->sumfn, this->dFdmu, this->mo);
-  auto delta_eta = _delta_eta(this->kappa)(hij, e, wk);
-
-  double fr_x = 2 * innerh_tr()(gx, delta_x).real();
-  double fr_eta = innerh_tr()(g_eta, delta_eta).real();
-  double fr = fr_x + fr_eta;
+  auto res = this->exec_gradients(x, e, f, hx, sx, p, psx, phx, wk, locked);
+  double fr = std::get<0>(res);
+  auto delta_x = std::get<1>(res);
+  auto delta_eta = std::get<2>(res);
+  auto gx = std::get<3>(res);
+  auto g_eta = std::get<4>(res);
+  auto& active = std::get<5>(res);
 
   // CG contributions
-  auto res_conj = this->exec_conjugate(x, sx, zxp, zetap, ul, gx, g_eta);
+  auto res_conj = this->exec_conjugate(x, sx, zxp, zetap, ul, dxp, detap, gx, g_eta, active);
   double slope_zp = std::get<0>(res_conj);
-  auto z_x = std::get<1>(res_conj);
   auto z_eta = std::get<2>(res_conj);
-
-  return std::make_tuple(fr, delta_x, delta_eta, z_x, z_eta, slope_zp);
+  double g_dp = std::get<3>(res_conj);
+
+  return std::make_tuple(fr,
+                         active.expand(delta_x),
+                         delta_eta,
+                         active.expand(std::get<1>(res_conj)),
+                         z_eta,
+                         slope_zp,
+                         g_dp,
+                         active.nact,
+                         std::get<6>(res),
+                         std::get<4>(res_conj),
+                         active.locked);
 }
 
 
-template <class memspc_t, enum smearing_type smearing_t>
-template <class x_t, class sx_t, class zxp_t, class zetap_t, class ul_t, class gx_t, class geta_t>
-std::tuple<double, to_layout_left_t<zxp_t>, to_layout_left_t<zetap_t>>
-descent_direction_impl<memspc_t, smearing_t>::exec_conjugate(
-    x_t&& x, sx_t&& sx, zxp_t&& zxp, zetap_t&& zetap, ul_t&& ul, gx_t&& gx, geta_t&& geta)
+template <class memspc_t, enum smearing_type smearing_t, class overlap_t>
+template <class x_t,
+          class sx_t,
+          class zxp_t,
+          class zetap_t,
+          class ul_t,
+          class dp_t,
+          class gx_t,
+          class geta_t,
+          class act_t>
+std::tuple<double, to_layout_left_t<zxp_t>, to_layout_left_t<zetap_t>, double, double>
+descent_direction_impl<memspc_t, smearing_t, overlap_t>::exec_conjugate(x_t&& x,
+                                                                        sx_t&& sx,
+                                                                        zxp_t&& zxp,
+                                                                        zetap_t&& zetap,
+                                                                        ul_t&& ul,
+                                                                        dp_t&& dxp_h,
+                                                                        dp_t&& detap_h,
+                                                                        gx_t&& gx,
+                                                                        geta_t&& geta,
+                                                                        const act_t& active)
 {
-  auto zx_tmp = local::rotatex()(zxp, ul);
+  // only the active columns of Zx are transported, the others are held fixed
+  auto ul_a = active.columns(ul);
+  auto rotate_active = [&](auto& z) {
+    if (active.nact == active.n) return local::rotatex()(z, ul);
+    using z_t = to_layout_left_t<std::remove_reference_t<decltype(z)>>;
+    using numeric_t = typename z_t::numeric_t;
+    z_t z_a(Map<>(z.map().comm(), SlabLayoutV({{0, 0, z.map().nrows(), active.nact}})));
+    transform(z_a, numeric_t{0.0}, numeric_t{1.0}, z, ul_a);
+    return z_a;
+  };
+  auto zx_tmp = rotate_active(zxp);
   auto zeta = local::rotateeta()(zetap, ul);
 
   // apply Lagrange multipliers to zx
-  auto zx = local::conjugatex()(zx_tmp, x, sx);
+  auto conjugate = [&](auto& z) {
+    if constexpr (is_identity_overlap<overlap_t>::value) {
+      return local::conjugatex()(z, x);
+    } else {
+      return local::conjugatex()(z, x, sx);
+    }
+  };
+  auto zx = conjugate(zx_tmp);
 
   auto slope_x_loc = 2 * innerh_tr()(zx, gx).real();
   auto slope_eta_loc = innerh_tr()(zeta, geta).real();
   double slope_loc = slope_x_loc + slope_eta_loc;
 
-  return std::make_tuple(slope_loc, zx, zeta);
+  // <g, Δ(n-1)>, Fletcher-Reeves doesn't need it
+  double g_dp_loc{0};
+  if (cg != cg_type::FLETCHER_REEVES) {
+    auto dxp = create_mirror_view_and_copy(memspc, dxp_h, "descent_direction");
+    auto detap = create_mirror_view_and_copy(memspc, detap_h, "descent_direction");
+    auto dx_tmp = rotate_active(dxp);
+    auto deta = local::rotateeta()(detap, ul);
+    auto dx = conjugate(dx_tmp);
+    g_dp_loc = 2 * innerh_tr()(dx, gx).real() + innerh_tr()(deta, geta).real();
+  }
+
+  return std::make_tuple(slope_loc, zx, zeta, g_dp_loc, slope_eta_loc);
 }
 
 
-template <class memspc_t, enum smearing_type smearing_t>
-template <class x_t, class e_t, class f_t, class hx_t, class op_t, class prec_t>
-std::tuple<double, to_layout_left_t<x_t>, to_layout_left_t<x_t>>
-descent_direction_impl<memspc_t, smearing_t>::exec_spc(
-    x_t&& x, e_t&& e, f_t&& f, hx_t&& hx, op_t&& s, prec_t&& p, double wk)
+template <class memspc_t, enum smearing_type smearing_t, class overlap_t>
+template <class x_t, class e_t, class f_t, class hx_t, class sx_t, class prec_t, class ws_t>
+std::tuple<double, to_layout_left_t<x_t>, to_layout_left_t<x_t>, int, double>
+descent_direction_impl<memspc_t, smearing_t, overlap_t>::exec_spc(x_t&& x,
+                                                       e_t&& e,
+                                                       f_t&& f,
+                                                       hx_t&& hx,
+                                                       sx_t&& sx,
+                                                       prec_t&& p,
+                                                       ws_t&& psx,
+                                                       ws_t&& phx,
+                                                       double wk)
 {
-  auto sx = s(x);
-  auto llm = local::lmult()(x, sx, hx, p);
-  auto gx = local::gradx()(sx, hx, f, llm, wk);
-  auto delta_x = local::precondgx_us()(sx, hx, p, llm);
+  auto res = this->exec_gradients(x, e, f, hx, sx, p, psx, phx, wk);
+  auto& active = std::get<5>(res);
+  return std::make_tuple(std::get<0>(res),
+                         active.expand(std::get<1>(res)),
+                         std::get<2>(res),
+                         active.nact,
+                         std::get<6>(res));
+}
+
+
+template <class memspc_t, enum smearing_type smearing_t, class overlap_t>
+template <class x_t, class e_t, class f_t, class hx_t, class sx_t, class prec_t, class ws_t>
+auto
+descent_direction_impl<memspc_t, smearing_t, overlap_t>::exec_gradients(
+    x_t&& x,
+    e_t&& e,
+    f_t&& f,
+    hx_t&& hx,
+    sx_t&& sx,
+    prec_t&& p,
+    ws_t&& psx,
+    ws_t&& phx,
+    double wk,
+    const Kokkos::View<int*, Kokkos::HostSpace>& locked)
+{
+  using memspace = typename std::remove_reference_t<x_t>::storage_t::memory_space;
+  int n = x.map().ncols();
+  // the X-gradient is computed for the leading na columns only, the trailing bands above
+  // mu + freeze_c * kT are frozen (η still couples to them through hij)
+  int na = n;
+  if (freeze_c > 0) {
+    auto e_h = copies::create_mirror_view_and_copy("descent_direction", Kokkos::HostSpace(), e);
+    double kT = T * physical_constants::kb;
+    while (na > 1 && e_h(na - 1) > mu + freeze_c * kT) --na;
+  }
+  // active bands, the locked ones are permuted to the back
+  std::vector<int> idx;
+  if (lock_thr > 0 && locked.size() == static_cast<size_t>(n)) {
+    for (int j = 0; j < na; ++j) {
+      if (locked(j) != 1) idx.push_back(j);
+    }
+  }
+  local::active_columns<memspace> active{n, na};
+  if (!idx.empty() && static_cast<int>(idx.size()) < na) {
+    active.nact = idx.size();
+    if (idx.back() >= active.nact) {
+      Kokkos::View<int*, Kokkos::HostSpace> idx_h("active bands", idx.size());
+      for (int j = 0; j < active.nact; ++j) idx_h(j) = idx[j];
+      active.idx = copies::create_mirror_view_and_copy("descent_direction", memspc, idx_h);
+    }
+  }
+  int nact = active.nact;
+
+  auto sx_a = active.columns(sx);
+  auto hx_a = active.columns(hx);
+  auto phx_a = nact == n ? phx : leading_columns(phx, nact);
+  Kokkos::View<double*, memspace> f_a;
+  if (active.idx.size() == 0) {
+    f_a = Kokkos::subview(f, std::make_pair(0, nact));
+  } else {
+    auto f_h = copies::create_mirror_view_and_copy("descent_direction", Kokkos::HostSpace(), f);
+    Kokkos::View<double*, Kokkos::HostSpace> fa_h("fn, active bands", nact);
+    for (int j = 0; j < nact; ++j) fa_h(j) = f_h(idx[j]);
+    f_a = copies::create_mirror_view_and_copy("descent_direction", memspc, fa_h);
+  }
+
+  // llm lives in the workspace psx and is overwritten by precondgx_us_inplace
+  auto llm = local::lmult()(x, sx, hx_a, p, psx, phx_a);
+  auto gx = local::gradx()(sx_a, hx_a, f_a, llm, wk);
+  auto delta_x = [&]() {
+    if constexpr (is_identity_overlap<overlap_t>::value) {
+      return local::precondgx()(active.columns(x), hx_a, p, llm);
+    } else {
+      return local::precondgx_us_inplace()(sx_a, hx_a, p, llm);
+    }
+  }();
   auto hij = inner_()(x, hx, wk);
 
+  // {occupied, fractional, empty} blocks of η
+  auto part = make_eta_partition(f, this->mo);
   GradEta<smearing_t> grad_eta(this->T, this->kappa);
-  auto g_eta = grad_eta.g_eta(hij, mu, wk, e, f, this->sumfn, this->dFdmu, this->mo);
-  auto delta_eta = _delta_eta(this->kappa)(hij, e, wk);
-
-  double fr_x = 2 * innerh_tr()(gx, delta_x).real();
+  auto g_eta = grad_eta.g_eta(hij, mu, wk, e, f, this->sumfn, this->dFdmu, this->mo, part);
+  auto delta_eta = _delta_eta(this->kappa)(hij, e, wk, part);
+
+  if (lock_thr > 0 || na < n) {
+    active.locked = Kokkos::View<int*, Kokkos::HostSpace>("band states", n);
+    for (int j = 0; j < n; ++j) {
+      active.locked(j) = j >= na ? 2 : 0;
+    }
+  }
+  double fr_x{0};
+  if (lock_thr > 0) {
+    // band locking: per-band contributions to <g, Δ>, bands below lock_thr are locked
+    auto fr_band = copies::create_mirror_view_and_copy(
+        "descent_direction", Kokkos::HostSpace(), innerh_cols()(gx, delta_x));
+    if (locked.size() == static_cast<size_t>(n)) {
+      for (int j = 0; j < na; ++j) active.locked(j) = locked(j) == 1;
+    }
+    for (int j = 0; j < nact; ++j) {
+      fr_x += 2 * fr_band(j);
+      int band = active.idx.size() == 0 ? j : idx[j];
+      if (std::abs(2 * fr_band(j)) < lock_thr) active.locked(band) = 1;
+    }
+  } else {
+    fr_x = 2 * innerh_tr()(gx, delta_x).real();
+  }
   double fr_eta = innerh_tr()(g_eta, delta_eta).real();
   double fr = fr_x + fr_eta;
 
-  return std::make_tuple(fr, delta_x, delta_eta);
+  return std::make_tuple(fr, delta_x, delta_eta, gx, g_eta, active, fr_eta);
 }
 
-
-template <class memspc_t, enum smearing_type smearing_t>
+template <class memspc_t, enum smearing_type smearing_t, class overlap_t>
 template <class x_t,
           class e_t,
           class f_t,
@@ -202,31 +508,41 @@ template <class x_t,
           class zxp_t,
           class zetap_t,
           class ul_t,
-          class op_t,
-          class prec_t>
+          class dp_t,
+          class lk_t,
+          class sx_t,
+          class prec_t,
+          class ws_t>
 auto
-descent_direction_impl<memspc_t, smearing_t>::operator()(x_t&& X_h,
+descent_direction_impl<memspc_t, smearing_t, overlap_t>::operator()(x_t&& X_h,
                                                          e_t&& en_h,
                                                          f_t&& fn_h,
                                                          hx_t&& hx_h,
                                                          zxp_t&& zxp_h,
                                                          zetap_t&& zetap_h,
                                                          ul_t&& ul_h,
-                                                         op_t&& S,
+                                                         dp_t&& dxp_h,
+                                                         dp_t&& detap_h,
+                                                         lk_t&& locked,
+                                                         sx_t&& SX_h,
                                                          prec_t&& P,
+                                                         ws_t&& psx,
+                                                         ws_t&& phx,
                                                          double wk)
 {
-  auto X = create_mirror_view_and_copy(memspc, X_h);
-  auto en = Kokkos::create_mirror_view_and_copy(memspc, en_h);
-  auto fn = Kokkos::create_mirror_view_and_copy(memspc, fn_h);
-  auto HX = create_mirror_view_and_copy(memspc, hx_h);
+  auto X = create_mirror_view_and_copy(memspc, X_h, "descent_direction");
+  auto SX = create_mirror_view_and_copy(memspc, SX_h, "descent_direction");
+  auto en = copies::create_mirror_view_and_copy("descent_direction", memspc, en_h);
+  auto fn = copies::create_mirror_view_and_copy("descent_direction", memspc, fn_h);
+  auto HX = create_mirror_view_and_copy(memspc, hx_h, "descent_direction");
 
   // previous search directions
-  auto ZXp = create_mirror_view_and_copy(memspc, zxp_h);
-  auto Zetap = create_mirror_view_and_copy(memspc, zetap_h);
-  auto ul = create_mirror_view_and_copy(memspc, ul_h);
+  auto ZXp = create_mirror_view_and_copy(memspc, zxp_h, "descent_direction");
+  auto Zetap = create_mirror_view_and_copy(memspc, zetap_h, "descent_direction");
+  auto ul = create_mirror_view_and_copy(memspc, ul_h, "descent_direction");
 
-  auto res = this->exec_spc(X, en, fn, HX, S, P, ZXp, Zetap, ul, wk);
+  auto res = this->exec_spc(
+      X, en, fn, HX, SX, P, ZXp, Zetap, ul, dxp_h, detap_h, psx, phx, wk, locked);
 
   // steepest descent vars
   double fr = std::get<0>(res);
@@ -237,43 +553,69 @@ descent_direction_impl<memspc_t, smearing_t>::operator()(x_t&& X_h,
   auto z_x = std::get<3>(res);
   auto z_eta = std::get<4>(res);
   double slope_zp = std::get<5>(res);
+  double g_dp = std::get<6>(res);
+  int nactive = std::get<7>(res);
+  double fr_eta = std::get<8>(res);
+  double slope_zp_eta = std::get<9>(res);
 
   // copy Δ to host
-  auto delta_x_h = create_mirror_view_and_copy(Kokkos::HostSpace(), delta_x);
-  auto delta_eta_h = create_mirror_view_and_copy(Kokkos::HostSpace(), delta_eta);
+  auto delta_x_h = create_mirror_view_and_copy(Kokkos::HostSpace(), delta_x, "descent_direction");
+  auto delta_eta_h =
+      create_mirror_view_and_copy(Kokkos::HostSpace(), delta_eta, "descent_direction");
 
   // copy Z to host
-  auto z_x_h = create_mirror_view_and_copy(Kokkos::HostSpace(), z_x);
-  auto z_eta_h = create_mirror_view_and_copy(Kokkos::HostSpace(), z_eta);
-
-  /// return slopes and Δ, Z (host memeory)
-  return std::make_tuple(fr, delta_x_h, delta_eta_h, z_x_h, z_eta_h, slope_zp);
+  auto z_x_h = create_mirror_view_and_copy(Kokkos::HostSpace(), z_x, "descent_direction");
+  auto z_eta_h = create_mirror_view_and_copy(Kokkos::HostSpace(), z_eta, "descent_direction");
+
+  /// return slopes and Δ, Z (host memeory) and the lock flags for the next iteration
+  return std::make_tuple(fr,
+                         delta_x_h,
+                         delta_eta_h,
+                         z_x_h,
+                         z_eta_h,
+                         slope_zp,
+                         g_dp,
+                         nactive,
+                         fr_eta,
+                         slope_zp_eta,
+                         std::get<10>(res));
 }
 
-template <class memspc_t, enum smearing_type smearing_t>
-template <class x_t, class e_t, class f_t, class hx_t, class op_t, class prec_t>
+template <class memspc_t, enum smearing_type smearing_t, class overlap_t>
+template <class x_t, class e_t, class f_t, class hx_t, class sx_t, class prec_t, class ws_t>
 auto
-descent_direction_impl<memspc_t, smearing_t>::operator()(
-    x_t&& X_h, e_t&& en_h, f_t&& fn_h, hx_t&& hx_h, op_t&& S, prec_t&& P, double wk)
+descent_direction_impl<memspc_t, smearing_t, overlap_t>::operator()(x_t&& X_h,
+                                                         e_t&& en_h,
+                                                         f_t&& fn_h,
+                                                         hx_t&& hx_h,
+                                                         sx_t&& SX_h,
+                                                         prec_t&& P,
+                                                         ws_t&& psx,
+                                                         ws_t&& phx,
+                                                         double wk)
 {
-  auto X = create_mirror_view_and_copy(memspc, X_h);
-  auto en = Kokkos::create_mirror_view_and_copy(memspc, en_h);
-  auto fn = Kokkos::create_mirror_view_and_copy(memspc, fn_h);
-  auto HX = create_mirror_view_and_copy(memspc, hx_h);
+  auto X = create_mirror_view_and_copy(memspc, X_h, "descent_direction");
+  auto SX = create_mirror_view_and_copy(memspc, SX_h, "descent_direction");
+  auto en = copies::create_mirror_view_and_copy("descent_direction", memspc, en_h);
+  auto fn = copies::create_mirror_view_and_copy("descent_direction", memspc, fn_h);
+  auto HX = create_mirror_view_and_copy(memspc, hx_h, "descent_direction");
 
-  auto res = this->exec_spc(X, en, fn, HX, S, P, wk);
+  auto res = this->exec_spc(X, en, fn, HX, SX, P, psx, phx, wk);
 
   // steepest descent vars
   double fr = std::get<0>(res);
   auto delta_x = std::get<1>(res);
   auto delta_eta = std::get<2>(res);
+  int nactive = std::get<3>(res);
+  double fr_eta = std::get<4>(res);
 
   // copy Δ to host
-  auto delta_x_h = create_mirror_view_and_copy(Kokkos::HostSpace(), delta_x);
-  auto delta_eta_h = create_mirror_view_and_copy(Kokkos::HostSpace(), delta_eta);
+  auto delta_x_h = create_mirror_view_and_copy(Kokkos::HostSpace(), delta_x, "descent_direction");
+  auto delta_eta_h =
+      create_mirror_view_and_copy(Kokkos::HostSpace(), delta_eta, "descent_direction");
 
   /// return slopes and Δ, Z (host memeory)
-  return std::make_tuple(fr, delta_x_h, delta_eta_h);
+  return std::make_tuple(fr, delta_x_h, delta_eta_h, nactive, fr_eta);
 }
 
 }  // namespace nlcglib
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <vector>
+#include "descent_direction.hpp"
+#include "descent_direction_impl.hpp"
+#include "overlap.hpp"
+#include "utils/logger.hpp"
+
+namespace nlcglib {
+
+namespace local {
+
+/// project an x-component to the tangent space at X (see conjugatex)
+template <class op_t, class z_t, class x_t, class sx_t>
+auto
+project_tangent(z_t& z, const x_t& x, const sx_t& sx)
+{
+  if constexpr (is_identity_overlap<op_t>::value) {
+    return local::conjugatex()(z, x);
+  } else {
+    return local::conjugatex()(z, x, sx);
+  }
+}
+
+}  // namespace local
+
+/**
+ * Limited-memory BFGS direction on the (X, η) manifold.
+ *
+ * Keeps the last m pairs s = t Z(n-1), y = g - g(n-1), they are parallel-transported to the
+ * current basis in the same way as the previous search direction in CG (rotatex, rotateeta,
+ * conjugatex). Gradients are projected to the tangent space before they are stored, otherwise
+ * the transport does not preserve <s, y>. The initial inverse Hessian H0 is the preconditioner,
+ * i.e. H0 g = -Δ, and H0 y = -(Δ - Δ(n-1)) is stored along with the pair. The Gram matrices
+ * <s_i, y_j>, <y_i, H0 y_j> and the products with the current gradient are recomputed every
+ * iteration, in a single reduction: the projection after the transport is not an isometry, products
+ * from earlier iterations do not match the transported pairs. The recursion itself runs on the
+ * coefficients.
+ */
+template <enum smearing_type SMEARING_TYPE, class matrix_t>
+class lbfgs_direction
+{
+  using key_t = std::pair<int, int>;
+  /// upper bound for the history size, Z is assembled in a single pass over the stored pairs
+  static constexpr int max_pairs = 16;
+
+  /// (x, η) components of a tangent vector, on memspc
+  struct tangent
+  {
+    matrix_t x;
+    matrix_t eta;
+  };
+
+  struct history
+  {
+    std::deque<tangent> s;
+    std::deque<tangent> y;
+    /// -H0 y
+    std::deque<tangent> py;
+    /// previous search direction, gradient and preconditioned gradient
+    tangent z;
+    tangent g;
+    tangent d;
+  };
+
+public:
+  lbfgs_direction(double T, double kappa, int m)
+      : T(T)
+      , kappa(kappa)
+      , m(m)
+  {
+    if (m < 1) throw std::runtime_error("L-BFGS: history size must be positive");
+    if (m > max_pairs) {
+      throw std::runtime_error("L-BFGS: history size must not exceed " + std::to_string(max_pairs));
+    }
+  }
+
+  /// steepest descent, clears the history. returns tuple<slope, Z_x, Z_η>
+  template <class mem_t,
+            class x_t,
+            class e_t,
+            class f_t,
+            class hx_t,
+            class op_t,
+            class prec_t,
+            class F,
+            class ws_t>
+  std::tuple<double, mvector<to_layout_left_t<x_t>>, mvector<to_layout_left_t<x_t>>> restarted(
+      const mem_t& memspc,
+      const mvector<x_t>& X,
+      const mvector<e_t>& en,
+      const mvector<f_t>& fn,
+      const mvector<hx_t>& hx,
+      const mvector<double>& wk,
+      double mu,
+      op_t&& S,
+      prec_t&& P,
+      F&& free_energy,
+      descent_workspace<ws_t>& ws);
+
+  /**
+   * Quasi-Newton direction, t is the step length accepted along the previous direction and ul the
+   * corresponding subspace rotation. returns tuple<slope, Z_x, Z_η>
+   */
+  template <class mem_t,
+            class x_t,
+            class e_t,
+            class f_t,
+            class hx_t,
+            class ul_t,
+            class op_t,
+            class prec_t,
+            class F,
+            class ws_t>
+  std::tuple<double, mvector<to_layout_left_t<x_t>>, mvector<to_layout_left_t<x_t>>> update(
+      const mem_t& memspc,
+      double t,
+      const mvector<x_t>& X,
+      const mvector<e_t>& en,
+      const mvector<f_t>& fn,
+      const mvector<hx_t>& hx,
+      const mvector<ul_t>& ul,
+      const mvector<double>& wk,
+      double mu,
+      op_t&& S,
+      prec_t&& P,
+      F&& free_energy,
+      descent_workspace<ws_t>& ws);
+
+  int size() const { return num_pairs; }
+
+  /// change the temperature, the history is invalid afterwards (call restarted)
+  void set_temperature(double T) { this->T = T; }
+
+private:
+  /// (x, η) pair, the x-component is projected to the tangent space at X (overwritten)
+  template <class op_t, class vx_t, class veta_t, class x_t, class sx_t>
+  static tangent tangent_at(vx_t&& vx, veta_t&& veta, const x_t& x, const sx_t& sx)
+  {
+    return tangent{local::project_tangent<op_t>(vx, x, sx), veta};
+  }
+
+  static double dot(const tangent& a, const tangent& b)
+  {
+    return 2 * innerh_tr()(a.x, b.x).real() + innerh_tr()(a.eta, b.eta).real();
+  }
+
+private:
+  double T;
+  double kappa;
+  int m;
+  /// number of stored pairs, identical for all k-points
+  int num_pairs{0};
+  std::map<key_t, history> hist;
+};
+
+template <enum smearing_type SMEARING_TYPE, class matrix_t>
+template <class mem_t,
+          class x_t,
+          class e_t,
+          class f_t,
+          class hx_t,
+          class op_t,
+          class prec_t,
+          class F,
+          class ws_t>
+std::tuple<double, mvector<to_layout_left_t<x_t>>, mvector<to_layout_left_t<x_t>>>
+lbfgs_direction<SMEARING_TYPE, matrix_t>::restarted(const mem_t& memspc,
+                                                    const mvector<x_t>& X,
+                                                    const mvector<e_t>& en,
+                                                    const mvector<f_t>& fn,
+                                                    const mvector<hx_t>& hx,
+                                                    const mvector<double>& wk,
+                                                    double mu,
+                                                    op_t&& S,
+                                                    prec_t&& P,
+                                                    F&& free_energy,
+                                                    descent_workspace<ws_t>& ws)
+{
+  using op_type = std::decay_t<op_t>;
+  double mo = free_energy.occupancy();
+  double dFdmu = GradEtaHelper<SMEARING_TYPE>::dFdmu(free_energy.get_ek(), en, fn, wk, mu, T, mo);
+  double sumfn = GradEtaHelper<SMEARING_TYPE>::dmu_deta(en, wk, mu, T, mo);
+
+  auto commk = wk.commk();
+
+  descent_direction_impl<mem_t, SMEARING_TYPE, op_type> functor(
+      memspc, mu, dFdmu, sumfn, T, kappa, mo);
+
+  auto Xm = local::mirror_and_apply_batch(memspc, X, S, ws);
+  const auto& SXm = local::overlap_applied(Xm, S, ws);
+
+  hist.clear();
+  num_pairs = 0;
+
+  mvector<to_layout_left_t<x_t>> z_x(commk);
+  mvector<to_layout_left_t<x_t>> z_eta(commk);
+  double fr{0};
+  for (auto& elem : Xm) {
+    auto key = elem.first;
+    auto e = copies::create_mirror_view_and_copy("lbfgs", memspc, en.at(key));
+    auto f = copies::create_mirror_view_and_copy("lbfgs", memspc, fn.at(key));
+    auto h = create_mirror_view_and_copy(memspc, hx.at(key), "lbfgs");
+    auto p = P.at(key);
+    auto res = functor.exec_gradients(
+        elem.second, e, f, h, SXm.at(key), p, ws.psx.at(key), ws.phx.at(key), wk.at(key));
+
+    const auto& sx = SXm.at(key);
+    auto g = this->tangent_at<op_type>(std::get<3>(res), std::get<4>(res), elem.second, sx);
+    auto d = this->tangent_at<op_type>(std::get<1>(res), std::get<2>(res), elem.second, sx);
+    fr += dot(g, d);
+    auto& hk = hist[key];
+    hk.g = g;
+    hk.d = d;
+    // Z = Δ
+    hk.z = d;
+
+    z_x[key] = create_mirror_view_and_copy(Kokkos::HostSpace(), d.x, "lbfgs");
+    z_eta[key] = create_mirror_view_and_copy(Kokkos::HostSpace(), d.eta, "lbfgs");
+  }
+  fr = commk.allreduce(fr, mpi_op::sum);
+
+  return std::make_tuple(fr, z_x, z_eta);
+}
+
+template <enum smearing_type SMEARING_TYPE, class matrix_t>
+template <class mem_t,
+          class x_t,
+          class e_t,
+          class f_t,
+          class hx_t,
+          class ul_t,
+          class op_t,
+          class prec_t,
+          class F,
+          class ws_t>
+std::tuple<double, mvector<to_layout_left_t<x_t>>, mvector<to_layout_left_t<x_t>>>
+lbfgs_direction<SMEARING_TYPE, matrix_t>::update(const mem_t& memspc,
+                                                 double t,
+                                                 const mvector<x_t>& X,
+                                                 const mvector<e_t>& en,
+                                                 const mvector<f_t>& fn,
+                                                 const mvector<hx_t>& hx,
+                                                 const mvector<ul_t>& ul,
+                                                 const mvector<double>& wk,
+                                                 double mu,
+                                                 op_t&& S,
+                                                 prec_t&& P,
+                                                 F&& free_energy,
+                                                 descent_workspace<ws_t>& ws)
+{
+  using op_type = std::decay_t<op_t>;
+  double mo = free_energy.occupancy();
+  double dFdmu = GradEtaHelper<SMEARING_TYPE>::dFdmu(free_energy.get_ek(), en, fn, wk, mu, T, mo);
+  double sumfn = GradEtaHelper<SMEARING_TYPE>::dmu_deta(en, wk, mu, T, mo);
+
+  auto commk = wk.commk();
+
+  descent_direction_impl<mem_t, SMEARING_TYPE, op_type> functor(
+      memspc, mu, dFdmu, sumfn, T, kappa, mo);
+
+  auto Xm = local::mirror_and_apply_batch(memspc, X, S, ws);
+  const auto& SXm = local::overlap_applied(Xm, S, ws);
+
+  // the new pair is appended as index n, it is kept only if it passes the curvature check
+  const int n = num_pairs;
+  const int n1 = n + 1;
+
+  /* layout of the reduction buffer:
+   *   <g, Δ>, <s_i, g>, <y_i, Δ>, <g, py_i> for i <= n,
+   *   <s_i, y_j>, <y_i, py_j> for i, j <= n (row major) */
+  const int o_sg = 1;
+  const int o_yd = o_sg + n1;
+  const int o_gpy = o_yd + n1;
+  const int o_sy = o_gpy + n1;
+  const int o_ypy = o_sy + n1 * n1;
+  const int nip = o_ypy + n1 * n1;
+
+  mvector<key_t> keys(commk);
+  for (auto& elem : Xm) {
+    keys[elem.first] = elem.first;
+  }
+
+  auto kpoint = [&, t](key_t key,
+                       auto x,
+                       auto en_k,
+                       auto fn_k,
+                       auto hx_k,
+                       auto ul_k,
+                       auto sx,
+                       auto p,
+                       auto psx,
+                       auto phx,
+                       double wk_k) {
+    auto e = copies::create_mirror_view_and_copy("lbfgs", memspc, en_k);
+    auto f = copies::create_mirror_view_and_copy("lbfgs", memspc, fn_k);
+    auto h = create_mirror_view_and_copy(memspc, hx_k, "lbfgs");
+    auto u = create_mirror_view_and_copy(memspc, ul_k, "lbfgs");
+    auto res = functor.exec_gradients(x, e, f, h, sx, p, psx, phx, wk_k);
+
+    auto g = this->tangent_at<op_type>(std::get<3>(res), std::get<4>(res), x, sx);
+    auto d = this->tangent_at<op_type>(std::get<1>(res), std::get<2>(res), x, sx);
+
+    auto transport = [&](const tangent& v) {
+      auto vx = local::rotatex()(v.x, u);
+      return tangent{local::project_tangent<op_type>(vx, x, sx), local::rotateeta()(v.eta, u)};
+    };
+
+    auto& hk = hist.at(key);
+    for (int i = 0; i < n; ++i) {
+      hk.s[i] = transport(hk.s[i]);
+      hk.y[i] = transport(hk.y[i]);
+      hk.py[i] = transport(hk.py[i]);
+    }
+    // new pair, computed in-place on the transported previous quantities
+    // s = t Z(n-1)
+    auto s = transport(hk.z);
+    add(s.x, s.x, t, 0.0);
+    add(s.eta, s.eta, t, 0.0);
+    // y = g - g(n-1)
+    auto y = transport(hk.g);
+    add(y.x, g.x, 1.0, -1.0);
+    add(y.eta, g.eta, 1.0, -1.0);
+    // -H0 y = Δ - Δ(n-1)
+    auto py = transport(hk.d);
+    add(py.x, d.x, 1.0, -1.0);
+    add(py.eta, d.eta, 1.0, -1.0);
+    hk.s.push_back(s);
+    hk.y.push_back(y);
+    hk.py.push_back(py);
+    hk.g = g;
+    hk.d = d;
+
+    std::vector<double> ip(nip, 0);
+    ip[0] = dot(g, d);
+    for (int i = 0; i < n1; ++i) {
+      ip[o_sg + i] = dot(hk.s[i], g);
+      ip[o_yd + i] = dot(hk.y[i], d);
+      ip[o_gpy + i] = dot(g, hk.py[i]);
+      for (int j = 0; j < n1; ++j) {
+        ip[o_sy + i * n1 + j] = dot(hk.s[i], hk.y[j]);
+        ip[o_ypy + i * n1 + j] = dot(hk.y[i], hk.py[j]);
+      }
+    }
+    return ip;
+  };
+  auto ipk = eval_threaded(
+      tapply_async(kpoint, keys, Xm, en, fn, hx, ul, SXm, P, ws.psx, ws.phx, wk));
+
+  std::vector<double> ip(nip, 0);
+  for (auto& elem : ipk) {
+    for (int i = 0; i < nip; ++i) ip[i] += elem.second[i];
+  }
+  // single reduction for all inner products
+  commk.allreduce(ip.data(), ip.size(), mpi_op::sum);
+
+  auto sy = [&](int i, int j) { return ip[o_sy + i * n1 + j]; };
+  auto ypy = [&](int i, int j) { return ip[o_ypy + i * n1 + j]; };
+  double fr = ip[0];
+
+  // a pair violating the curvature condition is not stored, the oldest pair is dropped only when
+  // the new one is accepted
+  bool accept = sy(n, n) > 0;
+  if (!accept) {
+    Logger::GetInstance() << " L-BFGS: <s, y> <= 0, pair rejected\n";
+  }
+  bool drop_oldest = accept && n1 > m;
+  std::vector<int> used;
+  for (int i = drop_oldest ? 1 : 0; i < n; ++i) used.push_back(i);
+  if (accept) used.push_back(n);
+
+  // two-loop recursion on the coefficients of
+  //   q = g - Σ α_i y_i,  r = γ (-Δ + Σ α_i py_i) + Σ c_i s_i
+  std::vector<double> alpha(n1, 0);
+  std::vector<double> c(n1, 0);
+  for (auto it = used.rbegin(); it != used.rend(); ++it) {
+    int i = *it;
+    double sq = ip[o_sg + i];
+    for (int j : used) sq -= alpha[j] * sy(i, j);
+    alpha[i] = sq / sy(i, i);
+  }
+  double gamma{1};
+  if (!used.empty()) {
+    int k = used.back();
+    // <y, H0 y>
+    double yhy = -ypy(k, k);
+    if (yhy > 0) gamma = sy(k, k) / yhy;
+  }
+  for (int i : used) {
+    double yr = -gamma * ip[o_yd + i];
+    for (int j : used) yr += gamma * alpha[j] * ypy(i, j) + c[j] * sy(j, i);
+    double beta = yr / sy(i, i);
+    c[i] += alpha[i] - beta;
+  }
+  // Z = -r, slope = <g, Z>
+  double slope = gamma * fr;
+  for (int j : used) slope -= gamma * alpha[j] * ip[o_gpy + j] + c[j] * ip[o_sg + j];
+
+  bool reset = !(slope < 0);
+  if (reset) {
+    Logger::GetInstance() << " L-BFGS: no descent direction, history cleared\n";
+    gamma = 1;
+    slope = fr;
+    used.clear();
+  } else {
+    Logger::GetInstance() << " L-BFGS: " << used.size() << " pairs, gamma " << std::setprecision(3)
+                          << gamma << "\n";
+  }
+
+  // Z = γ Δ - Σ (γ α_j py_j + c_j s_j), single pass over the x and η components
+  std::vector<Kokkos::complex<double>> cz;
+  for (int j : used) {
+    cz.push_back(-gamma * alpha[j]);
+    cz.push_back(-c[j]);
+  }
+  mvector<to_layout_left_t<x_t>> z_x(commk);
+  mvector<to_layout_left_t<x_t>> z_eta(commk);
+  for (auto& elem : hist) {
+    auto key = elem.first;
+    auto& hk = elem.second;
+    std::vector<const matrix_t*> vx;
+    std::vector<const matrix_t*> veta;
+    for (int j : used) {
+      vx.push_back(&hk.py[j].x);
+      vx.push_back(&hk.s[j].x);
+      veta.push_back(&hk.py[j].eta);
+      veta.push_back(&hk.s[j].eta);
+    }
+    tangent z{empty_like()(hk.d.x), empty_like()(hk.d.eta)};
+    lincomb<2 * max_pairs>(z.x, hk.d.x, gamma, vx, cz);
+    lincomb<2 * max_pairs>(z.eta, hk.d.eta, gamma, veta, cz);
+    if (reset) {
+      hk.s.clear();
+      hk.y.clear();
+      hk.py.clear();
+    } else {
+      if (!accept) {
+        hk.s.pop_back();
+        hk.y.pop_back();
+        hk.py.pop_back();
+      }
+      if (drop_oldest) {
+        hk.s.pop_front();
+        hk.y.pop_front();
+        hk.py.pop_front();
+      }
+    }
+    hk.z = z;
+    z_x[key] = create_mirror_view_and_copy(Kokkos::HostSpace(), z.x, "lbfgs");
+    z_eta[key] = create_mirror_view_and_copy(Kokkos::HostSpace(), z.eta, "lbfgs");
+  }
+
+  num_pairs = used.size();
+
+  return std::make_tuple(slope, z_x, z_eta);
+}
+
+}  // namespace nlcglib
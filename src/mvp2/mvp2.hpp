@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Kokkos_Complex.hpp>
+#include <tuple>
 #include "la/lapack.hpp"
 #include "la/utils.hpp"
 #include "mpi/communicator.hpp"
@@ -9,6 +10,103 @@ namespace nlcglib {
 
 namespace local {
 
+namespace _detail {
+/// batched application, if supported by prec
+template <class prec_t, class a_t, class b_t>
+auto
+apply_batch(prec_t&& prec, a_t&& a, b_t&& b, int) -> decltype(prec.batch(a, b))
+{
+  return prec.batch(a, b);
+}
+
+template <class prec_t, class a_t, class b_t>
+auto
+apply_batch(prec_t&& prec, a_t&& a, b_t&& b, long)
+{
+  return std::make_tuple(prec(a), prec(b));
+}
+
+template <class prec_t, class y_t, class x_t>
+auto
+apply_into(prec_t&& prec, y_t&& y, x_t&& x, int) -> decltype(prec.apply_into(y, x))
+{
+  return prec.apply_into(y, x);
+}
+
+template <class prec_t, class y_t, class x_t>
+void
+apply_into(prec_t&& prec, y_t&& y, x_t&& x, long)
+{
+  deep_copy(y, prec(x), "mvp2");
+}
+
+/// y <- prec(a - b) in a single pass, if supported by prec
+template <class prec_t, class y_t, class a_t, class b_t>
+auto
+apply_residual_into(prec_t&& prec, y_t&& y, a_t&& a, b_t&& b, int)
+    -> decltype(prec.apply_residual_into(y, a, b))
+{
+  return prec.apply_residual_into(y, a, b);
+}
+
+template <class prec_t, class y_t, class a_t, class b_t>
+void
+apply_residual_into(prec_t&& prec, y_t&& y, a_t&& a, b_t&& b, long)
+{
+  // a <- a - b
+  add(a, b, -1.0, 1.0);
+  apply_into(prec, y, a, 0);
+}
+
+template <class prec_t, class ya_t, class yb_t, class a_t, class b_t>
+auto
+apply_batch_into(prec_t&& prec, ya_t&& ya, yb_t&& yb, a_t&& a, b_t&& b, int)
+    -> decltype(prec.batch_into(std::tie(ya, yb), a, b))
+{
+  return prec.batch_into(std::tie(ya, yb), a, b);
+}
+
+template <class prec_t, class ya_t, class yb_t, class a_t, class b_t>
+void
+apply_batch_into(prec_t&& prec, ya_t&& ya, yb_t&& yb, a_t&& a, b_t&& b, long)
+{
+  apply_into(prec, ya, a, 0);
+  apply_into(prec, yb, b, 0);
+}
+}  // namespace _detail
+
+/// returns tuple (prec(a), prec(b))
+template <class prec_t, class a_t, class b_t>
+auto
+apply_batch(prec_t&& prec, a_t&& a, b_t&& b)
+{
+  return _detail::apply_batch(prec, a, b, 0);
+}
+
+/// y <- prec(x), writes into the caller provided y
+template <class prec_t, class y_t, class x_t>
+void
+apply_into(prec_t&& prec, y_t&& y, x_t&& x)
+{
+  _detail::apply_into(prec, y, x, 0);
+}
+
+/// y <- prec(a - b), writes into the caller provided y, a may be overwritten
+template <class prec_t, class y_t, class a_t, class b_t>
+void
+apply_residual_into(prec_t&& prec, y_t&& y, a_t&& a, b_t&& b)
+{
+  _detail::apply_residual_into(prec, y, a, b, 0);
+}
+
+/// (ya, yb) <- (prec(a), prec(b)), writes into the caller provided ya, yb
+template <class prec_t, class ya_t, class yb_t, class a_t, class b_t>
+void
+apply_batch_into(prec_t&& prec, ya_t&& ya, yb_t&& yb, a_t&& a, b_t&& b)
+{
+  _detail::apply_batch_into(prec, ya, yb, a, b, 0);
+}
+
 struct lmult
 {
   template <class x_t, class sx_t, class hx_t, class prec_t>
@@ -20,15 +118,36 @@ struct lmult
     // TODO x is not used
     // Lagrange multipliers
     // compute ll = (xkx)^{-1} @ xKhx
-    auto xkx = inner_()(sx, prec(sx));
-    auto xkhx = inner_()(sx, prec(hx));
-    // auto khx = prec(hx);
+    auto psx_phx = apply_batch(prec, sx, hx);
+    auto xkx = inner_()(sx, std::get<0>(psx_phx));
+    auto xkhx = inner_()(sx, std::get<1>(psx_phx));
     solve_sym(xkx, xkhx);
     auto ll = xkhx;
     // X @ ll
     auto xll = transform_alloc(sx, ll);
     return xll;
   }
+
+  /**
+   * Uses the caller provided workspaces psx, phx for P·SX and P·HX.
+   * The returned X @ ll is stored in (and aliases) the leading columns of psx. hx may hold only
+   * the leading columns of HX, ll is then computed for those columns only.
+   */
+  template <class x_t, class sx_t, class hx_t, class prec_t, class psx_t, class phx_t>
+  std::remove_reference_t<psx_t> operator()(
+      x_t&& x, sx_t&& sx, hx_t&& hx, prec_t&& prec, psx_t&& psx, phx_t&& phx)
+  {
+    apply_batch_into(prec, psx, phx, sx, hx);
+    auto xkx = inner_()(sx, psx);
+    auto xkhx = inner_()(sx, phx);
+    solve_sym(xkx, xkhx);
+    auto ll = xkhx;
+    using numeric_t = typename std::remove_reference_t<psx_t>::numeric_t;
+    // X @ ll, P·SX is no longer needed
+    auto xll = leading_columns(psx, hx.map().ncols());
+    transform(xll, numeric_t{0.0}, numeric_t{1.0}, sx, ll);
+    return xll;
+  }
 };
 
 struct gradx
@@ -81,6 +200,22 @@ struct precondgx_us
   }
 };
 
+/** Same as precondgx_us, avoids the temporary, note that xll may be overwritten. In-library
+ *  preconditioners apply P (xll - hx) in a single pass. */
+struct precondgx_us_inplace
+{
+  template <class x_t, class hx_t, class prec_t, class ll_t>
+  to_layout_left_t<std::remove_reference_t<x_t>> operator()(x_t&& x,
+                                                            hx_t&& hx,
+                                                            prec_t&& prec,
+                                                            ll_t&& xll)
+  {
+    auto delta_x = empty_like()(x);
+    apply_residual_into(prec, delta_x, xll, hx);
+    return delta_x;
+  }
+};
+
 
 struct rotatex
 {
@@ -12,58 +12,101 @@
 #include "free_energy.hpp"
 #include "geodesic.hpp"
 #include "interface.hpp"
+#include "la/copy_counters.hpp"
 #include "la/dvector.hpp"
+#include "la/la_counters.hpp"
 #include "la/lapack.hpp"
 #include "la/layout.hpp"
 #include "la/magma.hpp"
 #include "la/map.hpp"
 #include "la/mvector.hpp"
+#include "la/thread_budget.hpp"
 #include "la/utils.hpp"
 #include "linesearch/linesearch.hpp"
 #include "mvp2/descent_direction.hpp"
+#include "mvp2/lbfgs.hpp"
 #include "overlap.hpp"
 #include "preconditioner.hpp"
 #include "pseudo_hamiltonian/grad_eta.hpp"
+#include "record_replay.hpp"
 #include "smearing.hpp"
 #include "traits.hpp"
 #include "ultrasoft_precond.hpp"
+#include "utils/convergence_monitor.hpp"
+#include "utils/env.hpp"
 #include "utils/format.hpp"
 #include "utils/logger.hpp"
+#include "utils/solver_stats.hpp"
 #include "utils/step_logger.hpp"
 #include "utils/timer.hpp"
+#include "utils/topology.hpp"
 
 typedef std::complex<double> complex_double;
 
 namespace nlcglib {
 
+/// Kokkos was initialized by nlcglib (and not by the host application)
+static bool owns_kokkos{false};
+
 void
 initialize()
 {
+  // the thread budget (NLCGLIB_NUM_THREADS) is shared between Kokkos and BLAS
+  int num_threads = ThreadBudget::GetInstance().total;
+  bool kokkos_running = Kokkos::is_initialized();
+
+  // initialize() may be called by a subset of the ranks: communicate (MPI_COMM_WORLD) only if
+  // pinning or the full report was requested, otherwise check the binding of this rank only
+  std::string pin = env::get_pin();
+  bool full_report = env::get_topology_report();
+  bool collective = full_report || pin != "none";
+  MPI_Comm local = collective ? topology::local_comm() : MPI_COMM_SELF;
+  // threads inherit the mask at creation, threads which already exist (a running Kokkos, an
+  // OpenMP pool started by the host application) keep their binding
+  std::vector<std::string> warnings;
+  if (kokkos_running && pin != "none") {
+    warnings.push_back("Kokkos already initialized, NLCGLIB_PIN=" + pin + " ignored");
+  } else if (!topology::pin(pin, local)) {
+    warnings.push_back("pinning policy NLCGLIB_PIN=" + pin + " not applied");
+  }
+  auto binding = topology::detect(local);
+  auto misbinding = topology::check(binding, num_threads, local);
+  warnings.insert(warnings.end(), misbinding.begin(), misbinding.end());
+  topology::report(binding, warnings, full_report, collective);
+  if (local != MPI_COMM_SELF) MPI_Comm_free(&local);
+
+#ifdef __NLCGLIB__MAGMA
+  nlcg_init_magma();
+#endif
+
+  // reuse the runtime of the host application
+  if (kokkos_running) return;
+
 #if KOKKOS_VERSION < 30700
   Kokkos::InitArguments args;
   args.disable_warnings = true;
-#ifdef USE_OPENMP
-  args.num_threads = omp_get_max_threads();
-#endif /* endif USE_OPENMP */
+#ifdef __USE_OPENMP
+  args.num_threads = num_threads;
+#endif /* endif __USE_OPENMP */
 #else  /* KOKKOS_VERSION >= 3.7.00 */
   Kokkos::InitializationSettings args;
   args.set_disable_warnings(true);
-#endif /* endif KOKKOS VERSION */
-#ifdef USE_OPENMP
-  args.num_threads = omp_get_max_threads();
-#endif
-
-#ifdef __NLCGLIB__MAGMA
-  nlcg_init_magma();
+#ifdef __USE_OPENMP
+  args.set_num_threads(num_threads);
 #endif
+#endif /* endif KOKKOS VERSION */
 
   Kokkos::initialize(args);
+  owns_kokkos = true;
 }
 
 void
 finalize()
 {
-  Kokkos::finalize();
+  if (owns_kokkos) {
+    Kokkos::finalize();
+    owns_kokkos = false;
+  }
 #ifdef __NLCGLIB__MAGMA
   nlcg_finalize_magma();
 #endif
@@ -123,7 +166,8 @@ cg_write_step_json(double free_energy,
     auto ek_host =
         eval_threaded(tapply(
                           [](auto&& x) {
-                            return Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), x);
+                            return copies::create_mirror_view_and_copy(
+                                "cg_write_step_json", Kokkos::HostSpace(), x);
                           },
                           ek))
             .allgather(commk);
@@ -131,7 +175,8 @@ cg_write_step_json(double free_energy,
     auto fn_host =
         eval_threaded(tapply(
                           [](auto&& x) {
-                            return Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), x);
+                            return copies::create_mirror_view_and_copy(
+                                "cg_write_step_json", Kokkos::HostSpace(), x);
                           },
                           fn))
             .allgather(commk);
@@ -191,6 +236,26 @@ check_overlap(EnergyBase& e, OverlapBase& Sb, OverlapBase& Sib)
 
   double diff = l2norm(error);
   std::cout << "** check: S(S_inv(x)), error: " << diff << "\n";
+
+  // in-library S = 1 + B Q B^H and its Woodbury inverse against the callbacks
+  if (Sb.get_projectors(memory_type::host) != nullptr) {
+    LowRankOverlap<memspace> S_lr(Sb);
+    auto Sinv_lr = S_lr.inverse();
+    auto deviation = [&](auto&& op, auto&& op_ref) {
+      auto err = tapply(
+          [](auto x, auto s, auto s_ref) {
+            auto z = s(x);
+            add(z, s_ref(x), -1, 1);
+            return z;
+          },
+          X,
+          op,
+          op_ref);
+      return l2norm(err);
+    };
+    std::cout << "** check: lowrank S, error: " << deviation(S_lr, S) << "\n";
+    std::cout << "** check: lowrank S_inv, error: " << deviation(Sinv_lr, Sinv) << "\n";
+  }
 }
 
 void
@@ -213,27 +278,35 @@ struct minus
 
 
 /// xspace -> memory space where nlcg is executed
-template <class xspace, enum smearing_type smearing_t>
+/// overlap_t -> Overlap (ultrasoft) or IdentityOverlap (norm-conserving, S = I)
+template <class xspace, enum smearing_type smearing_t, class overlap_t, class precond_t>
 nlcg_info
-nlcg_us(EnergyBase& energy_base,
-        UltrasoftPrecondBase& us_precond_base,
-        OverlapBase& overlap_base,
-        double T,
-        int maxiter,
-        double tol,
-        double kappa,
-        double tau,
-        int restart)
+nlcg(EnergyBase& energy_base,
+     const overlap_t& S,
+     const precond_t& P,
+     double T,
+     int maxiter,
+     double tol,
+     double kappa,
+     double tau,
+     int restart)
 {
   // std::feclearexcept(FE_ALL_EXCEPT);
   // feenableexcept(FE_ALL_EXCEPT & ~FE_INEXACT &
   //                ~FE_UNDERFLOW);  // Enable all floating point exceptions but FE_INEXACT
   nlcg_info info;
 
-  auto S = Overlap(overlap_base);
-  auto P = USPreconditioner(us_precond_base);
-
   Timer timer;
+  // event counters and phase times, reported in info.stats
+  auto& stats = SolverStats::GetInstance();
+  stats.reset();
+  // deep copies by call site (NLCGLIB_COPY_COUNTERS), per iteration and run totals
+  auto& copy_counters = CopyCounters::GetInstance();
+  copy_counters.reset();
+  Timer total_timer;
+  total_timer.start();
+  double time_linesearch{0};
+  double time_direction{0};
   FreeEnergy free_energy(T, energy_base, smearing_t);
   std::map<smearing_type, std::string> smear_name{
       {smearing_type::FERMI_DIRAC, "Fermi-Dirac"},
@@ -248,6 +321,20 @@ nlcg_us(EnergyBase& energy_base,
   logger.attach_file_master("nlcg.out");
   remove("nlcg.json");
 
+  // temperature continuation: converge loosely at T_cur > T, then lower T_cur geometrically
+  double T_cur = T;
+  double t_start = env::get_t_start();
+  double t_factor = env::get_t_factor();
+  if (t_start > T) {
+    if (!(t_factor > 0 && t_factor < 1)) {
+      throw std::runtime_error("invalid NLCGLIB_T_FACTOR, expected 0 < factor < 1");
+    }
+    T_cur = t_start;
+    free_energy.set_temperature(T_cur);
+  }
+  // tolerance of the intermediate temperatures
+  double stage_tol = 100 * tol;
+
   free_energy.compute();
 
   logger << "nlcglib parameters\n"
@@ -266,9 +353,28 @@ nlcg_us(EnergyBase& energy_base,
          << std::setw(10) << "restart"
          << ": " << restart << "\n";
 
+  cg_type cg = make_cg_type(env::get_cg_type());
+  std::string direction = env::get_direction();
+  if (direction != "cg" && direction != "lbfgs") {
+    throw std::runtime_error("invalid NLCGLIB_DIRECTION: " + direction + " (expected cg or lbfgs)");
+  }
+  bool use_lbfgs = direction == "lbfgs";
+  if (use_lbfgs) {
+    logger << "search direction: L-BFGS, m = " << env::get_lbfgs_m() << "\n";
+  } else {
+    logger << "CG type: " << cg_type_name(cg) << "\n";
+  }
+
   int Ne = energy_base.nelectrons();
   logger << "num electrons: " << Ne << "\n";
+  auto& budget = ThreadBudget::GetInstance();
+  logger << "threads: " << budget.total << ", per k-point task: " << budget.per_task()
+         << ", BLAS grain: " << budget.grain << "\n";
   logger << "tol = " << tol << "\n";
+  if (T_cur > T) {
+    logger << "temperature continuation: T = " << T_cur << " -> " << T << ", factor " << t_factor
+           << ", stage tol = " << stage_tol << "\n";
+  }
 
   auto ek = free_energy.get_ek();
   auto wk = free_energy.get_wk();
@@ -293,10 +399,47 @@ nlcg_us(EnergyBase& energy_base,
          << "\n";
 
   // auto HX_c = copy(Hx);
-  descent_direction<smearing_t> dd(T, kappa);
+  descent_direction<smearing_t> dd(T_cur, kappa, cg);
+  double band_locking = env::get_band_locking();
+  if (band_locking > 0) {
+    if (use_lbfgs) {
+      logger << "band locking is not supported by L-BFGS, ignored\n";
+    } else {
+      logger << "band locking: " << band_locking << " * tol\n";
+      int recheck = env::get_band_locking_recheck();
+      logger << "band locking: re-check every " << recheck << " iterations\n";
+      dd.set_band_locking(tol, band_locking, recheck);
+    }
+  }
+  double freeze_empty = env::get_freeze_empty();
+  if (freeze_empty > 0) {
+    if (use_lbfgs) {
+      logger << "freezing empty bands is not supported by L-BFGS, ignored\n";
+    } else {
+      logger << "frozen bands: above mu + " << freeze_empty << " * kT\n";
+      dd.set_freeze_empty(tol, freeze_empty);
+    }
+  }
+  bool adaptive_kappa = env::get_adaptive_kappa();
+  if (adaptive_kappa) {
+    if (use_lbfgs) {
+      logger << "adaptive kappa is not supported by L-BFGS, ignored\n";
+      adaptive_kappa = false;
+    } else {
+      logger << "adaptive kappa: on\n";
+    }
+  }
+  // exponential average of log(dd.kappa_factor())
+  double log_kappa_factor{0};
+  // buffers reused across iterations
+  using matrix_t = KokkosDVector<Kokkos::complex<double>**, SlabLayoutV, Kokkos::LayoutLeft, xspace>;
+  descent_workspace<matrix_t> ws;
+  lbfgs_direction<smearing_t, matrix_t> lbfgs(T_cur, kappa, use_lbfgs ? env::get_lbfgs_m() : 1);
 
   auto eta = eval_threaded(tapply(make_diag(), ek));
-  auto slope_zx_zeta = dd.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy);
+  auto slope_zx_zeta =
+      use_lbfgs ? lbfgs.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws)
+                : dd.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws);
   double slope = std::get<0>(slope_zx_zeta);
   auto z_x = std::get<1>(slope_zx_zeta);
   auto z_eta = std::get<2>(slope_zx_zeta);
@@ -306,9 +449,85 @@ nlcg_us(EnergyBase& energy_base,
   // CG related variables
   double fr = slope;  // Fletcher-Reeves numerator
   bool force_restart{false};
+  convergence_monitor monitor(tol);
+  bool stall_detection = env::get_stall_detection();
+  if (stall_detection) logger << "stall detection: on\n";
+
+  // flop/byte counters of the LA wrappers (NLCGLIB_LA_COUNTERS), per iteration and run totals
+  auto& la_counters = LaCounters::GetInstance();
+  la_counters.reset();
+  auto finish = [&](nlcg_info& out) -> nlcg_info& {
+    stats.fill(out.stats);
+    out.stats.time_linesearch = time_linesearch;
+    out.stats.time_direction = time_direction;
+    out.stats.time_total = total_timer.stop();
+    auto& st = out.stats;
+    logger << "statistics\n"
+           << "  evaluations: " << st.evaluations << ", line searches: " << st.qline
+           << " quadratic / " << st.btsearch << " backtracking, restarts: " << st.restarts << "\n"
+           << "  applications: overlap " << st.overlap_applications << ", preconditioner "
+           << st.precond_applications << "\n"
+           << "  bytes: copied " << st.bytes_copied << ", allreduce " << st.bytes_allreduced
+           << ", allgather " << st.bytes_allgathered << "\n"
+           << std::fixed << std::setprecision(3) << "  time [s]: line search " << st.time_linesearch
+           << ", direction " << st.time_direction << ", total " << st.time_total << "\n"
+           << "  time [s]: occupation search " << st.time_occupation << ", allgather "
+           << st.time_allgather << ", logging " << st.time_logging << ", small matrices "
+           << st.time_small_matrices << "\n";
+    logger.flush();
+    if (la_counters.enabled) {
+      logger << "LA counters (total)\n" << LaCounters::format(la_counters.total());
+      logger.flush();
+    }
+    if (copy_counters.enabled) {
+      logger << "copies (total)\n" << CopyCounters::format(copy_counters.total());
+      logger.flush();
+    }
+    return out;
+  };
+  // phase times (occupation search, allgather, logging, small matrices) are reported per
+  // iteration, in total and the part outside of the line search and the search direction
+  auto phase_last = stats.phase_seconds();
 
   for (int cg_iter = 0; cg_iter < maxiter; ++cg_iter) {
+    while (T_cur > T && std::abs(slope) < stage_tol) {
+      // lower the temperature, keep X and eta; the gradient changes with T, hence restart
+      T_cur = std::max(T, T_cur * t_factor);
+      logger << "i=" << cg_iter << ": F(T) = " << std::setprecision(13) << free_energy.get_F()
+             << " converged, continue with T = " << T_cur << "\n";
+      free_energy.set_temperature(T_cur);
+      smearing.set_temperature(T_cur);
+      dd.set_temperature(T_cur);
+      lbfgs.set_temperature(T_cur);
+
+      auto mu_fn = smearing.fn(ek);
+      mu = std::get<0>(mu_fn);
+      fn = std::get<1>(mu_fn);
+      free_energy.compute(X, fn, ek, mu);
+      Hx = copy(free_energy.get_HX());
+
+      SolverStats::add(stats.restarts, 1);
+      auto slope_zx_zeta =
+          use_lbfgs ? lbfgs.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws)
+                    : dd.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws);
+      slope = std::get<0>(slope_zx_zeta);
+      fr = slope;
+      z_x = std::get<1>(slope_zx_zeta);
+      z_eta = std::get<2>(slope_zx_zeta);
+      monitor.reset();
+    }
+    if (std::abs(slope) < tol && dd.partial()) {
+      // locked or frozen bands are not part of the slope, converged on the full residual only
+      logger << "i=" << cg_iter << ": converged on the active bands -> restart\n";
+      SolverStats::add(stats.restarts, 1);
+      auto slope_zx_zeta = dd.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws);
+      slope = std::get<0>(slope_zx_zeta);
+      fr = slope;
+      z_x = std::get<1>(slope_zx_zeta);
+      z_eta = std::get<2>(slope_zx_zeta);
+    }
     if (std::abs(slope) < tol) {
+      nlcglib::stats::phase_timer log_timer(stats.ns_logging);
       info = print_info(free_energy.get_F(),
                         free_energy.ks_energy(),
                         free_energy.get_entropy(),
@@ -338,50 +557,74 @@ nlcg_us(EnergyBase& energy_base,
       logger.flush();
 
       info.converged = true;
+      info.status = nlcg_status::converged;
+      info.iter_forecast = 0;
 
-      return info;
+      return finish(info);
     }
     try {
       // line search
 
+      // frozen bands are not updated
+      auto nx = dd.updated_columns(X);
       // TODO: capture variables explicitly here
-      auto g = [&](double t) {
-        auto ek_ul_xnext = geodesic(xspace(), X, eta, z_x, z_eta, S, t);
-        auto ek = std::get<0>(ek_ul_xnext);
-        auto Xn = std::get<2>(ek_ul_xnext);
-        auto mu_fn = smearing.fn(ek);
-        double mu = std::get<0>(mu_fn);
-
-        free_energy.compute(Xn, std::get<1>(mu_fn), ek, mu);
-
-        return std::tuple_cat(ek_ul_xnext, std::make_tuple(mu));
-      };
-
-      cg_write_step_json(free_energy.get_F(),
-                         free_energy.ks_energy(),
-                         free_energy.get_entropy(),
-                         slope,
-                         -1,
-                         free_energy.get_chemical_potential(),
-                         ek,
-                         fn,
-                         free_energy.ks_energy_components(),
-                         commk,
-                         cg_iter);
+      auto g = make_async_geodesic(
+          [&](double t) {
+            auto ek_ul_x = geodesic_prepare(xspace(), X, eta, z_x, z_eta, nx, t);
+            auto mu_fn = smearing.fn(std::get<0>(ek_ul_x));
+            return std::make_tuple(ek_ul_x, mu_fn);
+          },
+          [&](const auto& prepared, const eval_hints& hints) {
+            auto ek_ul_xnext = geodesic_finalize(std::get<0>(prepared), S, ws.sx);
+            auto ek = std::get<0>(ek_ul_xnext);
+            auto Xn = std::get<2>(ek_ul_xnext);
+            auto& mu_fn = std::get<1>(prepared);
+            double mu = std::get<0>(mu_fn);
+
+            free_energy.compute_async(Xn, std::get<1>(mu_fn), ek, mu, hints);
+
+            return std::tuple_cat(ek_ul_xnext, std::make_tuple(mu));
+          },
+          [&]() { free_energy.wait(); });
+
+      {
+        nlcglib::stats::phase_timer log_timer(stats.ns_logging);
+        cg_write_step_json(free_energy.get_F(),
+                           free_energy.ks_energy(),
+                           free_energy.get_entropy(),
+                           slope,
+                           -1,
+                           free_energy.get_chemical_potential(),
+                           ek,
+                           fn,
+                           free_energy.ks_energy_components(),
+                           commk,
+                           cg_iter);
+      }
 
       timer.start();
+      auto phase_ls = stats.phase_seconds();
+
+      {
+        nlcglib::stats::phase_timer log_timer(stats.ns_logging);
+        info = print_info(free_energy.get_F(),
+                          free_energy.ks_energy(),
+                          free_energy.get_entropy(),
+                          slope /* slope in X and eta, temporarily */,
+                          -1 /* need to separate the two slopes first */,
+                          free_energy.get_chemical_potential(),
+                          cg_iter);
+        free_energy.ehandle().print_info();  // print magnetization
+      }
 
-      info = print_info(free_energy.get_F(),
-                        free_energy.ks_energy(),
-                        free_energy.get_entropy(),
-                        slope /* slope in X and eta, temporarily */,
-                        -1 /* need to separate the two slopes first */,
-                        free_energy.get_chemical_potential(),
-                        cg_iter);
-      free_energy.ehandle().print_info();  // print magnetization
-
-      auto ek_ul_x_mu = ls(g, free_energy, slope, force_restart);
+      auto ek_ul_x_mu = [&]() {
+        la_phase phase("linesearch");
+        return ls(g, free_energy, slope, force_restart);
+      }();
       auto tlap = timer.stop();
+      auto phase_inside = stats.phase_seconds();
+      for (size_t i = 0; i < phase_inside.size(); ++i) phase_inside[i] -= phase_ls[i];
+      time_linesearch += tlap;
       logger << "line search took: " << tlap << " seconds\n";
 
       // update (X, fn(ek), ul, Hx) after line-search
@@ -389,28 +632,64 @@ nlcg_us(EnergyBase& energy_base,
       ul = std::get<1>(ek_ul_x_mu);
       X = std::get<2>(ek_ul_x_mu);
       double mu = std::get<3>(ek_ul_x_mu);
+      bool bt_search = std::get<4>(ek_ul_x_mu).type == "btsearch";
       eta = eval_threaded(tapply(make_diag(), ek));
       fn = free_energy.get_fn();
       Hx = copy(free_energy.get_HX());
 
-      if ((cg_iter % restart == 0) || force_restart) {
+      la_phase phase("direction");
+      auto phase_dir = stats.phase_seconds();
+      // periodic restarts would discard the L-BFGS history
+      if ((!use_lbfgs && cg_iter % restart == 0) || force_restart) {
         /* compute directions for steepest descent */
         timer.start();
+        SolverStats::add(stats.restarts, 1);
 
-        auto slope_zx_zeta = dd.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy);
+        auto slope_zx_zeta =
+            use_lbfgs ? lbfgs.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws)
+                      : dd.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws);
         slope = std::get<0>(slope_zx_zeta);  // no need to catch slope > 0 -> linesearch will throw
         fr = slope;
         z_x = std::get<1>(slope_zx_zeta);
         z_eta = std::get<2>(slope_zx_zeta);
 
         auto tlap = timer.stop();
+        time_direction += tlap;
         logger << "steepest descent took: " << tlap << " seconds\n";
+      } else if (use_lbfgs) {
+        /* compute L-BFGS direction */
+        timer.start();
+
+        auto slope_z_x_z_eta = lbfgs.update(
+            xspace(), ls.t_accepted, X, ek, fn, Hx, ul, wk, mu, S, P, free_energy, ws);
+        slope = std::get<0>(slope_z_x_z_eta);
+        z_x = std::get<1>(slope_z_x_z_eta);
+        z_eta = std::get<2>(slope_z_x_z_eta);
+
+        if (slope > 0) {
+          // steepest descent
+          logger << "i=" << cg_iter << ": slope > 0 detected -> restart\n";
+          SolverStats::add(stats.restarts, 1);
+          auto slope_zx_zeta =
+              lbfgs.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws);
+          // no need to catch slope > 0 again -> linesearch will throw
+          slope = std::get<0>(slope_zx_zeta);
+          fr = slope;
+          z_x = std::get<1>(slope_zx_zeta);
+          z_eta = std::get<2>(slope_zx_zeta);
+
+          force_restart = true;
+        }
+
+        auto tlap = timer.stop();
+        time_direction += tlap;
+        logger << "L-BFGS direction took: " << tlap << " seconds\n";
       } else {
         /* compute directions for cg */
         timer.start();
 
         auto fr_slope_z_x_z_eta =
-            dd.conjugated(xspace(), fr, X, ek, fn, Hx, z_x, z_eta, ul, wk, mu, S, P, free_energy);
+            dd.conjugated(xspace(), fr, X, ek, fn, Hx, z_x, z_eta, ul, wk, mu, S, P, free_energy, ws);
         fr = std::get<0>(fr_slope_z_x_z_eta);
         slope = std::get<1>(fr_slope_z_x_z_eta);
         z_x = std::get<2>(fr_slope_z_x_z_eta);
@@ -419,7 +698,8 @@ nlcg_us(EnergyBase& energy_base,
         if (slope > 0) {
           // force restart
           logger << "i=" << cg_iter << ": slope > 0 detected -> restart\n";
-          auto slope_zx_zeta = dd.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy);
+          SolverStats::add(stats.restarts, 1);
+          auto slope_zx_zeta = dd.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws);
           slope = std::get<0>(
               slope_zx_zeta);  // no need to catch slope > 0 again -> linesearch will throw
           fr = slope;
@@ -427,22 +707,186 @@ nlcg_us(EnergyBase& energy_base,
           z_eta = std::get<2>(slope_zx_zeta);
 
           force_restart = true;
+        } else if (adaptive_kappa) {
+          // rebalance the X and η steps once the (smoothed) estimate is off by more than a factor
+          // 2, a new kappa changes Δη hence restart
+          log_kappa_factor = 0.5 * log_kappa_factor + 0.5 * std::log(dd.kappa_factor());
+          double factor = std::exp(std::clamp(log_kappa_factor, -std::log(4.0), std::log(4.0)));
+          double kappa_new = std::clamp(dd.get_kappa() * factor, kappa / 100, kappa * 100);
+          if (std::abs(log_kappa_factor) > std::log(2.0) && kappa_new != dd.get_kappa()) {
+            log_kappa_factor = 0;
+            logger << "i=" << cg_iter << ": kappa " << std::scientific << std::setprecision(3)
+                   << dd.get_kappa() << " -> " << kappa_new << ", restart\n";
+            dd.set_kappa(kappa_new);
+            SolverStats::add(stats.restarts, 1);
+            auto slope_zx_zeta =
+                dd.restarted(xspace(), X, ek, fn, Hx, wk, mu, S, P, free_energy, ws);
+            slope = std::get<0>(slope_zx_zeta);
+            fr = slope;
+            z_x = std::get<1>(slope_zx_zeta);
+            z_eta = std::get<2>(slope_zx_zeta);
+          }
         }
 
         auto tlap = timer.stop();
+        time_direction += tlap;
         logger << "conjugated descent took: " << tlap << " seconds\n";
       }
+      auto phase_now = stats.phase_seconds();
+      for (size_t i = 0; i < phase_now.size(); ++i) {
+        double dt = phase_now[i] - phase_last[i];
+        double outside = dt - phase_inside[i] - (phase_now[i] - phase_dir[i]);
+        logger << SolverStats::phase_names[i] << " took: " << dt
+               << " seconds, outside line search / direction: " << outside << "\n";
+      }
+      phase_last = phase_now;
+
+      nlcglib::stats::phase_timer log_timer(stats.ns_logging);
+
+      // F and slope at the new point
+      monitor.push(free_energy.get_F(), slope, bt_search);
+      info.iter_forecast = monitor.forecast();
+      logger << "convergence rate: slope " << std::scientific << std::setprecision(3)
+             << monitor.slope_rate() << ", dF " << monitor.energy_rate()
+             << ", forecast: " << info.iter_forecast << " iterations\n";
+      auto verdict = stall_detection ? monitor.check(cg_iter + 1, maxiter)
+                                     : convergence_monitor::verdict::ok;
+      if (verdict != convergence_monitor::verdict::ok) {
+        logger << TO_STDOUT << "[NLCG] stopped at i=" << cg_iter << ": " << monitor.reason() << "\n";
+        logger.flush();
+        int iter_forecast = info.iter_forecast;
+        info = print_info(free_energy.get_F(),
+                          free_energy.ks_energy(),
+                          free_energy.get_entropy(),
+                          slope,
+                          -1,
+                          free_energy.get_chemical_potential(),
+                          cg_iter + 1);
+        info.iter_forecast = iter_forecast;
+        info.status = verdict == convergence_monitor::verdict::stagnated ? nlcg_status::stagnated
+                                                                         : nlcg_status::too_slow;
+        return finish(info);
+      }
+      if (la_counters.enabled) {
+        logger << "LA counters i=" << cg_iter << "\n"
+               << LaCounters::format(la_counters.next_iteration());
+      }
+      if (copy_counters.enabled) {
+        logger << "copies i=" << cg_iter << "\n"
+               << CopyCounters::format(copy_counters.next_iteration());
+      }
       logger.flush();
     } catch (DescentError&) {
       // CG failed abort
       logger << "[NLCG] Error: No descent direction found, nlcg didn't reach final tolerance\n";
-      return info;
+      info.status = nlcg_status::no_descent;
+      return finish(info);
     } catch (SlopeError&) {
       logger << "[NLCG] Error: slope > 0 after CG-restart. Abort.\n";
-      return info;
+      info.status = nlcg_status::no_descent;
+      return finish(info);
     }
   }
-  return info;
+  return finish(info);
+}
+
+template <class xspace, enum smearing_type smearing_t>
+nlcg_info
+nlcg_us(EnergyBase& energy_base,
+        UltrasoftPrecondBase& us_precond_base,
+        OverlapBase& overlap_base,
+        double T,
+        int maxiter,
+        double tol,
+        double kappa,
+        double tau,
+        int restart)
+{
+  // preconditioner: host callback or in-library (Teter diagonal, optional low-rank correction)
+  std::string us_precond = env::get_us_precond();
+  if (us_precond != "host" && us_precond != "teter" && us_precond != "teter_lowrank") {
+    throw std::runtime_error("invalid NLCGLIB_US_PRECOND: " + us_precond +
+                             " (expected host, teter or teter_lowrank)");
+  }
+  // overlap: host callback or in-library S = 1 + B Q B^H
+  std::string overlap_mode = env::get_overlap();
+  if (overlap_mode != "auto" && overlap_mode != "host" && overlap_mode != "lowrank") {
+    throw std::runtime_error("invalid NLCGLIB_OVERLAP: " + overlap_mode +
+                             " (expected auto, host or lowrank)");
+  }
+  bool lowrank_overlap =
+      overlap_mode == "lowrank" ||
+      (overlap_mode == "auto" && overlap_base.get_projectors(memory_type::host) != nullptr);
+
+  auto run = [&](EnergyBase& energy,
+                 OverlapBase& overlap,
+                 UltrasoftPrecondBase& precond,
+                 bool lowrank) {
+    auto solve = [&](const auto& S) {
+      if (us_precond == "teter") {
+        PreconditionerTeter<xspace> P(energy.get_gkvec_ekin());
+        return nlcg<xspace, smearing_t>(energy, S, P, T, maxiter, tol, kappa, tau, restart);
+      }
+      if (us_precond == "teter_lowrank") {
+        PreconditionerTeterLowRank<xspace> P(energy.get_gkvec_ekin(),
+                                             precond.get_projectors(memory_type::host),
+                                             precond.get_correction(memory_type::host));
+        return nlcg<xspace, smearing_t>(energy, S, P, T, maxiter, tol, kappa, tau, restart);
+      }
+      auto P = USPreconditioner(precond);
+      return nlcg<xspace, smearing_t>(energy, S, P, T, maxiter, tol, kappa, tau, restart);
+    };
+    if (lowrank) {
+      LowRankOverlap<xspace> S(overlap);
+      return solve(S);
+    }
+    return solve(Overlap(overlap));
+  };
+
+  auto prefix = env::get_record();
+  if (!prefix.empty()) {
+    record::parameters params{
+        0, static_cast<int32_t>(smearing_t), T, tol, kappa, tau, maxiter, restart};
+    RecordingEnergy energy(energy_base, prefix, params);
+    RecordingOp<OverlapBase> overlap(overlap_base, energy.writer(), record::op_id::overlap);
+    RecordingOp<UltrasoftPrecondBase> precond(
+        us_precond_base, energy.writer(), record::op_id::precond);
+    // B and C of teter_lowrank are not applied through callbacks, they are part of the recording
+    if (us_precond == "teter_lowrank") precond.record_factors();
+    // the recording is replayed through the OverlapBase callbacks, S stays on the host
+    auto info = run(energy, overlap, precond, false);
+    energy.write_result(info);
+    return info;
+  }
+
+  return run(energy_base, overlap_base, us_precond_base, lowrank_overlap);
+}
+
+/// norm-conserving pseudopotentials, S = I and Teter preconditioner
+template <class xspace, enum smearing_type smearing_t>
+nlcg_info
+nlcg_mvp2(EnergyBase& energy_base,
+          double T,
+          int maxiter,
+          double tol,
+          double kappa,
+          double tau,
+          int restart)
+{
+  IdentityOverlap S;
+  PreconditionerTeter<xspace> P(energy_base.get_gkvec_ekin());
+
+  auto prefix = env::get_record();
+  if (!prefix.empty()) {
+    record::parameters params{
+        1, static_cast<int32_t>(smearing_t), T, tol, kappa, tau, maxiter, restart};
+    RecordingEnergy energy(energy_base, prefix, params);
+    auto info = nlcg<xspace, smearing_t>(energy, S, P, T, maxiter, tol, kappa, tau, restart);
+    energy.write_result(info);
+    return info;
+  }
+
+  return nlcg<xspace, smearing_t>(energy_base, S, P, T, maxiter, tol, kappa, tau, restart);
 }
 
 
@@ -569,7 +1013,6 @@ nlcg_us_device(EnergyBase& energy_base,
 #endif
 }
 
-// norm conserving implementation is missing at the moment
 nlcg_info
 nlcg_mvp2_cpu(EnergyBase& energy_base,
               smearing_type smearing,
@@ -580,7 +1023,35 @@ nlcg_mvp2_cpu(EnergyBase& energy_base,
               int maxiter,
               int restart)
 {
-  throw std::runtime_error("temporarily unavailable!");
+  switch (smearing) {
+    case smearing_type::FERMI_DIRAC: {
+      auto info = nlcg_mvp2<Kokkos::HostSpace, smearing_type::FERMI_DIRAC>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::GAUSSIAN_SPLINE: {
+      auto info = nlcg_mvp2<Kokkos::HostSpace, smearing_type::GAUSSIAN_SPLINE>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::GAUSS: {
+      auto info = nlcg_mvp2<Kokkos::HostSpace, smearing_type::GAUSS>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::METHFESSEL_PAXTON: {
+      auto info = nlcg_mvp2<Kokkos::HostSpace, smearing_type::METHFESSEL_PAXTON>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::COLD: {
+      auto info = nlcg_mvp2<Kokkos::HostSpace, smearing_type::COLD>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    default:
+      throw std::runtime_error("invalid smearing type given");
+  }
 }
 
 nlcg_info
@@ -593,7 +1064,69 @@ nlcg_mvp2_device(EnergyBase& energy_base,
                  int maxiter,
                  int restart)
 {
-  throw std::runtime_error("temporarily unavailable!");
+#ifdef __NLCGLIB__CUDA
+  switch (smearing) {
+    case smearing_type::FERMI_DIRAC: {
+      auto info = nlcg_mvp2<Kokkos::CudaSpace, smearing_type::FERMI_DIRAC>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::GAUSSIAN_SPLINE: {
+      auto info = nlcg_mvp2<Kokkos::CudaSpace, smearing_type::GAUSSIAN_SPLINE>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::GAUSS: {
+      auto info = nlcg_mvp2<Kokkos::CudaSpace, smearing_type::GAUSS>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::METHFESSEL_PAXTON: {
+      auto info = nlcg_mvp2<Kokkos::CudaSpace, smearing_type::METHFESSEL_PAXTON>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::COLD: {
+      auto info = nlcg_mvp2<Kokkos::CudaSpace, smearing_type::COLD>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    default:
+      throw std::runtime_error("invalid smearing type given");
+  }
+#elif defined __NLCGLIB__ROCM
+  switch (smearing) {
+    case smearing_type::FERMI_DIRAC: {
+      auto info = nlcg_mvp2<Kokkos::Experimental::HIPSpace, smearing_type::FERMI_DIRAC>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::GAUSSIAN_SPLINE: {
+      auto info = nlcg_mvp2<Kokkos::Experimental::HIPSpace, smearing_type::GAUSSIAN_SPLINE>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::GAUSS: {
+      auto info = nlcg_mvp2<Kokkos::Experimental::HIPSpace, smearing_type::GAUSS>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::METHFESSEL_PAXTON: {
+      auto info = nlcg_mvp2<Kokkos::Experimental::HIPSpace, smearing_type::METHFESSEL_PAXTON>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    case smearing_type::COLD: {
+      auto info = nlcg_mvp2<Kokkos::Experimental::HIPSpace, smearing_type::COLD>(
+          energy_base, temp, maxiter, tol, kappa, tau, restart);
+      return info;
+    }
+    default:
+      throw std::runtime_error("invalid smearing type given");
+  }
+#else
+  throw std::runtime_error("recompile nlcglib with CUDA or ROCM.");
+#endif
 }
 
 nlcg_info
@@ -606,7 +1139,9 @@ nlcg_mvp2_cpu_device(EnergyBase& energy_base,
                      int maxiter,
                      int restart)
 {
-  throw std::runtime_error("temporarily unavailable!");
+  // this is now the same as `nlcg_mvp2_device`, since everything is copied to host before
+  // returning to nlcglib
+  return nlcg_mvp2_device(energy_base, smearing, temp, tol, kappa, tau, maxiter, restart);
 }
 
 nlcg_info
@@ -619,7 +1154,9 @@ nlcg_mvp2_device_cpu(EnergyBase& energy_base,
                      int maxiter,
                      int restart)
 {
-  throw std::runtime_error("temporarily unavailable!");
+  // this is now the same as `nlcg_mvp2_cpu`, since everything is copied to host before returning
+  // to nlcglib
+  return nlcg_mvp2_cpu(energy_base, smearing, temp, tol, kappa, tau, maxiter, restart);
 }
 
 
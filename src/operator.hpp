@@ -1,7 +1,10 @@
 #pragma once
 
+#include <tuple>
+#include <vector>
 #include "la/dvector.hpp"
 #include "la/mvector.hpp"
+#include "utils/solver_stats.hpp"
 
 namespace nlcglib {
 
@@ -68,16 +71,80 @@ public:
   auto operator()(X_t&& X) const
   {
     auto Y = empty_like()(X);
+    this->apply_into(Y, X);
+    return Y;
+  }
+
+  /// Y <- op(X), Y is provided by the caller
+  template <class Y_t, class X_t>
+  void apply_into(Y_t&& Y, X_t&& X) const
+  {
     auto vX = as_buffer_protocol(X);
     auto vY = as_buffer_protocol(Y);
     op.apply(key, vY, vX);
+    stats::count_op<T>();
+  }
+
+  /// apply to several operands of the same k-point in a single OpBase::apply_batch call
+  template <class... X_t>
+  auto batch(X_t&&... X) const
+  {
+    auto Y = std::make_tuple(empty_like()(X)...);
+    this->batch_into(Y, X...);
     return Y;
   }
 
+  /// as batch, but writes into the caller provided tuple Y
+  template <class... Y_t, class... X_t>
+  void batch_into(const std::tuple<Y_t...>& Y, X_t&&... X) const
+  {
+    static_assert(sizeof...(Y_t) == sizeof...(X_t), "number of inputs and outputs differ");
+    std::vector<OpBase::key_t> keys(sizeof...(X_t), key);
+    std::vector<MatrixBaseZ::buffer_t> vX{as_buffer_protocol(X)...};
+    auto vY = std::apply(
+        [](auto&... y) { return std::vector<MatrixBaseZ::buffer_t>{as_buffer_protocol(y)...}; },
+        Y);
+    op.apply_batch(keys, vY, vX);
+    stats::count_op<T>(keys.size());
+  }
+
 private:
   const T& op;
   std::pair<int, int> key;
 };
 
 
+/// apply op to all entries of an (evaluated) mvector in a single OpBase::apply_batch call,
+/// the result is written into the workspace ws, which is (re-)allocated only if needed
+template <class OP, class X, class R>
+mvector<R>&
+apply_op_batch(const OP& op, const mvector<X>& x, mvector<R>& ws)
+{
+  resize_like(ws, x);
+  std::vector<OpBase::key_t> keys;
+  std::vector<MatrixBaseZ::buffer_t> vin;
+  std::vector<MatrixBaseZ::buffer_t> vout;
+  for (auto& elem : x) {
+    auto key = elem.first;
+    keys.push_back(key);
+    vin.push_back(as_buffer_protocol(elem.second));
+    vout.push_back(as_buffer_protocol(ws.at(key)));
+  }
+  op.base().apply_batch(keys, vout, vin);
+  stats::count_op<std::decay_t<decltype(op.base())>>(keys.size());
+  return ws;
+}
+
+/// apply op to all entries of an (evaluated) mvector in a single OpBase::apply_batch call
+template <class OP, class X>
+auto
+apply_op_batch(const OP& op, const mvector<X>& x)
+{
+  using R = decltype(empty_like()(std::declval<X>()));
+  mvector<R> result(x.commk());
+  apply_op_batch(op, x, result);
+  return result;
+}
+
+
 }  // namespace nlcglib
@@ -1,11 +1,18 @@
 #pragma once
 
+#include <map>
 #include <memory>
+#include <type_traits>
+#include <vector>
 #include "interface.hpp"
+#include "la/cblas.hpp"
+#include "la/lapack.hpp"
+#include "la/lowrank.hpp"
 #include "la/mvector.hpp"
 #include "la/dvector.hpp"
 #include "operator.hpp"
 #include "mpi/communicator.hpp"
+#include "utils/solver_stats.hpp"
 
 
 namespace nlcglib {
@@ -36,6 +43,8 @@ public:
     throw std::runtime_error("not implemented");
   }
 
+  const OverlapBase& base() const { return overlap_base; }
+
 
 private:
   const OverlapBase& overlap_base;
@@ -47,4 +56,180 @@ Overlap::at(const key_t& key) const -> value_type
   return applicator<OverlapBase>(overlap_base, key);
 }
 
+/// y = x + B M B^H x for one k-point, M = Q (overlap) or the Woodbury matrix (inverse overlap)
+template <class SPACE>
+class lowrank_overlap
+{
+public:
+  using matrix_t = lowrank_matrix_t<SPACE>;
+  using numeric_t = Kokkos::complex<double>;
+
+public:
+  lowrank_overlap(const matrix_t& B, const matrix_t& M, std::shared_ptr<lowrank_workspace<SPACE>> ws)
+      : B(B)
+      , M(M)
+      , ws(ws)
+  {
+  }
+
+  template <class X_t>
+  auto operator()(X_t&& X) const
+  {
+    auto Y = empty_like()(X);
+    this->apply_into(Y, X);
+    return Y;
+  }
+
+  /// Y <- X + B M B^H X, Y is provided by the caller
+  template <class Y_t, class X_t>
+  void apply_into(Y_t&& Y, X_t&& X) const
+  {
+    auto [bx, mbx] = ws->get(B.map().comm(), B.map().ncols(), X.map().ncols());
+    inner(bx, B, X);
+    transform(mbx, numeric_t{0.0}, numeric_t{1.0}, M, bx);
+    // the identity is the initial value of the gemm (beta = 1): gemm has no separate input for
+    // C, X must be in Y before the call
+    copies::deep_copy("LowRankOverlap", Y.array(), X.array());
+    transform(Y, numeric_t{1.0}, numeric_t{1.0}, B, mbx);
+    stats::count_op<OverlapBase>();
+  }
+
+private:
+  matrix_t B;
+  matrix_t M;
+  std::shared_ptr<lowrank_workspace<SPACE>> ws;
+};
+
+/**
+ * Ultrasoft overlap S = 1 + B Q B^H applied inside nlcglib, from the projectors B and Q
+ * exported by OverlapBase::get_projectors / get_q. No callbacks into the host code.
+ *
+ * inverse(): S^-1 = 1 - B (1 + Q B^H B)^-1 Q B^H (Woodbury), the nproj x nproj matrices are
+ * set up once on the host (Q may be singular).
+ */
+template <class SPACE>
+class LowRankOverlap
+{
+public:
+  using value_type = lowrank_overlap<SPACE>;
+  using key_t = std::pair<int, int>;
+  using matrix_t = lowrank_matrix_t<SPACE>;
+
+public:
+  LowRankOverlap(const OverlapBase& overlap_base)
+  {
+    auto projectors = overlap_base.get_projectors(memory_type::host);
+    auto q = overlap_base.get_q(memory_type::host);
+    if (!projectors || !q) {
+      throw std::runtime_error("LowRankOverlap: OverlapBase doesn't provide get_projectors/get_q");
+    }
+    B = make_owned_mmatrix<SPACE>(projectors);
+    M = make_owned_mmatrix<SPACE>(q);
+    for (auto& elem : B) {
+      auto& key = elem.first;
+      if (M.data().count(key) == 0 || M.at(key).map().nrows() != elem.second.map().ncols()) {
+        throw std::runtime_error("LowRankOverlap: inconsistent projectors and Q");
+      }
+      keys.push_back(key);
+      workspaces[key] = std::make_shared<lowrank_workspace<SPACE>>();
+    }
+  }
+
+  auto at(const key_t& key) const { return value_type(B.at(key), M.at(key), workspaces.at(key)); }
+
+  auto begin() { return local::op_iterator<LowRankOverlap>(keys, *this, false); }
+  auto end() { return local::op_iterator<LowRankOverlap>(keys, *this, true); }
+  auto begin() const { return local::op_iterator<const LowRankOverlap>(keys, *this, false); }
+  auto end() const { return local::op_iterator<const LowRankOverlap>(keys, *this, true); }
+
+  const std::vector<key_t>& get_keys() const { return keys; }
+
+  /// S^-1, shares the projectors
+  LowRankOverlap inverse() const
+  {
+    LowRankOverlap inv(*this);
+    for (auto& elem : M) {
+      auto& key = elem.first;
+      inv.M[key] = woodbury(B.at(key), elem.second);
+      inv.workspaces[key] = std::make_shared<lowrank_workspace<SPACE>>();
+    }
+    return inv;
+  }
+
+private:
+  /// -(1 + Q B^H B)^-1 Q
+  static matrix_t woodbury(const matrix_t& B, const matrix_t& Q)
+  {
+    using numeric_t = Kokkos::complex<double>;
+    auto Bh = create_mirror_view_and_copy(Kokkos::HostSpace(), B, "LowRankOverlap");
+    auto Qh = create_mirror_view_and_copy(Kokkos::HostSpace(), Q, "LowRankOverlap");
+    int n = Qh.map().nrows();
+    auto G = empty_like()(Qh);
+    inner(G, Bh, Bh);
+    // A = 1 + Q G
+    auto A = zeros_like()(Qh);
+    for (int i = 0; i < n; ++i) A.array()(i, i) = 1;
+    transform(A, numeric_t{1.0}, numeric_t{1.0}, Qh, G);
+    // W = A^-1 Q
+    auto W = copy(Qh);
+    std::vector<int> ipiv(n);
+    int info = cblas::getrf<numeric_t>::call(
+        CblasColMajor, n, n, A.array().data(), A.array().stride(1), ipiv.data());
+    if (info == 0) {
+      info = cblas::getrs<numeric_t>::call(CblasColMajor,
+                                           'N',
+                                           n,
+                                           n,
+                                           A.array().data(),
+                                           A.array().stride(1),
+                                           ipiv.data(),
+                                           W.array().data(),
+                                           W.array().stride(1));
+    }
+    if (info != 0) {
+      throw std::runtime_error("LowRankOverlap: 1 + Q B^H B is singular");
+    }
+    for (int j = 0; j < n; ++j) {
+      for (int i = 0; i < n; ++i) W.array()(i, j) = -W.array()(i, j);
+    }
+    return create_mirror_view_and_copy(SPACE(), W, "LowRankOverlap");
+  }
+
+private:
+  mvector<matrix_t> B;
+  /// Q, or the Woodbury matrix for the inverse
+  mvector<matrix_t> M;
+  std::vector<key_t> keys;
+  std::map<key_t, std::shared_ptr<lowrank_workspace<SPACE>>> workspaces;
+};
+
+/// S X for all k-points of an (evaluated) mvector, the result is written into the workspace ws
+template <class SPACE, class X, class R>
+mvector<R>&
+apply_op_batch(const LowRankOverlap<SPACE>& op, const mvector<X>& x, mvector<R>& ws)
+{
+  resize_like(ws, x);
+  for (auto& elem : x) {
+    auto key = elem.first;
+    op.at(key).apply_into(ws.at(key), elem.second);
+  }
+  return ws;
+}
+
+/// Overlap for norm-conserving pseudopotentials, S = I. Selects the S-free code paths at compile
+/// time, it is never applied.
+struct IdentityOverlap
+{
+};
+
+template <class T>
+struct is_identity_overlap : std::false_type
+{
+};
+
+template <>
+struct is_identity_overlap<IdentityOverlap> : std::true_type
+{
+};
+
 }  // namespace nlcglib
@@ -1,11 +1,15 @@
 #pragma once
 
 #include <Kokkos_Core.hpp>
+#include <map>
+#include <memory>
 
 #include "la/dvector.hpp"
 #include "la/mvector.hpp"
 #include "la/lapack.hpp"
+#include "la/lowrank.hpp"
 #include "exec_space.hpp"
+#include "utils/solver_stats.hpp"
 
 namespace nlcglib {
 
@@ -28,16 +32,15 @@ public:
                     const M2& src,
                     const Kokkos::View<double*, KOKKOS_ARGS3...>& entries)
   {
-    typedef Kokkos::MDRangePolicy<Kokkos::Rank<2>, exec_t<SPACE>> mdrange_policy;
     int m = dst.array().extent(0);
     int n = dst.array().extent(1);
     auto mdst = dst.array();
     auto msrc = src.array();
 
-    Kokkos::parallel_for(
-        "teter preconditioner", mdrange_policy({{0, 0}}, {{m, n}}), KOKKOS_LAMBDA(int i, int j) {
-          mdst(i, j) = entries(i) * msrc(i, j);
-        });
+    SolverStats::add(SolverStats::GetInstance().precond_applications, 1);
+    parallel_for_columns<SPACE>("teter preconditioner", m, n, KOKKOS_LAMBDA(int i, int j) {
+      mdst(i, j) = entries(i) * msrc(i, j);
+    });
   }
 
   template<typename X>
@@ -54,8 +57,153 @@ public:
     diagonal_preconditioner::apply(x, x, entries);
   }
 
+  /// y <- P x, y is provided by the caller
+  template<typename Y, typename X>
+  void apply_into(Y& y, const X& x)
+  {
+    diagonal_preconditioner::apply(y, x, entries);
+  }
+
+  /// y <- P (a - b), fused with the residual
+  template <typename Y, typename A, typename B>
+  void apply_residual_into(Y& y, const A& a, const B& b)
+  {
+    int m = y.array().extent(0);
+    int n = y.array().extent(1);
+    auto my = y.array();
+    auto ma = a.array();
+    auto mb = b.array();
+    auto d = entries;
+
+    SolverStats::add(SolverStats::GetInstance().precond_applications, 1);
+    parallel_for_columns<SPACE>(
+        "teter preconditioner residual", m, n, KOKKOS_LAMBDA(int i, int j) {
+          my(i, j) = d(i) * (ma(i, j) - mb(i, j));
+        });
+  }
+
+private:
+  view_t<SPACE> entries;
+};
+
+
+/**
+ * Diagonal preconditioner with a low-rank ultrasoft correction, P = K + K B C B^H K.
+ *
+ * K: Teter diagonal, KB = K B: scaled projectors (npw x nproj), C: Hermitian (nproj x nproj),
+ * P is Hermitian.
+ */
+template <class SPACE>
+class lowrank_preconditioner
+{
+public:
+  using matrix_t = lowrank_matrix_t<SPACE>;
+  using numeric_t = Kokkos::complex<double>;
+  using workspace = lowrank_workspace<SPACE>;
+
+public:
+  lowrank_preconditioner(const view_t<SPACE>& entries,
+                         const matrix_t& KB,
+                         const matrix_t& C,
+                         std::shared_ptr<workspace> ws)
+      : entries(entries)
+      , KB(KB)
+      , C(C)
+      , ws(ws)
+  {
+  }
+
+  template <typename X>
+  auto operator()(const X& x)
+  {
+    auto y = empty_like()(x);
+    this->apply_into(y, x);
+    return y;
+  }
+
+  /// y <- P x, y is provided by the caller
+  template <typename Y, typename X>
+  void apply_into(Y& y, const X& x)
+  {
+    auto [bx, cbx] = ws->get(KB.map().comm(), KB.map().ncols(), x.map().ncols());
+    inner(bx, KB, x);
+    this->correction_into(y, bx, cbx);
+    fuse(y, x);
+  }
+
+  /// y <- P (a - b), r = a - b is formed in y, y <- K r + KB C KB^H r (single product with KB^H)
+  template <typename Y, typename A, typename Bv>
+  void apply_residual_into(Y& y, const A& a, const Bv& b)
+  {
+    auto [bx, cbx] = ws->get(KB.map().comm(), KB.map().ncols(), a.map().ncols());
+    residual(y, a, b);
+    inner(bx, KB, y);
+    transform(cbx, numeric_t{0.0}, numeric_t{1.0}, C, bx);
+    scale_diagonal(y);
+    transform(y, numeric_t{1.0}, numeric_t{1.0}, KB, cbx);
+  }
+
+private:
+  /// y <- KB C bx
+  template <typename Y>
+  void correction_into(Y& y, const matrix_t& bx, matrix_t& cbx)
+  {
+    transform(cbx, numeric_t{0.0}, numeric_t{1.0}, C, bx);
+    transform(y, numeric_t{0.0}, numeric_t{1.0}, KB, cbx);
+  }
+
+  /// y <- K x + y
+  template <typename Y, typename X>
+  void fuse(Y& y, const X& x)
+  {
+    int m = y.array().extent(0);
+    int n = y.array().extent(1);
+    auto my = y.array();
+    auto mx = x.array();
+    auto d = entries;
+
+    SolverStats::add(SolverStats::GetInstance().precond_applications, 1);
+    parallel_for_columns<SPACE>(
+        "teter lowrank preconditioner", m, n, KOKKOS_LAMBDA(int i, int j) {
+          my(i, j) = d(i) * mx(i, j) + my(i, j);
+        });
+  }
+
+  /// y <- a - b
+  template <typename Y, typename A, typename Bv>
+  static void residual(Y& y, const A& a, const Bv& b)
+  {
+    int m = y.array().extent(0);
+    int n = y.array().extent(1);
+    auto my = y.array();
+    auto ma = a.array();
+    auto mb = b.array();
+    parallel_for_columns<SPACE>("teter lowrank residual", m, n, KOKKOS_LAMBDA(int i, int j) {
+      my(i, j) = ma(i, j) - mb(i, j);
+    });
+  }
+
+  /// y <- K y
+  template <typename Y>
+  void scale_diagonal(Y& y)
+  {
+    int m = y.array().extent(0);
+    int n = y.array().extent(1);
+    auto my = y.array();
+    auto d = entries;
+
+    SolverStats::add(SolverStats::GetInstance().precond_applications, 1);
+    parallel_for_columns<SPACE>(
+        "teter lowrank preconditioner", m, n, KOKKOS_LAMBDA(int i, int j) {
+          my(i, j) = d(i) * my(i, j);
+        });
+  }
+
 private:
   view_t<SPACE> entries;
+  matrix_t KB;
+  matrix_t C;
+  std::shared_ptr<workspace> ws;
 };
 
 /**
@@ -72,7 +220,14 @@ public:
   using value_type = diagonal_preconditioner<SPACE>;
 public:
   PreconditionerTeter(std::shared_ptr<VectorBaseZ> ekin)
+      : kinetic_diag_precond(teter_diagonal(ekin))
   {
+  }
+
+  /// Teter diagonal on memspace from the kinetic energies of the plane-waves
+  static mvector<view_t<memspace>> teter_diagonal(std::shared_ptr<VectorBaseZ> ekin)
+  {
+    mvector<view_t<memspace>> diag;
     auto ekin_vector = make_mmvector<Kokkos::HostSpace>(ekin);
     for (auto& elem : ekin_vector) {
       auto& key = elem.first;
@@ -88,9 +243,10 @@ public:
         result(i) = 1 / (1 + tp);
       });
       // store result in mvector
-      kinetic_diag_precond[key] = Kokkos::create_mirror(memspace(), result);
-      Kokkos::deep_copy(kinetic_diag_precond.at(key), result);
+      diag[key] = Kokkos::create_mirror(memspace(), result);
+      copies::deep_copy("preconditioner", diag.at(key), result);
     }
+    return diag;
   }
 
 
@@ -111,4 +267,75 @@ private:
 };
 
 
+/**
+ * Teter preconditioner with the low-rank ultrasoft correction exported by the host code,
+ * P = K + K B C B^H K, see UltrasoftPrecondBase::get_projectors / get_correction.
+ */
+template <class SPACE>
+class PreconditionerTeterLowRank
+{
+public:
+  using memspace = SPACE;
+  using value_type = lowrank_preconditioner<SPACE>;
+  using matrix_t = typename value_type::matrix_t;
+
+public:
+  PreconditionerTeterLowRank(std::shared_ptr<VectorBaseZ> ekin,
+                             std::shared_ptr<MatrixBaseZ> projectors,
+                             std::shared_ptr<MatrixBaseZ> correction)
+      : kinetic_diag_precond(PreconditionerTeter<SPACE>::teter_diagonal(ekin))
+  {
+    if (!projectors || !correction) {
+      throw std::runtime_error(
+          "teter_lowrank preconditioner: UltrasoftPrecondBase doesn't provide "
+          "get_projectors/get_correction");
+    }
+    KB = make_owned_mmatrix<memspace>(projectors);
+    C = make_owned_mmatrix<memspace>(correction);
+    for (auto& elem : KB) {
+      auto& key = elem.first;
+      if (C.data().count(key) == 0) {
+        throw std::runtime_error("teter_lowrank preconditioner: correction missing for k-point");
+      }
+      if (elem.second.map().nrows() != int(kinetic_diag_precond.at(key).size()) ||
+          elem.second.map().ncols() != C.at(key).map().nrows()) {
+        throw std::runtime_error("teter_lowrank preconditioner: inconsistent dimensions");
+      }
+      // KB <- K B, once
+      scale_rows(elem.second, kinetic_diag_precond.at(key));
+      workspaces[key] = std::make_shared<lowrank_workspace<memspace>>();
+    }
+  }
+
+  template <class key_t>
+  auto operator[](const key_t& key) const
+  {
+    return value_type(kinetic_diag_precond.at(key), KB.at(key), C.at(key), workspaces.at(key));
+  }
+
+  template <class key_t>
+  auto at(const key_t& key) const
+  {
+    return this->operator[](key);
+  }
+
+private:
+  static void scale_rows(matrix_t& b, const view_t<memspace>& d)
+  {
+    auto mb = b.array();
+    int m = mb.extent(0);
+    int n = mb.extent(1);
+    parallel_for_columns<memspace>("teter lowrank scale", m, n, KOKKOS_LAMBDA(int i, int j) {
+      mb(i, j) = d(i) * mb(i, j);
+    });
+  }
+
+private:
+  mvector<view_t<memspace>> kinetic_diag_precond;
+  mvector<matrix_t> KB;
+  mvector<matrix_t> C;
+  std::map<std::pair<int, int>, std::shared_ptr<lowrank_workspace<memspace>>> workspaces;
+};
+
+
 }  // namespace nlcglib
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <Kokkos_Core.hpp>
+#include <cmath>
+#include <type_traits>
 #include "constants.hpp"
 #include "exec_space.hpp"
 #include "la/mvector.hpp"
 #include "smearing.hpp"
+#include "utils/solver_stats.hpp"
 
 namespace nlcglib {
 
@@ -81,16 +84,44 @@ struct GradEtaHelper
   }
 };
 
+/**
+ * Partition of the bands into {occupied, fractional, empty} blocks, the leading nocc bands are
+ * fully occupied and the trailing nempty bands are empty. The off-diagonal entries of the
+ * occupied-occupied and empty-empty blocks of the η-gradient vanish ((fn(j) - fn(i)) = 0).
+ * nocc = nempty = 0 is the dense case.
+ */
+struct eta_partition
+{
+  int nocc{0};
+  int nempty{0};
+};
+
+/// partition from the occupation numbers, bands are expected to be sorted by energy
+template <class fn_t>
+eta_partition
+make_eta_partition(const fn_t& fn, double mo, double tol = 1e-12)
+{
+  auto fn_h = copies::create_mirror_view_and_copy("grad_eta", Kokkos::HostSpace(), fn);
+  int n = fn_h.size();
+  eta_partition part;
+  while (part.nocc < n && std::abs(fn_h(part.nocc) - mo) < tol * mo) ++part.nocc;
+  while (part.nempty < n - part.nocc && std::abs(fn_h(n - 1 - part.nempty)) < tol * mo)
+    ++part.nempty;
+  return part;
+}
+
 struct _delta_eta
 {
   _delta_eta(double kappa)
       : kappa(kappa)
   {
   }
+  /// off-diagonal entries of the occupied-occupied and empty-empty blocks (part) are zero
   template <class hij_t, class ek_t, class wk_t>
   to_layout_left_t<std::remove_reference_t<hij_t>> operator()(const hij_t& hij,
                                                               const ek_t& ek,
-                                                              const wk_t& wk) const
+                                                              const wk_t& wk,
+                                                              eta_partition part = {}) const
   {
     using Kokkos::RangePolicy;
     using Kokkos::Rank;
@@ -109,6 +140,19 @@ struct _delta_eta
         RangePolicy<exec_t<memspc>>(0, n),
         KOKKOS_LAMBDA(int i) { d_eta_array(i, i) = d_eta_array(i, i) - local_kappa * ek(i); });
 
+    if (part.nocc > 1 || part.nempty > 1) {
+      int nocc = part.nocc;
+      int e0 = n - part.nempty;
+      Kokkos::parallel_for(
+          "delta_eta blocks",
+          Kokkos::MDRangePolicy<Rank<2>, exec_t<memspc>>({{0, 0}}, {{n, n}}),
+          KOKKOS_LAMBDA(int i, int j) {
+            if (i != j && ((i < nocc && j < nocc) || (i >= e0 && j >= e0))) {
+              d_eta_array(i, j) = 0;
+            }
+          });
+    }
+
     return d_eta;
   }
 
@@ -127,7 +171,8 @@ public:
   }
 
   /**
-   * Gradient of η
+   * Gradient of η, the off-diagonal entries of the occupied-occupied and empty-empty blocks given
+   * by part are not evaluated (they are zero).
    */
   template <class matrix_t, class array1_t, class array2_t>
   to_layout_left_t<matrix_t> g_eta(const matrix_t& Hij,
@@ -137,8 +182,10 @@ public:
                                    const array2_t& fn,
                                    double dmu_deta,
                                    double dFdmu,
-                                   double mo)
+                                   double mo,
+                                   eta_partition part = {})
   {
+    stats::phase_timer timer(SolverStats::GetInstance().ns_small_matrices);
     // TODO: add static assert Hij, ek, fn must all have the same memory space
     auto gETA = zeros_like()(Hij);
 
@@ -166,23 +213,45 @@ public:
           });
     }
 
-    Kokkos::parallel_for(
-        "gEta(3)",
-        Kokkos::MDRangePolicy<Kokkos::Rank<2>, exec_space>({{0, 0}}, {{nbands, nbands}}),
-        KOKKOS_LAMBDA(int i, int j) {
-          if (i == j) {
-            // do nothing
-          } else {
+    // the off-diagonal entries of the diagonal blocks of fully occupied and empty bands are
+    // skipped
+    int nocc = part.nocc;
+    int e0 = nbands - part.nempty;
+    if constexpr (std::is_same<SPACE, Kokkos::HostSpace>::value) {
+      // by columns on the host: column j couples to the rows [i0, i1) (same blocks), which are
+      // contiguous in memory. The diagonal and degenerate pairs get a zero factor instead of a
+      // branch, such that the loop vectorizes.
+      Kokkos::parallel_for(
+          "gEta(3)", Kokkos::RangePolicy<exec_space>(0, nbands), KOKKOS_LAMBDA(int j) {
+            int i0 = j < nocc ? nocc : 0;
+            int i1 = j >= e0 ? e0 : nbands;
             double ej = ek(j);
-            double ei = ek(i);
-            if (std::abs(ej - ei) < 1e-10) {
-              // zero contribution
-            } else {
-              double II = (fn(j) - fn(i)) / (ej - ei);
+            double fj = fn(j);
+            for (int i = i0; i < i1; ++i) {
+              double de = ej - ek(i);
+              double II = std::abs(de) < 1e-10 ? 0 : (fj - fn(i)) / de;
               mgETA(i, j) += II * mHij(i, j);
             }
-          }
-        });
+          });
+    } else {
+      // one thread per entry on the device, the skipped blocks are a predicate
+      Kokkos::parallel_for(
+          "gEta(3)",
+          Kokkos::MDRangePolicy<Kokkos::Rank<2>, exec_space>({{0, 0}}, {{nbands, nbands}}),
+          KOKKOS_LAMBDA(int i, int j) {
+            bool skip = i == j || (i < nocc && j < nocc) || (i >= e0 && j >= e0);
+            if (!skip) {
+              double ej = ek(j);
+              double ei = ek(i);
+              if (std::abs(ej - ei) < 1e-10) {
+                // zero contribution
+              } else {
+                double II = (fn(j) - fn(i)) / (ej - ei);
+                mgETA(i, j) += II * mHij(i, j);
+              }
+            }
+          });
+    }
     return gETA;
   }
 
@@ -0,0 +1,908 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+#include <mpi.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "interface.hpp"
+
+namespace nlcglib {
+
+/**
+ * Record / replay of the interaction between nlcglib and the electronic structure code.
+ *
+ * RecordingEnergy and RecordingOp decorate the EnergyBase / OpBase objects of a real run
+ * (enabled with NLCGLIB_RECORD=<prefix>) and write every buffer nlcglib receives to
+ * <prefix>.<rank>.nlcgrec: the initial state (C, HX, SX, fn, ek, kinetic energy, k-point
+ * weights, energies), the low-rank factors of the preconditioner (NLCGLIB_US_PRECOND=
+ * teter_lowrank), the result of every evaluation and the output of every overlap /
+ * preconditioner application. ReplayEnergy and ReplayOp serve these responses back in the same
+ * order, the solver can then be run without the electronic structure code (see
+ * test/test_replay.cpp) with the same number of MPI ranks and the same NLCGLIB_* settings.
+ *
+ * The wave-functions nlcglib passes to the evaluations are recorded as well, replay compares
+ * them with its own and reports the largest deviation. Replay buffers live in host memory, use
+ * the *_cpu entry points for replay.
+ *
+ * File format (native endianness, sizes as int64): a sequence of records, each starting with a
+ * uint32 tag, see record::tag.
+ */
+namespace record {
+
+constexpr uint64_t magic = 0x31434552474c434eull;  // "NLCGREC1"
+
+enum class tag : uint32_t
+{
+  /// solver parameters, k-points and communicators
+  header = 1,
+  /// initial state: C, HX, SX, fn, ek, ekin, wk, energies
+  state = 2,
+  /// evaluation: hints, C (input), HX, SX, ek, energies
+  compute = 3,
+  /// operator application: op id, key, output
+  apply = 4,
+  /// nlcg_info of the recorded run
+  result = 5,
+  /// low-rank factors of the preconditioner, per k-point: nproj, B, C (optional, after state)
+  factors = 6
+};
+
+/// operator ids in apply records
+enum class op_id : int32_t
+{
+  overlap = 0,
+  precond = 1
+};
+
+/// solver parameters stored in the header
+struct parameters
+{
+  /// 0: nlcg_us, 1: nlcg_mvp2
+  int32_t solver{0};
+  int32_t smearing{0};
+  double T{0};
+  double tol{0};
+  double kappa{0};
+  double tau{0};
+  int32_t maxiter{0};
+  int32_t restart{0};
+};
+
+/// host copy of a buffer, packed column-major
+template <class T, int d>
+std::vector<T>
+to_host(const buffer_protocol<T, d>& buf)
+{
+  int rows = buf.size[0];
+  int cols = d == 2 ? buf.size[1] : 1;
+  int s0 = buf.stride[0];
+  int s1 = d == 2 ? buf.stride[1] : 0;
+  std::vector<T> packed(static_cast<size_t>(rows) * cols);
+  if (packed.empty()) return packed;
+
+  const T* src = buf.data;
+  std::vector<T> staging;
+  if (buf.memtype == memory_type::device) {
+#if defined(__NLCGLIB__CUDA) || defined(__NLCGLIB__ROCM)
+#ifdef __NLCGLIB__CUDA
+    using device_space = Kokkos::CudaSpace;
+#else
+    using device_space = Kokkos::Experimental::HIPSpace;
+#endif
+    // copy the whole strided range in one transfer
+    size_t span = static_cast<size_t>(rows - 1) * s0 + static_cast<size_t>(cols - 1) * s1 + 1;
+    staging.resize(span);
+    size_t n = span * sizeof(T) / sizeof(double);
+    Kokkos::View<double*, Kokkos::HostSpace, Kokkos::MemoryUnmanaged> dst(
+        reinterpret_cast<double*>(staging.data()), n);
+    Kokkos::View<const double*, device_space, Kokkos::MemoryUnmanaged> dev(
+        reinterpret_cast<const double*>(buf.data), n);
+    Kokkos::deep_copy(dst, dev);
+    src = staging.data();
+#else
+    throw std::runtime_error("record: device buffer, recompile nlcglib with CUDA or ROCM");
+#endif
+  }
+  for (int j = 0; j < cols; ++j) {
+    for (int i = 0; i < rows; ++i) {
+      packed[i + static_cast<size_t>(rows) * j] = src[i * s0 + j * s1];
+    }
+  }
+  return packed;
+}
+
+/// write packed data into a host buffer
+template <class T, int d>
+void
+from_host(buffer_protocol<T, d>& buf, const std::vector<T>& packed)
+{
+  int rows = buf.size[0];
+  int cols = d == 2 ? buf.size[1] : 1;
+  if (packed.size() != static_cast<size_t>(rows) * cols) {
+    throw std::runtime_error("replay: buffer size differs from the recording");
+  }
+  if (buf.memtype == memory_type::device) {
+    throw std::runtime_error("replay: device buffers are not supported, use the *_cpu solvers");
+  }
+  int s0 = buf.stride[0];
+  int s1 = d == 2 ? buf.stride[1] : 0;
+  for (int j = 0; j < cols; ++j) {
+    for (int i = 0; i < rows; ++i) {
+      buf.data[i * s0 + j * s1] = packed[i + static_cast<size_t>(rows) * j];
+    }
+  }
+}
+
+/// ranks of comm in MPI_COMM_WORLD
+inline std::vector<int>
+world_ranks(MPI_Comm comm)
+{
+  MPI_Group group, world;
+  MPI_Comm_group(comm, &group);
+  MPI_Comm_group(MPI_COMM_WORLD, &world);
+  int n;
+  MPI_Group_size(group, &n);
+  std::vector<int> ranks(n), out(n);
+  for (int i = 0; i < n; ++i) ranks[i] = i;
+  MPI_Group_translate_ranks(group, n, ranks.data(), world, out.data());
+  MPI_Group_free(&group);
+  MPI_Group_free(&world);
+  return out;
+}
+
+class writer
+{
+public:
+  writer(const std::string& fname)
+      : out_(fname, std::ios::binary)
+  {
+    if (!out_) throw std::runtime_error("record: cannot open " + fname);
+    pod(magic);
+  }
+
+  template <class T>
+  void pod(const T& x)
+  {
+    out_.write(reinterpret_cast<const char*>(&x), sizeof(T));
+  }
+
+  template <class T>
+  void array(const std::vector<T>& x)
+  {
+    pod(static_cast<int64_t>(x.size()));
+    out_.write(reinterpret_cast<const char*>(x.data()), x.size() * sizeof(T));
+  }
+
+  void string(const std::string& s)
+  {
+    pod(static_cast<int64_t>(s.size()));
+    out_.write(s.data(), s.size());
+  }
+
+  void begin(tag t) { pod(static_cast<uint32_t>(t)); }
+
+  void flush() { out_.flush(); }
+
+private:
+  std::ofstream out_;
+};
+
+class reader
+{
+public:
+  reader(const std::string& fname)
+      : in_(fname, std::ios::binary)
+  {
+    if (!in_) throw std::runtime_error("replay: cannot open " + fname);
+    if (pod<uint64_t>() != magic) throw std::runtime_error("replay: " + fname + " is not a recording");
+  }
+
+  template <class T>
+  T pod()
+  {
+    T x;
+    in_.read(reinterpret_cast<char*>(&x), sizeof(T));
+    if (!in_) throw std::runtime_error("replay: unexpected end of the recording");
+    return x;
+  }
+
+  template <class T>
+  std::vector<T> array()
+  {
+    std::vector<T> x(pod<int64_t>());
+    in_.read(reinterpret_cast<char*>(x.data()), x.size() * sizeof(T));
+    if (!in_) throw std::runtime_error("replay: unexpected end of the recording");
+    return x;
+  }
+
+  std::string string()
+  {
+    std::string s(pod<int64_t>(), '\0');
+    in_.read(&s[0], s.size());
+    if (!in_) throw std::runtime_error("replay: unexpected end of the recording");
+    return s;
+  }
+
+  /// read the tag of the next record, throws if it is not t
+  void expect(tag t, const char* call)
+  {
+    auto found = pod<uint32_t>();
+    if (found != static_cast<uint32_t>(t)) {
+      throw std::runtime_error(std::string("replay: ") + call + " does not match the recording (tag " +
+                               std::to_string(found) + "), the run diverged");
+    }
+  }
+
+  /// tag of the next record without consuming it, 0 at the end of the file
+  uint32_t peek()
+  {
+    uint32_t t{0};
+    auto pos = in_.tellg();
+    in_.read(reinterpret_cast<char*>(&t), sizeof(t));
+    if (!in_) {
+      in_.clear();
+      t = 0;
+    }
+    in_.seekg(pos);
+    return t;
+  }
+
+private:
+  std::ifstream in_;
+};
+
+inline std::string
+filename(const std::string& prefix)
+{
+  int rank{0}, initialized{0};
+  MPI_Initialized(&initialized);
+  if (initialized) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  return prefix + "." + std::to_string(rank) + ".nlcgrec";
+}
+
+inline void
+write_energies(writer& w, EnergyBase& e)
+{
+  w.pod(e.get_total_energy());
+  auto components = e.get_energy_components();
+  w.pod(static_cast<int64_t>(components.size()));
+  for (auto& [name, value] : components) {
+    w.string(name);
+    w.pod(value);
+  }
+}
+
+template <class base_t>
+inline void
+write_all(writer& w, const std::shared_ptr<base_t>& x)
+{
+  for (int i = 0; i < x->size(); ++i) w.array(to_host(x->get(i)));
+}
+
+/// low-rank factors exported by the operator, none (see the UltrasoftPrecondBase specialization)
+template <class base_t>
+class exported_factors : public base_t
+{
+};
+
+/// UltrasoftPrecondBase::get_projectors / get_correction, set by RecordingOp and ReplayOp
+template <>
+class exported_factors<UltrasoftPrecondBase> : public UltrasoftPrecondBase
+{
+public:
+  std::shared_ptr<MatrixBaseZ> get_projectors(memory_type) const override { return projectors; }
+  std::shared_ptr<MatrixBaseZ> get_correction(memory_type) const override { return correction; }
+
+protected:
+  std::shared_ptr<MatrixBaseZ> projectors;
+  std::shared_ptr<MatrixBaseZ> correction;
+};
+
+}  // namespace record
+
+/// EnergyBase decorator, records the initial state and every evaluation
+class RecordingEnergy : public EnergyBase
+{
+public:
+  RecordingEnergy(EnergyBase& energy, const std::string& prefix, const record::parameters& params)
+      : energy_(energy)
+      , out_(std::make_shared<record::writer>(record::filename(prefix)))
+  {
+    auto& w = *out_;
+    auto C = energy_.get_C(memory_type::host);
+    auto wk = energy_.get_kpoint_weights();
+
+    w.begin(record::tag::header);
+    w.pod(params);
+    int world_size{1};
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    w.pod(static_cast<int32_t>(world_size));
+    w.pod(static_cast<int32_t>(energy_.nelectrons()));
+    w.pod(static_cast<int32_t>(energy_.occupancy()));
+    w.array(record::world_ranks(C->mpicomm()));
+    w.pod(static_cast<int32_t>(C->size()));
+    for (int i = 0; i < C->size(); ++i) {
+      auto kindex = C->kpoint_index(i);
+      auto buf = C->get(i);
+      w.pod(static_cast<int32_t>(kindex.first));
+      w.pod(static_cast<int32_t>(kindex.second));
+      w.pod(static_cast<int32_t>(buf.size[0]));
+      w.pod(static_cast<int32_t>(buf.size[1]));
+      w.array(record::world_ranks(C->mpicomm(i)));
+    }
+
+    w.begin(record::tag::state);
+    record::write_all(w, C);
+    record::write_all(w, energy_.get_hphi(memory_type::host));
+    record::write_all(w, energy_.get_sphi(memory_type::host));
+    record::write_all(w, energy_.get_fn());
+    record::write_all(w, energy_.get_ek());
+    record::write_all(w, energy_.get_gkvec_ekin());
+    for (int i = 0; i < wk->size(); ++i) w.pod(wk->get(i));
+    w.pod(energy_.get_chemical_potential());
+    record::write_energies(w, energy_);
+    w.flush();
+  }
+
+  void compute() override
+  {
+    energy_.compute();
+    this->write_compute(eval_hints{});
+  }
+
+  void compute_hinted(const eval_hints& hints) override
+  {
+    energy_.compute_hinted(hints);
+    this->write_compute(hints);
+  }
+
+  void compute_async(const eval_hints& hints) override
+  {
+    energy_.compute_async(hints);
+    pending_ = hints;
+    is_pending_ = true;
+  }
+
+  bool is_async() const override { return energy_.is_async(); }
+
+  void wait() override
+  {
+    energy_.wait();
+    if (is_pending_) {
+      is_pending_ = false;
+      this->write_compute(pending_);
+    }
+  }
+
+  int nelectrons() override { return energy_.nelectrons(); }
+  int occupancy() override { return energy_.occupancy(); }
+  double get_total_energy() override { return energy_.get_total_energy(); }
+  std::map<std::string, double> get_energy_components() override
+  {
+    return energy_.get_energy_components();
+  }
+  std::shared_ptr<MatrixBaseZ> get_hphi(memory_type m) override { return energy_.get_hphi(m); }
+  std::shared_ptr<MatrixBaseZ> get_sphi(memory_type m) override { return energy_.get_sphi(m); }
+  std::shared_ptr<MatrixBaseZ> get_C(memory_type m) override { return energy_.get_C(m); }
+  std::shared_ptr<VectorBaseZ> get_fn() override { return energy_.get_fn(); }
+  void set_fn(const std::vector<std::pair<int, int>>& keys,
+              const std::vector<std::vector<double>>& fn) override
+  {
+    energy_.set_fn(keys, fn);
+  }
+  std::shared_ptr<VectorBaseZ> get_ek() override { return energy_.get_ek(); }
+  std::shared_ptr<VectorBaseZ> get_gkvec_ekin() override { return energy_.get_gkvec_ekin(); }
+  std::shared_ptr<ScalarBaseZ> get_kpoint_weights() override { return energy_.get_kpoint_weights(); }
+  void set_chemical_potential(double mu) override { energy_.set_chemical_potential(mu); }
+  double get_chemical_potential() override { return energy_.get_chemical_potential(); }
+  void print_info() const override { energy_.print_info(); }
+
+  void write_result(const nlcg_info& info)
+  {
+    auto& w = *out_;
+    w.begin(record::tag::result);
+    w.pod(info.F);
+    w.pod(info.S);
+    w.pod(static_cast<int32_t>(info.iter));
+    w.pod(static_cast<int32_t>(info.converged));
+    w.pod(static_cast<int32_t>(info.status));
+    w.flush();
+  }
+
+  /// writer shared with the RecordingOp decorators, records are written in call order
+  const std::shared_ptr<record::writer>& writer() const { return out_; }
+
+private:
+  void write_compute(const eval_hints& hints)
+  {
+    auto& w = *out_;
+    w.begin(record::tag::compute);
+    w.pod(hints.energy_tol);
+    w.pod(static_cast<int32_t>(hints.is_trial));
+    record::write_all(w, energy_.get_C(memory_type::host));
+    record::write_all(w, energy_.get_hphi(memory_type::host));
+    record::write_all(w, energy_.get_sphi(memory_type::host));
+    record::write_all(w, energy_.get_ek());
+    record::write_energies(w, energy_);
+  }
+
+private:
+  EnergyBase& energy_;
+  std::shared_ptr<record::writer> out_;
+  eval_hints pending_;
+  bool is_pending_{false};
+};
+
+/// OverlapBase / UltrasoftPrecondBase decorator, records the output of every application
+template <class base_t>
+class RecordingOp : public record::exported_factors<base_t>
+{
+public:
+  using key_t = OpBase::key_t;
+
+public:
+  RecordingOp(const base_t& op, std::shared_ptr<record::writer> out, record::op_id id)
+      : op_(op)
+      , out_(std::move(out))
+      , id_(id)
+  {
+  }
+
+  void apply(const key_t& key, MatrixBaseZ::buffer_t& out, MatrixBaseZ::buffer_t& in) const override
+  {
+    op_.apply(key, out, in);
+    this->write(key, out);
+  }
+
+  void apply_batch(const std::vector<key_t>& keys,
+                   std::vector<MatrixBaseZ::buffer_t>& out,
+                   std::vector<MatrixBaseZ::buffer_t>& in) const override
+  {
+    op_.apply_batch(keys, out, in);
+    for (size_t i = 0; i < keys.size(); ++i) this->write(keys[i], out[i]);
+  }
+
+  std::vector<key_t> get_keys() const override { return op_.get_keys(); }
+
+  /**
+   * Forward the low-rank factors exported by the preconditioner and record them, must be called
+   * before the first evaluation. No-op for the overlap or if the factors are not provided.
+   */
+  void record_factors()
+  {
+    if constexpr (std::is_same<base_t, UltrasoftPrecondBase>::value) {
+      this->projectors = op_.get_projectors(memory_type::host);
+      this->correction = op_.get_correction(memory_type::host);
+      if (!this->projectors || !this->correction) return;
+      auto& w = *out_;
+      w.begin(record::tag::factors);
+      for (int i = 0; i < this->projectors->size(); ++i) {
+        auto b = this->projectors->get(i);
+        w.pod(static_cast<int32_t>(b.size[1]));
+        w.array(record::to_host(b));
+        w.array(record::to_host(this->correction->get(i)));
+      }
+      w.flush();
+    }
+  }
+
+private:
+  void write(const key_t& key, const MatrixBaseZ::buffer_t& out) const
+  {
+    auto& w = *out_;
+    w.begin(record::tag::apply);
+    w.pod(static_cast<int32_t>(id_));
+    w.pod(static_cast<int32_t>(key.first));
+    w.pod(static_cast<int32_t>(key.second));
+    w.array(record::to_host(out));
+  }
+
+private:
+  const base_t& op_;
+  std::shared_ptr<record::writer> out_;
+  record::op_id id_;
+};
+
+namespace record {
+
+/// state of a recorded run, shared by ReplayEnergy and ReplayOp
+struct replay_state
+{
+  struct kpoint
+  {
+    std::pair<int, int> key;
+    int rows;
+    int cols;
+    MPI_Comm comm;
+    std::vector<std::complex<double>> C, HX, SX;
+    std::vector<double> fn, ek, ekin;
+    double wk;
+    /// low-rank factors of the preconditioner, B (rows x nproj) and C (nproj x nproj)
+    int nproj{0};
+    std::vector<std::complex<double>> projectors, correction;
+  };
+
+  replay_state(const std::string& prefix)
+      : in(filename(prefix))
+  {
+    in.expect(tag::header, "header");
+    params = in.pod<parameters>();
+    int world_size{1};
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    int recorded_size = in.pod<int32_t>();
+    if (recorded_size != world_size) {
+      throw std::runtime_error("replay: recorded with " + std::to_string(recorded_size) +
+                               " MPI ranks, running on " + std::to_string(world_size));
+    }
+    nelectrons = in.pod<int32_t>();
+    occupancy = in.pod<int32_t>();
+    commk = this->make_comm(in.array<int>(), 0);
+    kpoints.resize(in.pod<int32_t>());
+    for (size_t i = 0; i < kpoints.size(); ++i) {
+      auto& k = kpoints[i];
+      k.key.first = in.pod<int32_t>();
+      k.key.second = in.pod<int32_t>();
+      k.rows = in.pod<int32_t>();
+      k.cols = in.pod<int32_t>();
+      k.comm = this->make_comm(in.array<int>(), i + 1);
+    }
+
+    in.expect(tag::state, "initial state");
+    for (auto& k : kpoints) k.C = in.array<std::complex<double>>();
+    for (auto& k : kpoints) k.HX = in.array<std::complex<double>>();
+    for (auto& k : kpoints) k.SX = in.array<std::complex<double>>();
+    for (auto& k : kpoints) k.fn = in.array<double>();
+    for (auto& k : kpoints) k.ek = in.array<double>();
+    for (auto& k : kpoints) k.ekin = in.array<double>();
+    for (auto& k : kpoints) k.wk = in.pod<double>();
+    mu = in.pod<double>();
+    this->read_energies();
+
+    if (in.peek() == static_cast<uint32_t>(tag::factors)) {
+      in.expect(tag::factors, "low-rank factors");
+      for (auto& k : kpoints) {
+        k.nproj = in.pod<int32_t>();
+        k.projectors = in.array<std::complex<double>>();
+        k.correction = in.array<std::complex<double>>();
+      }
+      has_factors = true;
+    }
+  }
+
+  ~replay_state()
+  {
+    for (auto& comm : comms) MPI_Comm_free(&comm);
+  }
+
+  replay_state(const replay_state&) = delete;
+  replay_state& operator=(const replay_state&) = delete;
+
+  /// next evaluation of the recording
+  void compute()
+  {
+    in.expect(tag::compute, "compute");
+    in.pod<double>();
+    in.pod<int32_t>();
+    for (auto& k : kpoints) {
+      auto C = in.array<std::complex<double>>();
+      double diff{0};
+      for (size_t i = 0; i < C.size() && i < k.C.size(); ++i) {
+        diff = std::max(diff, std::abs(C[i] - k.C[i]));
+      }
+      max_deviation = std::max(max_deviation, diff);
+    }
+    for (auto& k : kpoints) k.HX = in.array<std::complex<double>>();
+    for (auto& k : kpoints) k.SX = in.array<std::complex<double>>();
+    for (auto& k : kpoints) k.ek = in.array<double>();
+    this->read_energies();
+    ++ncompute;
+  }
+
+  /// next operator application of the recording
+  std::vector<std::complex<double>> apply(op_id id, const std::pair<int, int>& key)
+  {
+    in.expect(tag::apply, "operator application");
+    int32_t rid = in.pod<int32_t>();
+    int32_t k1 = in.pod<int32_t>();
+    int32_t k2 = in.pod<int32_t>();
+    if (rid != static_cast<int32_t>(id) || k1 != key.first || k2 != key.second) {
+      throw std::runtime_error("replay: operator application does not match the recording");
+    }
+    ++napply;
+    return in.array<std::complex<double>>();
+  }
+
+  /// nlcg_info of the recorded run, if the recording is complete
+  bool result(nlcg_info& info)
+  {
+    if (in.peek() != static_cast<uint32_t>(tag::result)) return false;
+    in.expect(tag::result, "result");
+    info.F = in.pod<double>();
+    info.S = in.pod<double>();
+    info.iter = in.pod<int32_t>();
+    info.converged = in.pod<int32_t>();
+    info.status = static_cast<nlcg_status>(in.pod<int32_t>());
+    return true;
+  }
+
+  int local_index(const std::pair<int, int>& key) const
+  {
+    for (size_t i = 0; i < kpoints.size(); ++i) {
+      if (kpoints[i].key == key) return i;
+    }
+    throw std::runtime_error("replay: unknown k-point");
+  }
+
+  reader in;
+  parameters params;
+  int nelectrons;
+  int occupancy;
+  MPI_Comm commk;
+  std::vector<kpoint> kpoints;
+  double mu{0};
+  /// the recording holds the low-rank factors of the preconditioner
+  bool has_factors{false};
+  double etot{0};
+  std::map<std::string, double> components;
+  /// largest difference between the wave-functions of the replay and the recording
+  double max_deviation{0};
+  int ncompute{0};
+  int napply{0};
+
+private:
+  void read_energies()
+  {
+    etot = in.pod<double>();
+    components.clear();
+    auto n = in.pod<int64_t>();
+    for (int64_t i = 0; i < n; ++i) {
+      auto name = in.string();
+      components[name] = in.pod<double>();
+    }
+  }
+
+  /// communicator of the recorded world ranks, collective over these ranks only
+  MPI_Comm make_comm(const std::vector<int>& ranks, int id)
+  {
+    int world_size;
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    if (ranks.size() == 1) return MPI_COMM_SELF;
+    bool is_world = static_cast<int>(ranks.size()) == world_size;
+    for (size_t i = 0; is_world && i < ranks.size(); ++i) is_world = ranks[i] == static_cast<int>(i);
+    if (is_world) return MPI_COMM_WORLD;
+    MPI_Group world, group;
+    MPI_Comm_group(MPI_COMM_WORLD, &world);
+    MPI_Group_incl(world, ranks.size(), ranks.data(), &group);
+    MPI_Comm comm;
+    MPI_Comm_create_group(MPI_COMM_WORLD, group, id, &comm);
+    MPI_Group_free(&group);
+    MPI_Group_free(&world);
+    comms.push_back(comm);
+    return comm;
+  }
+
+  std::vector<MPI_Comm> comms;
+};
+
+class replay_matrix : public MatrixBaseZ
+{
+public:
+  using member_t = std::vector<std::complex<double>> replay_state::kpoint::*;
+
+  replay_matrix(replay_state& state, member_t member)
+      : state_(state)
+      , member_(member)
+  {
+  }
+
+  buffer_t get(int i) override
+  {
+    auto& k = state_.kpoints[i];
+    return buffer_t({1, k.rows}, {k.rows, k.cols}, (k.*member_).data(), memory_type::host, k.comm);
+  }
+  const buffer_t get(int i) const override
+  {
+    auto& k = state_.kpoints[i];
+    return buffer_t({1, k.rows}, {k.rows, k.cols}, (k.*member_).data(), memory_type::host, k.comm);
+  }
+  int size() const override { return state_.kpoints.size(); }
+  MPI_Comm mpicomm(int i) const override { return state_.kpoints[i].comm; }
+  MPI_Comm mpicomm() const override { return state_.commk; }
+  kindex_t kpoint_index(int i) const override { return state_.kpoints[i].key; }
+
+private:
+  replay_state& state_;
+  member_t member_;
+};
+
+/// low-rank factor of the preconditioner, B (rows x nproj) or C (nproj x nproj)
+class replay_factor : public MatrixBaseZ
+{
+public:
+  using member_t = std::vector<std::complex<double>> replay_state::kpoint::*;
+
+  replay_factor(replay_state& state, member_t member, bool square)
+      : state_(state)
+      , member_(member)
+      , square_(square)
+  {
+  }
+
+  buffer_t get(int i) override { return this->buffer(i); }
+  const buffer_t get(int i) const override { return this->buffer(i); }
+  int size() const override { return state_.kpoints.size(); }
+  MPI_Comm mpicomm(int i) const override { return state_.kpoints[i].comm; }
+  MPI_Comm mpicomm() const override { return state_.commk; }
+  kindex_t kpoint_index(int i) const override { return state_.kpoints[i].key; }
+
+private:
+  buffer_t buffer(int i) const
+  {
+    auto& k = state_.kpoints[i];
+    int rows = square_ ? k.nproj : k.rows;
+    return buffer_t({1, rows}, {rows, k.nproj}, (k.*member_).data(), memory_type::host, k.comm);
+  }
+
+  replay_state& state_;
+  member_t member_;
+  bool square_;
+};
+
+class replay_vector : public VectorBaseZ
+{
+public:
+  using member_t = std::vector<double> replay_state::kpoint::*;
+
+  replay_vector(replay_state& state, member_t member)
+      : state_(state)
+      , member_(member)
+  {
+  }
+
+  buffer_t get(int i) override
+  {
+    auto& x = state_.kpoints[i].*member_;
+    return buffer_t(x.size(), x.data(), memory_type::host);
+  }
+  const buffer_t get(int i) const override
+  {
+    auto& x = state_.kpoints[i].*member_;
+    return buffer_t(x.size(), x.data(), memory_type::host);
+  }
+  int size() const override { return state_.kpoints.size(); }
+  MPI_Comm mpicomm(int i) const override { return state_.kpoints[i].comm; }
+  MPI_Comm mpicomm() const override { return state_.commk; }
+  kindex_t kpoint_index(int i) const override { return state_.kpoints[i].key; }
+
+private:
+  replay_state& state_;
+  member_t member_;
+};
+
+class replay_scalar : public ScalarBaseZ
+{
+public:
+  replay_scalar(replay_state& state)
+      : state_(state)
+  {
+  }
+
+  buffer_t get(int i) override { return state_.kpoints[i].wk; }
+  const buffer_t get(int i) const override { return state_.kpoints[i].wk; }
+  int size() const override { return state_.kpoints.size(); }
+  MPI_Comm mpicomm(int i) const override { return state_.kpoints[i].comm; }
+  MPI_Comm mpicomm() const override { return state_.commk; }
+  kindex_t kpoint_index(int i) const override { return state_.kpoints[i].key; }
+
+private:
+  replay_state& state_;
+};
+
+}  // namespace record
+
+/// EnergyBase served from a recording
+class ReplayEnergy : public EnergyBase
+{
+  using kpoint = record::replay_state::kpoint;
+
+public:
+  ReplayEnergy(record::replay_state& state)
+      : state_(state)
+  {
+  }
+
+  void compute() override { state_.compute(); }
+  int nelectrons() override { return state_.nelectrons; }
+  int occupancy() override { return state_.occupancy; }
+  double get_total_energy() override { return state_.etot; }
+  std::map<std::string, double> get_energy_components() override { return state_.components; }
+  std::shared_ptr<MatrixBaseZ> get_hphi(memory_type) override
+  {
+    return std::make_shared<record::replay_matrix>(state_, &kpoint::HX);
+  }
+  std::shared_ptr<MatrixBaseZ> get_sphi(memory_type) override
+  {
+    return std::make_shared<record::replay_matrix>(state_, &kpoint::SX);
+  }
+  std::shared_ptr<MatrixBaseZ> get_C(memory_type) override
+  {
+    return std::make_shared<record::replay_matrix>(state_, &kpoint::C);
+  }
+  std::shared_ptr<VectorBaseZ> get_fn() override
+  {
+    return std::make_shared<record::replay_vector>(state_, &kpoint::fn);
+  }
+  void set_fn(const std::vector<std::pair<int, int>>& keys,
+              const std::vector<std::vector<double>>& fn) override
+  {
+    for (size_t i = 0; i < keys.size(); ++i) state_.kpoints[state_.local_index(keys[i])].fn = fn[i];
+  }
+  std::shared_ptr<VectorBaseZ> get_ek() override
+  {
+    return std::make_shared<record::replay_vector>(state_, &kpoint::ek);
+  }
+  std::shared_ptr<VectorBaseZ> get_gkvec_ekin() override
+  {
+    return std::make_shared<record::replay_vector>(state_, &kpoint::ekin);
+  }
+  std::shared_ptr<ScalarBaseZ> get_kpoint_weights() override
+  {
+    return std::make_shared<record::replay_scalar>(state_);
+  }
+  void set_chemical_potential(double mu) override { state_.mu = mu; }
+  double get_chemical_potential() override { return state_.mu; }
+  void print_info() const override {}
+
+private:
+  record::replay_state& state_;
+};
+
+/// OverlapBase / UltrasoftPrecondBase served from a recording
+template <class base_t>
+class ReplayOp : public record::exported_factors<base_t>
+{
+public:
+  using key_t = OpBase::key_t;
+
+public:
+  ReplayOp(record::replay_state& state, record::op_id id)
+      : state_(state)
+      , id_(id)
+  {
+    if constexpr (std::is_same<base_t, UltrasoftPrecondBase>::value) {
+      if (state_.has_factors) {
+        using kpoint = record::replay_state::kpoint;
+        this->projectors =
+            std::make_shared<record::replay_factor>(state_, &kpoint::projectors, false);
+        this->correction =
+            std::make_shared<record::replay_factor>(state_, &kpoint::correction, true);
+      }
+    }
+  }
+
+  void apply(const key_t& key, MatrixBaseZ::buffer_t& out, MatrixBaseZ::buffer_t&) const override
+  {
+    record::from_host(out, state_.apply(id_, key));
+  }
+
+  std::vector<key_t> get_keys() const override
+  {
+    std::vector<key_t> keys;
+    for (auto& k : state_.kpoints) keys.push_back(k.key);
+    return keys;
+  }
+
+private:
+  record::replay_state& state_;
+  record::op_id id_;
+};
+
+}  // namespace nlcglib
@@ -11,6 +11,7 @@
 #include "la/utils.hpp"
 #include "utils/env.hpp"
 #include "utils/logger.hpp"
+#include "utils/solver_stats.hpp"
 #include "utils/timer.hpp"
 
 namespace nlcglib {
@@ -354,9 +355,10 @@ occupation_from_mvector(double T,
                         const scalar_vec_t& wk,
                         double tol)
 {
+  stats::phase_timer timer(SolverStats::GetInstance().ns_occupation);
   auto x_host = eval_threaded(tapply(
       [](auto x) {
-        auto x_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), x);
+        auto x_host = copies::create_mirror_view_and_copy("smearing", Kokkos::HostSpace(), x);
         return x_host;
       },
       x));
@@ -400,7 +402,7 @@ occupation_from_mvector(double T,
       [](auto fn_host) {
         auto fn = Kokkos::View<double*, target_memspc>(
             Kokkos::view_alloc(Kokkos::WithoutInitializing, "fn"), fn_host.size());
-        Kokkos::deep_copy(fn, fn_host);
+        copies::deep_copy("smearing", fn, fn_host);
         return fn;
       },
       fn_host));
@@ -419,9 +421,10 @@ occupation_from_mvector_newton(double T,
                                const scalar_vec_t& wk,
                                double tol)
 {
+  stats::phase_timer timer(SolverStats::GetInstance().ns_occupation);
   auto x_host = eval_threaded(tapply(
       [](auto x) {
-        auto x_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), x);
+        auto x_host = copies::create_mirror_view_and_copy("smearing", Kokkos::HostSpace(), x);
         return x_host;
       },
       x));
@@ -514,7 +517,7 @@ occupation_from_mvector_newton(double T,
       [](auto fn_host) {
         auto fn = Kokkos::View<double*, target_memspc>(
             Kokkos::view_alloc(Kokkos::WithoutInitializing, "fn"), fn_host.size());
-        Kokkos::deep_copy(fn, fn_host);
+        copies::deep_copy("smearing", fn, fn_host);
         return fn;
       },
       fn_host));
@@ -575,6 +578,16 @@ public:
   template <class X, class Y>
   double entropy(const mvector<X>& fn, const mvector<Y>& en, double mu);
 
+  /// change the temperature (in Kelvin)
+  void set_temperature(double T)
+  {
+    if (T == 0) {
+      throw std::runtime_error("Temperature must be > 0.");
+    }
+    this->T = T;
+    kT = T * physical_constants::kb;
+  }
+
 
 protected:
   /// Temperature in Kelvin
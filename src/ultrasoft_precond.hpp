@@ -30,6 +30,8 @@ public:
   auto begin() const { return local::op_iterator<const USPreconditioner>(us_precond_base.get_keys(), *this, false); }
   auto end() const { return local::op_iterator<const USPreconditioner>(us_precond_base.get_keys(), *this, true); }
 
+  const UltrasoftPrecondBase& base() const { return us_precond_base; }
+
 private:
   const UltrasoftPrecondBase& us_precond_base;
 };
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <string>
+
+namespace nlcglib {
+
+/**
+ * Online convergence analytics for the CG loop.
+ *
+ * Fits log|slope| and log|ΔF| linearly over the last `window` iterations, forecasts the number
+ * of iterations required to reach |slope| < tol and detects stagnation:
+ *   - `max_bt` consecutive backtracking fallbacks of the line search which changed F by less
+ *     than sqrt(eps) |F| (backtracking steps with a substantial decrease are progress),
+ *   - `max_flat` consecutive changes of F below the round-off floor,
+ *   - the slope decays, but the forecast exceeds the remaining iterations by more than a factor
+ *     `slow_factor`. CG is not monotone in the slope, no decay over the window is not a stall.
+ *     The rate of the early (pre-asymptotic) iterations is not predictive, the forecast is only
+ *     acted upon in the second half of the iterations.
+ * The forecast is always logged, the CG loop stops on a verdict only if NLCGLIB_STALL_DETECTION
+ * is set.
+ */
+class convergence_monitor
+{
+public:
+  enum class verdict
+  {
+    ok,
+    stagnated,
+    too_slow
+  };
+
+public:
+  convergence_monitor(double tol, int window = 8)
+      : tol(tol)
+      , window(window)
+  {
+  }
+
+  /// record an iteration, F and slope after the step, bt: backtracking search was used
+  void push(double F, double slope, bool bt)
+  {
+    double df = f.empty() ? std::numeric_limits<double>::infinity() : std::abs(F - f.back());
+    double scale = std::max(1.0, std::abs(F));
+    if (!f.empty()) {
+      double floor = 10 * DBL_EPSILON * scale;
+      nflat = df < floor ? nflat + 1 : 0;
+      log_df.push_back(std::log(std::max(df, floor)));
+    }
+    nbt = bt && df < std::sqrt(DBL_EPSILON) * scale ? nbt + 1 : 0;
+    f.push_back(F);
+    log_slope.push_back(std::log(std::max(std::abs(slope), DBL_MIN)));
+    if (static_cast<int>(log_slope.size()) > window) log_slope.pop_front();
+    if (static_cast<int>(log_df.size()) > window) log_df.pop_front();
+    if (f.size() > 1) f.pop_front();
+  }
+
+  /// forget the history (e.g. after a change of the temperature)
+  void reset()
+  {
+    f.clear();
+    log_slope.clear();
+    log_df.clear();
+    nbt = 0;
+    nflat = 0;
+  }
+
+  /// decay rate of |slope| per iteration, |slope_n| ~ exp(-rate * n)
+  double slope_rate() const { return -fit(log_slope); }
+
+  /// decay rate of |F_n - F_{n-1}| per iteration
+  double energy_rate() const { return -fit(log_df); }
+
+  /// estimated number of iterations until |slope| < tol, -1 if unknown (or not decaying)
+  int forecast() const
+  {
+    if (static_cast<int>(log_slope.size()) < window) return -1;
+    double gap = log_slope.back() - std::log(tol);
+    if (gap <= 0) return 0;
+    double rate = slope_rate();
+    if (!(rate > 0)) return -1;
+    return static_cast<int>(std::min(std::ceil(gap / rate), 1e9));
+  }
+
+  /// iter: number of iterations done, maxiter: iteration budget
+  verdict check(int iter, int maxiter) const
+  {
+    if (nbt >= max_bt || nflat >= max_flat) return verdict::stagnated;
+    int n = forecast();
+    int iter_left = maxiter - iter;
+    if (2 * iter >= maxiter && n > 0 && n / slow_factor > iter_left) return verdict::too_slow;
+    return verdict::ok;
+  }
+
+  /// human readable reason for the last verdict != ok
+  std::string reason() const
+  {
+    if (nbt >= max_bt) return std::to_string(nbt) + " consecutive unproductive backtracking searches";
+    if (nflat >= max_flat) return std::to_string(nflat) + " steps with |dF| below round-off";
+    return "forecast of " + std::to_string(forecast()) + " iterations exceeds maxiter";
+  }
+
+public:
+  /// consecutive backtracking searches without substantial decrease of F
+  int max_bt{3};
+  /// consecutive steps with |ΔF| below round-off
+  int max_flat{3};
+  /// tolerated ratio between forecast and remaining iterations
+  double slow_factor{2};
+
+private:
+  /// least-squares slope of y over equidistant points
+  static double fit(const std::deque<double>& y)
+  {
+    int n = y.size();
+    if (n < 2) return 0;
+    double xm = 0.5 * (n - 1);
+    double ym = 0;
+    for (double v : y) ym += v;
+    ym /= n;
+    double sxy{0}, sxx{0};
+    for (int i = 0; i < n; ++i) {
+      sxy += (i - xm) * (y[i] - ym);
+      sxx += (i - xm) * (i - xm);
+    }
+    return sxy / sxx;
+  }
+
+private:
+  double tol;
+  int window;
+  /// last F
+  std::deque<double> f;
+  std::deque<double> log_slope;
+  std::deque<double> log_df;
+  int nbt{0};
+  int nflat{0};
+};
+
+}  // namespace nlcglib
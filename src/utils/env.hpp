@@ -3,11 +3,12 @@
 #include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <string>
 
 namespace nlcglib {
 namespace env {
 /// Check if environment variable NLCG_DISABLE_NEWTON_EFERMI is set (using a singleton).
-bool
+inline bool
 get_skip_newton_efermi()
 {
   static std::atomic<int> skip_newton{-1};
@@ -29,5 +30,231 @@ get_skip_newton_efermi()
   return skip_newton.load(std::memory_order_relaxed) == 1;
 }
 
+/// Value of the environment variable NLCGLIB_CG_TYPE, selects the CG update formula.
+inline std::string
+get_cg_type()
+{
+  char* cg_type = std::getenv("NLCGLIB_CG_TYPE");
+  if (cg_type == nullptr) {
+    return "fr";
+  }
+  return std::string(cg_type);
+}
+
+/// Value of the environment variable NLCGLIB_DIRECTION, selects the search direction (cg | lbfgs).
+inline std::string
+get_direction()
+{
+  char* direction = std::getenv("NLCGLIB_DIRECTION");
+  if (direction == nullptr) {
+    return "cg";
+  }
+  return std::string(direction);
+}
+
+/// Value of the environment variable NLCGLIB_US_PRECOND, preconditioner of the ultrasoft solver
+/// (host: UltrasoftPrecondBase callback | teter | teter_lowrank).
+inline std::string
+get_us_precond()
+{
+  char* p = std::getenv("NLCGLIB_US_PRECOND");
+  if (p == nullptr) {
+    return "host";
+  }
+  return std::string(p);
+}
+
+/// Value of the environment variable NLCGLIB_OVERLAP, application of S in the ultrasoft solver
+/// (auto: in-library if OverlapBase exports B and Q | host: OverlapBase callback | lowrank).
+inline std::string
+get_overlap()
+{
+  char* o = std::getenv("NLCGLIB_OVERLAP");
+  if (o == nullptr) {
+    return "auto";
+  }
+  return std::string(o);
+}
+
+/// Value of the environment variable NLCGLIB_LBFGS_M, number of L-BFGS pairs (default 5, at most
+/// 16).
+inline int
+get_lbfgs_m()
+{
+  char* m = std::getenv("NLCGLIB_LBFGS_M");
+  if (m == nullptr) {
+    return 5;
+  }
+  return std::atoi(m);
+}
+
+/// Value of the environment variable NLCGLIB_BAND_LOCKING, fraction of the tolerance that is
+/// available for locked bands (default 0: band locking is disabled).
+inline double
+get_band_locking()
+{
+  char* fraction = std::getenv("NLCGLIB_BAND_LOCKING");
+  if (fraction == nullptr) {
+    return 0;
+  }
+  return std::atof(fraction);
+}
+
+/// Value of the environment variable NLCGLIB_BAND_LOCKING_RECHECK, locked bands are re-checked
+/// every N iterations (default 10, 0: only on CG restarts).
+inline int
+get_band_locking_recheck()
+{
+  char* n = std::getenv("NLCGLIB_BAND_LOCKING_RECHECK");
+  if (n == nullptr) {
+    return 10;
+  }
+  return std::atoi(n);
+}
+
+/// Value of the environment variable NLCGLIB_FREEZE_EMPTY, bands above mu + c * kT are frozen
+/// (default 0: disabled).
+inline double
+get_freeze_empty()
+{
+  char* c = std::getenv("NLCGLIB_FREEZE_EMPTY");
+  if (c == nullptr) {
+    return 0;
+  }
+  return std::atof(c);
+}
+
+/// Value of the environment variable NLCGLIB_T_START, initial temperature (in Kelvin) of the
+/// temperature continuation (default 0: disabled).
+inline double
+get_t_start()
+{
+  char* t = std::getenv("NLCGLIB_T_START");
+  if (t == nullptr) {
+    return 0;
+  }
+  return std::atof(t);
+}
+
+/// Value of the environment variable NLCGLIB_T_FACTOR, the temperature is lowered by this factor
+/// in each stage of the temperature continuation (default 0.5).
+inline double
+get_t_factor()
+{
+  char* f = std::getenv("NLCGLIB_T_FACTOR");
+  if (f == nullptr) {
+    return 0.5;
+  }
+  return std::atof(f);
+}
+
+/// Value of the environment variable NLCGLIB_ADAPTIVE_KAPPA, adjust kappa online (default 0: off).
+inline bool
+get_adaptive_kappa()
+{
+  char* a = std::getenv("NLCGLIB_ADAPTIVE_KAPPA");
+  if (a == nullptr) {
+    return false;
+  }
+  return std::atoi(a) != 0;
+}
+
+/// Value of the environment variable NLCGLIB_STALL_DETECTION, stop early if the run stagnates or
+/// is forecast to exceed maxiter (default 0: off, run until tol or maxiter).
+inline bool
+get_stall_detection()
+{
+  char* a = std::getenv("NLCGLIB_STALL_DETECTION");
+  if (a == nullptr) {
+    return false;
+  }
+  return std::atoi(a) != 0;
+}
+
+/// Value of the environment variable NLCGLIB_NUM_THREADS, thread budget of nlcglib (default 0:
+/// OpenMP max threads).
+inline int
+get_num_threads()
+{
+  char* n = std::getenv("NLCGLIB_NUM_THREADS");
+  if (n == nullptr) {
+    return 0;
+  }
+  return std::atoi(n);
+}
+
+/// Value of the environment variable NLCGLIB_BLAS_GRAIN, minimal work m * n * k per BLAS thread
+/// (default 2^18, 0: always use all threads).
+inline long
+get_blas_grain()
+{
+  char* g = std::getenv("NLCGLIB_BLAS_GRAIN");
+  if (g == nullptr) {
+    return 1 << 18;
+  }
+  return std::atol(g);
+}
+
+/// Value of the environment variable NLCGLIB_LA_COUNTERS, flop/byte counters of the LA wrappers
+/// (default 0: off).
+inline bool
+get_la_counters()
+{
+  char* c = std::getenv("NLCGLIB_LA_COUNTERS");
+  if (c == nullptr) {
+    return false;
+  }
+  return std::atoi(c) != 0;
+}
+
+/// Value of the environment variable NLCGLIB_COPY_COUNTERS, account deep copies by call site and
+/// log a ranked report per iteration (default 0: off).
+inline bool
+get_copy_counters()
+{
+  char* c = std::getenv("NLCGLIB_COPY_COUNTERS");
+  if (c == nullptr) {
+    return false;
+  }
+  return std::atoi(c) != 0;
+}
+
+/// Value of the environment variable NLCGLIB_PIN, thread pinning policy applied by initialize()
+/// (none | ranks, default none). Other than none, initialize() is collective on MPI_COMM_WORLD.
+inline std::string
+get_pin()
+{
+  char* pin = std::getenv("NLCGLIB_PIN");
+  if (pin == nullptr) {
+    return "none";
+  }
+  return std::string(pin);
+}
+
+/// Value of the environment variable NLCGLIB_TOPOLOGY_REPORT, print the cpu/NUMA binding of all
+/// ranks in initialize(), collective on MPI_COMM_WORLD (default 0: only rank-local misbinding
+/// warnings, no communication).
+inline bool
+get_topology_report()
+{
+  char* r = std::getenv("NLCGLIB_TOPOLOGY_REPORT");
+  if (r == nullptr) {
+    return false;
+  }
+  return std::atoi(r) != 0;
+}
+
+/// Value of the environment variable NLCGLIB_RECORD, file prefix of the recording of the
+/// EnergyBase / OpBase interaction (default empty: off), see record_replay.hpp.
+inline std::string
+get_record()
+{
+  char* prefix = std::getenv("NLCGLIB_RECORD");
+  if (prefix == nullptr) {
+    return "";
+  }
+  return std::string(prefix);
+}
+
 }  // namespace env
 }  // namespace nlcglib
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include "csingleton.hpp"
+#include "interface.hpp"
+
+namespace nlcglib {
+
+/**
+ * Event counters of a solver run, incremented by the modules where the events happen (free
+ * energy, line search, operators, communicator, copies between memory spaces), reset at the
+ * start of nlcg() and reported in nlcg_info::stats. Counting is always on, the counters are
+ * relaxed atomics.
+ *
+ * The ns_* counters are the wall times (host clock, no fence) of phases which cut across the
+ * line search and the search direction, measured by stats::phase_timer where they happen.
+ */
+class SolverStats : public CSingleton<SolverStats>
+{
+public:
+  /// labels of the phase times, in the order of phase_seconds()
+  static constexpr std::array<const char*, 4> phase_names{
+      "occupation search", "allgather", "logging", "small matrices"};
+
+public:
+  void reset()
+  {
+    for (auto* c : {&evaluations,
+                    &qline,
+                    &btsearch,
+                    &overlap_applications,
+                    &precond_applications,
+                    &restarts,
+                    &bytes_copied,
+                    &bytes_allreduced,
+                    &bytes_allgathered,
+                    &ns_occupation,
+                    &ns_allgather,
+                    &ns_logging,
+                    &ns_small_matrices}) {
+      c->store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /// phase times [s] so far, see phase_names
+  std::array<double, 4> phase_seconds() const
+  {
+    std::array<double, 4> t;
+    int i{0};
+    for (auto* c : {&ns_occupation, &ns_allgather, &ns_logging, &ns_small_matrices}) {
+      t[i++] = 1e-9 * c->load(std::memory_order_relaxed);
+    }
+    return t;
+  }
+
+  /// copy counters to the result, the times are filled in by the solver
+  void fill(nlcg_stats& stats) const
+  {
+    stats.evaluations = evaluations.load(std::memory_order_relaxed);
+    stats.qline = qline.load(std::memory_order_relaxed);
+    stats.btsearch = btsearch.load(std::memory_order_relaxed);
+    stats.overlap_applications = overlap_applications.load(std::memory_order_relaxed);
+    stats.precond_applications = precond_applications.load(std::memory_order_relaxed);
+    stats.restarts = restarts.load(std::memory_order_relaxed);
+    stats.bytes_copied = bytes_copied.load(std::memory_order_relaxed);
+    stats.bytes_allreduced = bytes_allreduced.load(std::memory_order_relaxed);
+    stats.bytes_allgathered = bytes_allgathered.load(std::memory_order_relaxed);
+    auto t = phase_seconds();
+    stats.time_occupation = t[0];
+    stats.time_allgather = t[1];
+    stats.time_logging = t[2];
+    stats.time_small_matrices = t[3];
+  }
+
+  static void add(std::atomic<long>& counter, long n)
+  {
+    counter.fetch_add(n, std::memory_order_relaxed);
+  }
+
+public:
+  std::atomic<long> evaluations{0};
+  std::atomic<long> qline{0};
+  std::atomic<long> btsearch{0};
+  std::atomic<long> overlap_applications{0};
+  std::atomic<long> precond_applications{0};
+  std::atomic<long> restarts{0};
+  std::atomic<long> bytes_copied{0};
+  std::atomic<long> bytes_allreduced{0};
+  std::atomic<long> bytes_allgathered{0};
+  std::atomic<long> ns_occupation{0};
+  std::atomic<long> ns_allgather{0};
+  std::atomic<long> ns_logging{0};
+  std::atomic<long> ns_small_matrices{0};
+};
+
+namespace stats {
+
+/// n applications of the OpBase op_t (overlap or ultrasoft preconditioner)
+template <class op_t>
+inline void
+count_op(long n = 1)
+{
+  auto& s = SolverStats::GetInstance();
+  if (std::is_base_of<OverlapBase, op_t>::value) {
+    SolverStats::add(s.overlap_applications, n);
+  } else {
+    SolverStats::add(s.precond_applications, n);
+  }
+}
+
+/// bytes copied between memory spaces (host <-> device)
+inline void
+count_copy(long bytes)
+{
+  SolverStats::add(SolverStats::GetInstance().bytes_copied, bytes);
+}
+
+/**
+ * RAII: adds the wall time of the enclosing scope to a phase counter of SolverStats (ns_*).
+ * Nested phase timers are exclusive: the time of the inner phase (e.g. the allgather of the
+ * occupation search) is not added to the outer one.
+ */
+class phase_timer
+{
+  using clock = std::chrono::steady_clock;
+
+public:
+  explicit phase_timer(std::atomic<long>& counter)
+      : counter_(counter)
+      , parent_(current())
+      , t0_(clock::now())
+  {
+    current() = this;
+  }
+
+  ~phase_timer()
+  {
+    long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0_).count();
+    current() = parent_;
+    if (parent_ != nullptr) parent_->nested_ += ns;
+    SolverStats::add(counter_, ns - nested_);
+  }
+
+  phase_timer(const phase_timer&) = delete;
+  phase_timer& operator=(const phase_timer&) = delete;
+
+private:
+  /// innermost phase_timer of the calling thread
+  static phase_timer*& current()
+  {
+    static thread_local phase_timer* timer{nullptr};
+    return timer;
+  }
+
+  std::atomic<long>& counter_;
+  phase_timer* parent_;
+  clock::time_point t0_;
+  long nested_{0};
+};
+
+}  // namespace stats
+
+}  // namespace nlcglib
@@ -81,7 +81,8 @@ StepLogger::log(const std::string& key, const mvector<V>& x)
   // assuming V is a 1-d kokkos array
   for (auto& elem : x) {
     auto x_key = elem.first;
-    auto array = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), elem.second);
+    auto array =
+        copies::create_mirror_view_and_copy("step_logger", Kokkos::HostSpace(), elem.second);
     std::vector<typename V::value_type> v(array.size());
     // std::vector<double> v(array.size());
     std::copy(array.data(), array.data() + array.size(), v.data());
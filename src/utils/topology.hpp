@@ -0,0 +1,273 @@
+#pragma once
+
+#include <mpi.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+namespace nlcglib {
+namespace topology {
+
+#ifdef __linux__
+constexpr int max_cpus = CPU_SETSIZE;
+#else
+constexpr int max_cpus = 1024;
+#endif
+
+/// thread binding of a single rank
+struct binding
+{
+  std::string host;
+  int rank{0};
+  /// rank and number of ranks on this host
+  int local_rank{0};
+  int local_size{1};
+  /// cpus the process may run on
+  std::vector<int> cpus;
+  /// NUMA nodes of cpus
+  std::vector<int> numa;
+};
+
+/// parse a Linux cpu list, e.g. "0-3,8,10-11"
+inline std::vector<int>
+parse_cpulist(const std::string& list)
+{
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty()) continue;
+    int lo{0}, hi{0};
+    int n = std::sscanf(range.c_str(), "%d-%d", &lo, &hi);
+    if (n == 1) hi = lo;
+    if (n < 1) continue;
+    for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+  }
+  return cpus;
+}
+
+/// format as cpu list (inverse of parse_cpulist)
+inline std::string
+format_cpulist(const std::vector<int>& cpus)
+{
+  std::string out;
+  for (size_t i = 0; i < cpus.size();) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+    if (!out.empty()) out += ",";
+    out += std::to_string(cpus[i]);
+    if (j > i) out += "-" + std::to_string(cpus[j]);
+    i = j + 1;
+  }
+  return out;
+}
+
+/// cpus the calling thread may run on
+inline std::vector<int>
+affinity()
+{
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+    for (int c = 0; c < max_cpus; ++c) {
+      if (CPU_ISSET(c, &mask)) cpus.push_back(c);
+    }
+  }
+#endif
+  return cpus;
+}
+
+/// restrict the calling thread (and threads created afterwards) to cpus
+inline bool
+set_affinity(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (int c : cpus) CPU_SET(c, &mask);
+  return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#else
+  return false;
+#endif
+}
+
+/// NUMA nodes touched by cpus (empty if /sys is not available)
+inline std::vector<int>
+numa_nodes(const std::vector<int>& cpus)
+{
+  std::vector<int> nodes;
+  for (int node = 0; node < 1024; ++node) {
+    std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (!f) {
+      if (node > 0) break;
+      continue;
+    }
+    std::string list;
+    std::getline(f, list);
+    auto node_cpus = parse_cpulist(list);
+    bool touched = std::any_of(cpus.begin(), cpus.end(), [&](int c) {
+      return std::find(node_cpus.begin(), node_cpus.end(), c) != node_cpus.end();
+    });
+    if (touched) nodes.push_back(node);
+  }
+  return nodes;
+}
+
+/// communicator of the ranks on this host, MPI_COMM_SELF if MPI is not initialized (free with
+/// MPI_Comm_free if != MPI_COMM_SELF)
+inline MPI_Comm
+local_comm()
+{
+  int initialized{0};
+  MPI_Initialized(&initialized);
+  if (!initialized) return MPI_COMM_SELF;
+  MPI_Comm local;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &local);
+  return local;
+}
+
+inline binding
+detect(MPI_Comm local)
+{
+  binding b;
+  int initialized{0};
+  MPI_Initialized(&initialized);
+  if (initialized) {
+    MPI_Comm_rank(MPI_COMM_WORLD, &b.rank);
+    MPI_Comm_rank(local, &b.local_rank);
+    MPI_Comm_size(local, &b.local_size);
+  }
+#ifdef __linux__
+  char host[256] = {0};
+  gethostname(host, sizeof(host) - 1);
+  b.host = host;
+#endif
+  b.cpus = affinity();
+  b.numa = numa_nodes(b.cpus);
+  return b;
+}
+
+/**
+ * Pinning policy "ranks": the cpus available to the ranks of a host are split into local_size
+ * contiguous blocks, local rank i is bound to block i. Threads created afterwards (OpenMP, BLAS)
+ * inherit the mask. Returns false if the policy is unknown or the ranks have fewer cpus than ranks.
+ */
+inline bool
+pin(const std::string& policy, MPI_Comm local)
+{
+  if (policy == "none" || policy.empty()) return true;
+  if (policy != "ranks") return false;
+  int local_rank{0}, local_size{1};
+  if (local != MPI_COMM_SELF) {
+    MPI_Comm_rank(local, &local_rank);
+    MPI_Comm_size(local, &local_size);
+  }
+  // union of the cpus of all ranks on this host
+  std::vector<unsigned char> mask(max_cpus, 0);
+  for (int c : affinity()) mask[c] = 1;
+  if (local != MPI_COMM_SELF) {
+    MPI_Allreduce(MPI_IN_PLACE, mask.data(), mask.size(), MPI_UNSIGNED_CHAR, MPI_MAX, local);
+  }
+  std::vector<int> cpus;
+  for (int c = 0; c < max_cpus; ++c) {
+    if (mask[c]) cpus.push_back(c);
+  }
+  int ncpus = cpus.size();
+  if (ncpus < local_size) return false;
+  int begin = ncpus * local_rank / local_size;
+  int end = ncpus * (local_rank + 1) / local_size;
+  return set_affinity(std::vector<int>(cpus.begin() + begin, cpus.begin() + end));
+}
+
+/// misbinding warnings for this rank, num_threads: threads used per rank
+inline std::vector<std::string>
+check(const binding& b, int num_threads, MPI_Comm local)
+{
+  std::vector<std::string> warnings;
+  int ncpus = b.cpus.size();
+  if (ncpus > 0 && num_threads > ncpus) {
+    warnings.push_back(std::to_string(num_threads) + " threads on " + std::to_string(ncpus) +
+                       " cpus (oversubscribed)");
+  }
+  if (b.numa.size() > 1 && b.local_size > 1) {
+    warnings.push_back("rank spans " + std::to_string(b.numa.size()) + " NUMA nodes");
+  }
+  // overlapping cpu sets of the ranks on this host
+  if (local != MPI_COMM_SELF && b.local_size > 1) {
+    std::vector<unsigned char> mine(max_cpus, 0);
+    for (int c : b.cpus) mine[c] = 1;
+    std::vector<unsigned char> all(max_cpus * b.local_size);
+    MPI_Allgather(
+        mine.data(), max_cpus, MPI_UNSIGNED_CHAR, all.data(), max_cpus, MPI_UNSIGNED_CHAR, local);
+    int shared{0};
+    for (int r = 0; r < b.local_size; ++r) {
+      if (r == b.local_rank) continue;
+      for (int c = 0; c < max_cpus; ++c) {
+        if (mine[c] && all[r * max_cpus + c]) {
+          ++shared;
+          break;
+        }
+      }
+    }
+    if (shared > 0) {
+      warnings.push_back("cpus shared with " + std::to_string(shared) + " other rank(s) on " +
+                         b.host);
+    }
+  }
+  return warnings;
+}
+
+/// one line per rank, gathered and printed on rank 0 of MPI_COMM_WORLD if gather (collective),
+/// otherwise every rank prints its own lines
+inline void
+report(const binding& b, const std::vector<std::string>& warnings, bool full, bool gather)
+{
+  std::stringstream line;
+  if (full) {
+    line << "[nlcglib] rank " << b.rank << " host " << b.host << " local " << b.local_rank << "/"
+         << b.local_size << " cpus " << format_cpulist(b.cpus) << " numa "
+         << format_cpulist(b.numa) << "\n";
+  }
+  for (auto& w : warnings) {
+    line << "[nlcglib] WARNING rank " << b.rank << ": " << w << "\n";
+  }
+  std::string msg = line.str();
+
+  int initialized{0};
+  MPI_Initialized(&initialized);
+  if (!initialized || !gather) {
+    std::cout << msg << std::flush;
+    return;
+  }
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  int len = msg.size();
+  std::vector<int> lens(size), displs(size);
+  MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+  int total{0};
+  for (int r = 0; r < size; ++r) {
+    displs[r] = total;
+    total += lens[r];
+  }
+  std::vector<char> buf(std::max(total, 1));
+  MPI_Gatherv(msg.data(), len, MPI_CHAR, buf.data(), lens.data(), displs.data(), MPI_CHAR, 0,
+              MPI_COMM_WORLD);
+  if (rank == 0 && total > 0) {
+    std::cout << std::string(buf.data(), total) << std::flush;
+  }
+}
+
+}  // namespace topology
+}  // namespace nlcglib
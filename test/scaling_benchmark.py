@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Strong and weak scaling of nlcglib on a single node.
+
+Runs test_model_solver with mpirun for every combination of ranks x threads and
+reports the wall time per phase of the solver together with the parallel
+efficiency. The phase timings are taken from the "... took: X seconds" lines in
+nlcg.out, written by rank 0 in every iteration:
+
+  linesearch  line search (energy evaluations included)
+  direction   steepest descent / conjugated descent / L-BFGS direction
+  occupation  search of the chemical potential and the occupation numbers
+  allgather   allgathers over k-points (eigenvalues, occupations, weights)
+  logging     output to nlcg.out / nlcg.json
+  small       nbands x nbands factorizations (eigh, Cholesky) and the eta-gradient
+  other       remainder of the wall time (setup, ...)
+
+The last four phases also occur inside the line search and the direction, their
+columns are the total time wherever they happen. other excludes only the part of
+them outside of the line search and the direction, such that
+linesearch + direction + outside parts + other = total.
+
+strong: fixed number of k-points (--nk), efficiency T(1) / (p T(p))
+weak:   --nk-per-rank k-points per rank, efficiency t(1) / t(p), t: time per iteration
+
+p is the number of ranks times threads. The reference is the first configuration of
+the sweep (1 rank, --threads[0] threads unless changed).
+
+example:
+  ./scaling_benchmark.py --exe build/test/test_model_solver --ranks 1,2,4 --threads 1,2 \
+      --nk 8 --nk-per-rank 2 --npw 200 --nbands 32
+"""
+
+import argparse
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+
+PHASES = {
+    "line search": "linesearch",
+    "steepest descent": "direction",
+    "conjugated descent": "direction",
+    "L-BFGS direction": "direction",
+    "occupation search": "occupation",
+    "allgather": "allgather",
+    "logging": "logging",
+    "small matrices": "small",
+}
+CROSS_CUTTING = ["occupation", "allgather", "logging", "small"]
+COLUMNS = ["linesearch", "direction"] + CROSS_CUTTING + ["other", "total"]
+
+TOOK = re.compile(r"^(.+?) took: ([-+0-9.eE]+) seconds")
+OUTSIDE = re.compile(r"outside line search / direction: ([-+0-9.eE]+)")
+RESULT = re.compile(r"^model_solver .*")
+
+
+def int_list(s):
+    return [int(x) for x in s.split(",") if x]
+
+
+def parse_phases(nlcg_out):
+    """phase times and the time of the cross-cutting phases outside linesearch / direction"""
+    times = {c: 0.0 for c in COLUMNS}
+    outside = 0.0
+    with open(nlcg_out) as f:
+        for line in f:
+            m = TOOK.match(line.strip())
+            if m and m.group(1) in PHASES:
+                times[PHASES[m.group(1)]] += float(m.group(2))
+                o = OUTSIDE.search(line)
+                if o:
+                    outside += float(o.group(1))
+    return times, outside
+
+
+def parse_result(stdout):
+    for line in stdout.splitlines():
+        if RESULT.match(line):
+            tokens = line.split()[1:]
+            return dict(zip(tokens[::2], tokens[1::2]))
+    return None
+
+
+def run(args, ranks, threads, nk):
+    env = dict(os.environ)
+    env["OMP_NUM_THREADS"] = str(threads)
+    env["NLCGLIB_NUM_THREADS"] = str(threads)
+    env.setdefault("OMP_PROC_BIND", "spread")
+    env.setdefault("OMP_PLACES", "threads")
+    cmd = shlex.split(args.mpirun) + ["-np", str(ranks)] + shlex.split(args.mpirun_args)
+    cmd += [os.path.abspath(args.exe), "--nk", str(nk), "--npw", str(args.npw),
+            "--nbands", str(args.nbands), "--maxiter", str(args.maxiter), "--tol", str(args.tol)]
+    if args.nc:
+        cmd.append("--nc")
+    best = None
+    for _ in range(args.repeat):
+        with tempfile.TemporaryDirectory(prefix="nlcg_scaling_") as wd:
+            p = subprocess.run(cmd, cwd=wd, env=env, stdout=subprocess.PIPE,
+                               stderr=subprocess.STDOUT, universal_newlines=True)
+            result = parse_result(p.stdout)
+            if p.returncode != 0 or result is None:
+                sys.stderr.write(p.stdout)
+                raise RuntimeError("failed: " + " ".join(cmd))
+            times, outside = parse_phases(os.path.join(wd, "nlcg.out"))
+        times["total"] = float(result["time"])
+        times["other"] = max(
+            times["total"] - times["linesearch"] - times["direction"] - outside, 0.0)
+        if best is None or times["total"] < best["times"]["total"]:
+            best = {"ranks": ranks, "threads": threads, "nk": nk,
+                    "iter": int(result["iter"]), "F": float(result["F"]), "times": times}
+    print("  ranks %2d threads %2d nk %3d: %8.3f s, %d iterations"
+          % (ranks, threads, nk, best["times"]["total"], best["iter"]), file=sys.stderr)
+    return best
+
+
+def efficiency(runs, weak):
+    ref = runs[0]
+    p_ref = ref["ranks"] * ref["threads"]
+    for r in runs:
+        p = r["ranks"] * r["threads"]
+        r["efficiency"] = {}
+        for c in COLUMNS:
+            t, t_ref = r["times"][c], ref["times"][c]
+            if weak:
+                # normalize by the iteration count, it changes with the number of k-points
+                t, t_ref = t / max(r["iter"], 1), t_ref / max(ref["iter"], 1)
+                r["efficiency"][c] = t_ref / t if t > 0 else float("nan")
+            else:
+                r["efficiency"][c] = t_ref * p_ref / (p * t) if t > 0 else float("nan")
+
+
+def table(title, runs):
+    head = "| ranks | threads | nk | iter | " + " | ".join(
+        "%s [s] | eff" % c for c in COLUMNS) + " |"
+    lines = ["### " + title, "", head, "|" + "---|" * (4 + 2 * len(COLUMNS))]
+    for r in runs:
+        cells = ["%d" % r["ranks"], "%d" % r["threads"], "%d" % r["nk"], "%d" % r["iter"]]
+        for c in COLUMNS:
+            cells += ["%.4f" % r["times"][c], "%.2f" % r["efficiency"][c]]
+        lines.append("| " + " | ".join(cells) + " |")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--exe", default="test_model_solver", help="path to test_model_solver")
+    parser.add_argument("--ranks", type=int_list, default=[1, 2, 4])
+    parser.add_argument("--threads", type=int_list, default=[1])
+    parser.add_argument("--nk", type=int, default=8, help="k-points (strong scaling)")
+    parser.add_argument("--nk-per-rank", type=int, default=2, help="k-points per rank (weak scaling)")
+    parser.add_argument("--npw", type=int, default=200)
+    parser.add_argument("--nbands", type=int, default=32)
+    parser.add_argument("--maxiter", type=int, default=50)
+    parser.add_argument("--tol", type=float, default=1e-9)
+    parser.add_argument("--nc", action="store_true", help="norm-conserving solver (default: ultrasoft)")
+    parser.add_argument("--repeat", type=int, default=1, help="runs per configuration, keep the fastest")
+    parser.add_argument("--mode", choices=["strong", "weak", "both"], default="both")
+    parser.add_argument("--mpirun", default="mpirun")
+    parser.add_argument("--mpirun-args", default="", help="extra arguments, e.g. '--bind-to core'")
+    parser.add_argument("--json", help="write all results to this file")
+    args = parser.parse_args()
+
+    results = {}
+    if args.mode in ("strong", "both"):
+        print("strong scaling, nk = %d" % args.nk, file=sys.stderr)
+        runs = [run(args, r, t, args.nk) for r in args.ranks for t in args.threads]
+        efficiency(runs, weak=False)
+        results["strong"] = runs
+        print(table("strong scaling (nk = %d)" % args.nk, runs))
+    if args.mode in ("weak", "both"):
+        print("weak scaling, nk = %d per rank" % args.nk_per_rank, file=sys.stderr)
+        runs = [run(args, r, t, args.nk_per_rank * r) for r in args.ranks for t in args.threads]
+        efficiency(runs, weak=True)
+        results["weak"] = runs
+        print(table("weak scaling (nk = %d per rank, efficiency per iteration)" % args.nk_per_rank, runs))
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
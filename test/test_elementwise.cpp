@@ -0,0 +1,209 @@
+/**
+ * Timings of the elementwise kernels on the wave-function sized work buffers (scale by the
+ * occupation numbers, add, diagonal preconditioner, innerh_tr) and of the off-diagonal entries
+ * of the η-gradient, host memory.
+ *
+ * The library kernels work on interleaved Kokkos::complex<double> storage. For comparison the
+ * same operations are run as plain loops on split real/imaginary storage (two double arrays),
+ * the layout a vectorized implementation would use. Compile with the target instruction set
+ * (e.g. -mavx2 -mfma or -mavx512f) to compare hosts.
+ *
+ * usage: test_elementwise [--npw N] [--nbands N] [--rep N]
+ *
+ * Prints one line per kernel: time per call of the interleaved (library) and the split loops
+ * and the memory bandwidth of the former.
+ */
+#include <mpi.h>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "la/dvector.hpp"
+#include "la/lapack.hpp"
+#include "preconditioner.hpp"
+#include "pseudo_hamiltonian/grad_eta.hpp"
+
+using namespace nlcglib;
+
+typedef Kokkos::complex<double> cplx;
+typedef KokkosDVector<cplx**, SlabLayoutV, Kokkos::LayoutLeft, Kokkos::HostSpace> matrix_t;
+
+/// time per call in seconds, after one warm-up call
+template <class F>
+double
+timeit(F&& f, int rep)
+{
+  f();
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int r = 0; r < rep; ++r) f();
+  auto t1 = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count() / rep;
+}
+
+/// m x n complex matrix, column major, real and imaginary parts in separate arrays
+struct split_matrix
+{
+  split_matrix(int m, int n)
+      : m(m)
+      , n(n)
+      , re(m * n)
+      , im(m * n)
+  {
+  }
+
+  void assign(const matrix_t& x)
+  {
+    auto a = x.array();
+    for (int j = 0; j < n; ++j)
+      for (int i = 0; i < m; ++i) {
+        re[i + m * j] = a(i, j).real();
+        im[i + m * j] = a(i, j).imag();
+      }
+  }
+
+  int m;
+  int n;
+  std::vector<double> re;
+  std::vector<double> im;
+};
+
+void
+report(const std::string& kernel, double t_interleaved, double t_split, double bytes)
+{
+  std::cout << std::left << std::setw(12) << kernel << std::right << std::scientific
+            << std::setprecision(3) << " interleaved " << t_interleaved << " s";
+  if (t_split > 0) {
+    std::cout << "  split " << t_split << " s";
+  } else {
+    std::cout << "  split         -  ";
+  }
+  std::cout << std::fixed << std::setprecision(2) << "  " << bytes / t_interleaved * 1e-9
+            << " GB/s\n";
+}
+
+int
+main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  Kokkos::initialize();
+
+  int npw{4000};
+  int nbands{64};
+  int rep{20};
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    auto next = [&]() {
+      if (i + 1 >= argc) throw std::runtime_error("missing value for " + arg);
+      return std::string(argv[++i]);
+    };
+    if (arg == "--npw") npw = std::stoi(next());
+    else if (arg == "--nbands") nbands = std::stoi(next());
+    else if (arg == "--rep") rep = std::stoi(next());
+    else throw std::runtime_error("unknown argument " + arg);
+  }
+
+  {
+    Map<> map(Communicator(), SlabLayoutV({{0, 0, npw, nbands}}));
+    matrix_t X(map);
+    matrix_t Y(map);
+    matrix_t Z(map);
+    Kokkos::View<double*, Kokkos::HostSpace> fn("fn", nbands);
+    Kokkos::View<double*, Kokkos::HostSpace> ek("ek", nbands);
+    Kokkos::View<double*, Kokkos::HostSpace> d("d", npw);
+    auto x = X.array();
+    auto y = Y.array();
+    for (int j = 0; j < nbands; ++j) {
+      fn(j) = 2. / (1 + std::exp(j - nbands / 2.));
+      ek(j) = 0.1 * j;
+      for (int i = 0; i < npw; ++i) {
+        x(i, j) = cplx(std::sin(i + 2 * j), std::cos(3 * i - j));
+        y(i, j) = cplx(std::cos(i * j + 1), std::sin(i - 2 * j));
+      }
+    }
+    for (int i = 0; i < npw; ++i) d(i) = 1. / (1 + 0.01 * i);
+
+    split_matrix xs(npw, nbands);
+    split_matrix ys(npw, nbands);
+    split_matrix zs(npw, nbands);
+    xs.assign(X);
+    ys.assign(Y);
+    int m = npw;
+    double bytes2 = 2 * sizeof(cplx) * double(npw) * nbands;
+    double bytes3 = 3 * sizeof(cplx) * double(npw) * nbands;
+
+    // z <- fn * x
+    double t0 = timeit([&]() { scale(Z, X, fn, 1.0); }, rep);
+    double t1 = timeit(
+        [&]() {
+          for (int j = 0; j < nbands; ++j) {
+            double s = fn(j);
+            for (int i = 0; i < m; ++i) {
+              zs.re[i + m * j] = s * xs.re[i + m * j];
+              zs.im[i + m * j] = s * xs.im[i + m * j];
+            }
+          }
+        },
+        rep);
+    report("scale fn", t0, t1, bytes2);
+
+    // z <- 0.7 z + 0.5 x
+    t0 = timeit([&]() { add(Z, X, cplx{0.5}, cplx{0.7}); }, rep);
+    t1 = timeit(
+        [&]() {
+          for (int k = 0; k < m * nbands; ++k) {
+            zs.re[k] = 0.7 * zs.re[k] + 0.5 * xs.re[k];
+            zs.im[k] = 0.7 * zs.im[k] + 0.5 * xs.im[k];
+          }
+        },
+        rep);
+    report("add", t0, t1, bytes3);
+
+    // z <- d(i) * x
+    diagonal_preconditioner<Kokkos::HostSpace> P(d);
+    t0 = timeit([&]() { P.apply_into(Z, X); }, rep);
+    t1 = timeit(
+        [&]() {
+          for (int j = 0; j < nbands; ++j) {
+            for (int i = 0; i < m; ++i) {
+              zs.re[i + m * j] = d(i) * xs.re[i + m * j];
+              zs.im[i + m * j] = d(i) * xs.im[i + m * j];
+            }
+          }
+        },
+        rep);
+    report("precond", t0, t1, bytes2);
+
+    // sum x conj(y)
+    volatile double sink{0};
+    t0 = timeit([&]() { sink = innerh_tr()(X, Y).real(); }, rep);
+    t1 = timeit(
+        [&]() {
+          double re{0};
+          double im{0};
+          for (int k = 0; k < m * nbands; ++k) {
+            re += xs.re[k] * ys.re[k] + xs.im[k] * ys.im[k];
+            im += xs.im[k] * ys.re[k] - xs.re[k] * ys.im[k];
+          }
+          sink = re + im;
+        },
+        rep);
+    report("innerh_tr", t0, t1, bytes2);
+
+    // off-diagonal entries of the η-gradient (nbands x nbands)
+    Map<> map_h(Communicator(), SlabLayoutV({{0, 0, nbands, nbands}}));
+    matrix_t Hij(map_h);
+    auto h = Hij.array();
+    for (int j = 0; j < nbands; ++j)
+      for (int i = 0; i < nbands; ++i) h(i, j) = cplx(std::cos(i + j), std::sin(i - j));
+    GradEta<smearing_type::FERMI_DIRAC> grad_eta(300, 1);
+    eta_partition part;
+    t0 = timeit([&]() { grad_eta.g_eta(Hij, 0.1 * nbands / 2, 1, ek, fn, 0, 0, 2, part); }, rep);
+    report("g_eta", t0, 0, 2 * sizeof(cplx) * double(nbands) * nbands);
+  }
+
+  Kokkos::finalize();
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,531 @@
+/**
+ * Model Hamiltonian for benchmarking the solver without an electronic structure code.
+ *
+ * Every k-point has a dense random Hermitian H = diag(ekin) + V (npw x npw), S = 1 and a
+ * diagonal kinetic preconditioner. With --nproj N > 0 the overlap has the ultrasoft structure
+ * S = 1 + B Q B^H (B: npw x N random projectors, Q > 0 diagonal). The overlap exports B and
+ * Q (applied inside nlcglib, see NLCGLIB_OVERLAP), the preconditioner exports B and
+ * C = -(Q^-1 + B^H B)^-1 (1 + B C B^H = S^-1) for NLCGLIB_US_PRECOND=teter_lowrank. The
+ * k-points are distributed over the ranks of MPI_COMM_WORLD (block distribution, global
+ * k-point indices), H and the initial wave-functions depend only on the global k-point index,
+ * the result is therefore independent of the number of ranks. The energy is cheap compared to
+ * the solver for small npw, which makes the timings dominated by nlcglib's own work (occupation
+ * search, allgathers over k-points, small matrices, logging).
+ *
+ * usage: test_model_solver [--nk N] [--npw N] [--nbands N] [--nel N] [--temp T] [--tol X]
+ *                          [--maxiter N] [--nproj N] [--nc]
+ *
+ * Prints a single line on rank 0:
+ *   model_solver ranks R threads T nk N npw N nbands N iter N converged B F X time X
+ *                evaluations N
+ */
+#include <mpi.h>
+#include <chrono>
+#include <complex>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "interface.hpp"
+#include "nlcglib.hpp"
+
+using namespace nlcglib;
+
+using complex_double = std::complex<double>;
+
+/// k-points owned by this rank: global indices [begin, end)
+struct kpoint_range
+{
+  kpoint_range(int nk, MPI_Comm comm)
+  {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    begin = nk * rank / size;
+    end = nk * (rank + 1) / size;
+  }
+
+  int size() const { return end - begin; }
+
+  int begin;
+  int end;
+};
+
+class ModelMatrix : public MatrixBaseZ
+{
+public:
+  ModelMatrix(std::vector<std::vector<complex_double>>& data,
+              int npw,
+              int nbands,
+              const kpoint_range& kr)
+      : data_(data)
+      , npw_(npw)
+      , nbands_(nbands)
+      , kr_(kr)
+  {
+  }
+
+  buffer_t get(int i) override
+  {
+    return buffer_t({1, npw_}, {npw_, nbands_}, data_[i].data(), memory_type::host);
+  }
+  const buffer_t get(int i) const override
+  {
+    return buffer_t({1, npw_}, {npw_, nbands_}, data_[i].data(), memory_type::host);
+  }
+  int size() const override { return kr_.size(); }
+  MPI_Comm mpicomm(int) const override { return MPI_COMM_SELF; }
+  MPI_Comm mpicomm() const override { return MPI_COMM_WORLD; }
+  kindex_t kpoint_index(int i) const override { return {kr_.begin + i, 0}; }
+
+private:
+  std::vector<std::vector<complex_double>>& data_;
+  int npw_;
+  int nbands_;
+  kpoint_range kr_;
+};
+
+class ModelVector : public VectorBaseZ
+{
+public:
+  ModelVector(std::vector<std::vector<double>>& data, const kpoint_range& kr)
+      : data_(data)
+      , kr_(kr)
+  {
+  }
+
+  buffer_t get(int i) override
+  {
+    return buffer_t(data_[i].size(), data_[i].data(), memory_type::host);
+  }
+  const buffer_t get(int i) const override
+  {
+    return buffer_t(data_[i].size(), data_[i].data(), memory_type::host);
+  }
+  int size() const override { return kr_.size(); }
+  MPI_Comm mpicomm(int) const override { return MPI_COMM_SELF; }
+  MPI_Comm mpicomm() const override { return MPI_COMM_WORLD; }
+  kindex_t kpoint_index(int i) const override { return {kr_.begin + i, 0}; }
+
+private:
+  std::vector<std::vector<double>>& data_;
+  kpoint_range kr_;
+};
+
+class ModelScalar : public ScalarBaseZ
+{
+public:
+  ModelScalar(const std::vector<double>& data, const kpoint_range& kr)
+      : data_(data)
+      , kr_(kr)
+  {
+  }
+
+  buffer_t get(int i) override { return data_[i]; }
+  const buffer_t get(int i) const override { return data_[i]; }
+  int size() const override { return kr_.size(); }
+  MPI_Comm mpicomm(int) const override { return MPI_COMM_SELF; }
+  MPI_Comm mpicomm() const override { return MPI_COMM_WORLD; }
+  kindex_t kpoint_index(int i) const override { return {kr_.begin + i, 0}; }
+
+private:
+  std::vector<double> data_;
+  kpoint_range kr_;
+};
+
+class ModelEnergy : public EnergyBase
+{
+public:
+  ModelEnergy(int nk, int npw, int nbands, int nel, int nproj)
+      : kr_(nk, MPI_COMM_WORLD)
+      , npw_(npw)
+      , nbands_(nbands)
+      , nel_(nel)
+      , nproj_(nproj)
+  {
+    int nk_loc = kr_.size();
+    H_.resize(nk_loc);
+    B_.resize(nk_loc);
+    q_.resize(nk_loc);
+    qmat_.resize(nk_loc);
+    sinv_.resize(nk_loc);
+    C_.resize(nk_loc);
+    hphi_.resize(nk_loc);
+    sphi_.resize(nk_loc);
+    fn_.resize(nk_loc);
+    ek_.resize(nk_loc);
+    ekin_.resize(nk_loc);
+    wk_.assign(nk_loc, 1.0 / nk);
+    for (int i = 0; i < nk_loc; ++i) {
+      int ik = kr_.begin + i;
+      std::mt19937 gen(ik);
+      std::normal_distribution<double> normal(0, 1);
+      auto& H = H_[i];
+      auto& ekin = ekin_[i];
+      H.assign(npw * npw, 0);
+      ekin.resize(npw);
+      for (int p = 0; p < npw; ++p) {
+        ekin[p] = 0.05 * p * (1 + 0.1 * ik);
+        H[p + npw * p] = ekin[p];
+      }
+      for (int p = 0; p < npw; ++p) {
+        for (int q = p; q < npw; ++q) {
+          complex_double v(0.05 * normal(gen), p == q ? 0 : 0.05 * normal(gen));
+          H[p + npw * q] += v;
+          if (p != q) H[q + npw * p] += std::conj(v);
+        }
+      }
+      if (nproj > 0) init_overlap(i, gen);
+      // random S-orthonormal initial wave-functions (Gram-Schmidt)
+      auto& C = C_[i];
+      C.resize(npw * nbands);
+      for (auto& c : C) c = complex_double(normal(gen), normal(gen));
+      std::vector<complex_double> sc(npw);
+      for (int j = 0; j < nbands; ++j) {
+        for (int l = 0; l < j; ++l) {
+          apply_s(i, &C[npw * l], 1, npw, sc.data(), 1, npw, 1);
+          complex_double ov{0};
+          for (int p = 0; p < npw; ++p) ov += std::conj(sc[p]) * C[p + npw * j];
+          for (int p = 0; p < npw; ++p) C[p + npw * j] -= ov * C[p + npw * l];
+        }
+        apply_s(i, &C[npw * j], 1, npw, sc.data(), 1, npw, 1);
+        double nrm{0};
+        for (int p = 0; p < npw; ++p) nrm += (std::conj(sc[p]) * C[p + npw * j]).real();
+        nrm = std::sqrt(nrm);
+        for (int p = 0; p < npw; ++p) C[p + npw * j] /= nrm;
+      }
+      fn_[i].assign(nbands, std::min(2.0, 2.0 * nel / nbands));
+      ek_[i].assign(nbands, 0);
+      hphi_[i].assign(npw * nbands, 0);
+      sphi_[i].assign(npw * nbands, 0);
+    }
+    compute();
+  }
+
+  void compute() override
+  {
+    ++ncompute;
+    double etot{0};
+    for (int i = 0; i < kr_.size(); ++i) {
+      auto& H = H_[i];
+      auto& C = C_[i];
+      for (int j = 0; j < nbands_; ++j) {
+        complex_double e{0};
+        for (int p = 0; p < npw_; ++p) {
+          complex_double hc{0};
+          for (int q = 0; q < npw_; ++q) hc += H[p + npw_ * q] * C[q + npw_ * j];
+          hphi_[i][p + npw_ * j] = hc;
+          e += std::conj(C[p + npw_ * j]) * hc;
+        }
+        ek_[i][j] = e.real();
+        etot += wk_[i] * fn_[i][j] * e.real();
+      }
+      apply_s(i, C.data(), 1, npw_, sphi_[i].data(), 1, npw_, nbands_);
+    }
+    MPI_Allreduce(&etot, &etot_, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  }
+
+  int nelectrons() override { return nel_; }
+  int occupancy() override { return 2; }
+  double get_total_energy() override { return etot_; }
+  std::map<std::string, double> get_energy_components() override { return {{"total", etot_}}; }
+  std::shared_ptr<MatrixBaseZ> get_hphi(memory_type) override
+  {
+    return std::make_shared<ModelMatrix>(hphi_, npw_, nbands_, kr_);
+  }
+  std::shared_ptr<MatrixBaseZ> get_sphi(memory_type) override
+  {
+    return std::make_shared<ModelMatrix>(sphi_, npw_, nbands_, kr_);
+  }
+  std::shared_ptr<MatrixBaseZ> get_C(memory_type) override
+  {
+    return std::make_shared<ModelMatrix>(C_, npw_, nbands_, kr_);
+  }
+  std::shared_ptr<VectorBaseZ> get_fn() override { return std::make_shared<ModelVector>(fn_, kr_); }
+  void set_fn(const std::vector<std::pair<int, int>>& keys,
+              const std::vector<std::vector<double>>& fn) override
+  {
+    for (size_t i = 0; i < keys.size(); ++i) fn_[keys[i].first - kr_.begin] = fn[i];
+  }
+  std::shared_ptr<VectorBaseZ> get_ek() override { return std::make_shared<ModelVector>(ek_, kr_); }
+  std::shared_ptr<VectorBaseZ> get_gkvec_ekin() override
+  {
+    return std::make_shared<ModelVector>(ekin_, kr_);
+  }
+  std::shared_ptr<ScalarBaseZ> get_kpoint_weights() override
+  {
+    return std::make_shared<ModelScalar>(wk_, kr_);
+  }
+  void set_chemical_potential(double mu) override { mu_ = mu; }
+  double get_chemical_potential() override { return mu_; }
+  void print_info() const override {}
+
+  const kpoint_range& kpoints() const { return kr_; }
+  const std::vector<double>& ekin(int ik) const { return ekin_[ik - kr_.begin]; }
+  int nproj() const { return nproj_; }
+
+  /// out <- S in for ncols columns of the local k-point i, S = 1 + B Q B^H
+  void apply_s(int i,
+               const complex_double* in,
+               int in_stride0,
+               int in_stride1,
+               complex_double* out,
+               int out_stride0,
+               int out_stride1,
+               int ncols) const
+  {
+    for (int j = 0; j < ncols; ++j) {
+      for (int p = 0; p < npw_; ++p) {
+        out[p * out_stride0 + j * out_stride1] = in[p * in_stride0 + j * in_stride1];
+      }
+      for (int a = 0; a < nproj_; ++a) {
+        complex_double bx{0};
+        for (int p = 0; p < npw_; ++p) {
+          bx += std::conj(B_[i][p + npw_ * a]) * in[p * in_stride0 + j * in_stride1];
+        }
+        bx *= q_[i][a];
+        for (int p = 0; p < npw_; ++p) {
+          out[p * out_stride0 + j * out_stride1] += B_[i][p + npw_ * a] * bx;
+        }
+      }
+    }
+  }
+
+  std::shared_ptr<MatrixBaseZ> projectors()
+  {
+    return std::make_shared<ModelMatrix>(B_, npw_, nproj_, kr_);
+  }
+  std::shared_ptr<MatrixBaseZ> q_matrix()
+  {
+    return std::make_shared<ModelMatrix>(qmat_, nproj_, nproj_, kr_);
+  }
+  std::shared_ptr<MatrixBaseZ> sinv_correction()
+  {
+    return std::make_shared<ModelMatrix>(sinv_, nproj_, nproj_, kr_);
+  }
+
+public:
+  int ncompute{0};
+
+private:
+  /// random projectors B and Q, sinv = -(Q^-1 + B^H B)^-1 (Gauss-Jordan)
+  void init_overlap(int i, std::mt19937& gen)
+  {
+    std::normal_distribution<double> normal(0, 1);
+    std::uniform_real_distribution<double> uniform(0.5, 1.5);
+    int n = nproj_;
+    auto& B = B_[i];
+    B.resize(npw_ * n);
+    double scale = 0.5 / std::sqrt(double(npw_));
+    for (auto& b : B) b = scale * complex_double(normal(gen), normal(gen));
+    q_[i].resize(n);
+    for (auto& q : q_[i]) q = uniform(gen);
+    qmat_[i].assign(n * n, 0);
+    for (int a = 0; a < n; ++a) qmat_[i][a + n * a] = q_[i][a];
+
+    std::vector<complex_double> M(n * n), Minv(n * n, 0);
+    for (int a = 0; a < n; ++a) {
+      Minv[a + n * a] = 1;
+      for (int b = 0; b < n; ++b) {
+        complex_double bb{0};
+        for (int p = 0; p < npw_; ++p) bb += std::conj(B[p + npw_ * a]) * B[p + npw_ * b];
+        M[a + n * b] = bb + (a == b ? 1 / q_[i][a] : 0);
+      }
+    }
+    // M is Hermitian positive definite, no pivoting needed
+    for (int c = 0; c < n; ++c) {
+      complex_double d = M[c + n * c];
+      for (int b = 0; b < n; ++b) {
+        M[c + n * b] /= d;
+        Minv[c + n * b] /= d;
+      }
+      for (int r = 0; r < n; ++r) {
+        if (r == c) continue;
+        complex_double f = M[r + n * c];
+        for (int b = 0; b < n; ++b) {
+          M[r + n * b] -= f * M[c + n * b];
+          Minv[r + n * b] -= f * Minv[c + n * b];
+        }
+      }
+    }
+    sinv_[i].resize(n * n);
+    for (int k = 0; k < n * n; ++k) sinv_[i][k] = -Minv[k];
+  }
+
+private:
+  kpoint_range kr_;
+  int npw_;
+  int nbands_;
+  int nel_;
+  int nproj_;
+  std::vector<std::vector<complex_double>> H_, C_, hphi_, sphi_, B_, qmat_, sinv_;
+  std::vector<std::vector<double>> q_;
+  std::vector<std::vector<double>> fn_, ek_, ekin_;
+  std::vector<double> wk_;
+  double mu_{0};
+  double etot_{0};
+};
+
+static std::vector<std::pair<int, int>>
+model_keys(const kpoint_range& kr)
+{
+  std::vector<std::pair<int, int>> keys;
+  for (int ik = kr.begin; ik < kr.end; ++ik) keys.push_back({ik, 0});
+  return keys;
+}
+
+/// S = 1 + B Q B^H, exports B and Q if nproj > 0
+class ModelOverlap : public OverlapBase
+{
+public:
+  ModelOverlap(ModelEnergy& energy)
+      : energy_(energy)
+  {
+  }
+
+  std::shared_ptr<MatrixBaseZ> get_projectors(memory_type) const override
+  {
+    return energy_.nproj() > 0 ? energy_.projectors() : nullptr;
+  }
+  std::shared_ptr<MatrixBaseZ> get_q(memory_type) const override
+  {
+    return energy_.nproj() > 0 ? energy_.q_matrix() : nullptr;
+  }
+
+  void apply(const key_t& key, MatrixBaseZ::buffer_t& out, MatrixBaseZ::buffer_t& in) const override
+  {
+    energy_.apply_s(key.first - energy_.kpoints().begin,
+                    in.data,
+                    in.stride[0],
+                    in.stride[1],
+                    out.data,
+                    out.stride[0],
+                    out.stride[1],
+                    in.size[1]);
+  }
+  std::vector<key_t> get_keys() const override { return model_keys(energy_.kpoints()); }
+
+private:
+  ModelEnergy& energy_;
+};
+
+/// P = (1 + ekin)^-1, exports the low-rank S^-1 correction if nproj > 0
+class ModelPrecond : public UltrasoftPrecondBase
+{
+public:
+  ModelPrecond(ModelEnergy& energy)
+      : energy_(energy)
+  {
+  }
+
+  std::shared_ptr<MatrixBaseZ> get_projectors(memory_type) const override
+  {
+    return energy_.nproj() > 0 ? energy_.projectors() : nullptr;
+  }
+  std::shared_ptr<MatrixBaseZ> get_correction(memory_type) const override
+  {
+    return energy_.nproj() > 0 ? energy_.sinv_correction() : nullptr;
+  }
+
+  void apply(const key_t& key, MatrixBaseZ::buffer_t& out, MatrixBaseZ::buffer_t& in) const override
+  {
+    auto& ekin = energy_.ekin(key.first);
+    for (int j = 0; j < in.size[1]; ++j) {
+      for (int i = 0; i < in.size[0]; ++i) {
+        out.data[i * out.stride[0] + j * out.stride[1]] =
+            in.data[i * in.stride[0] + j * in.stride[1]] / (1.0 + ekin[i]);
+      }
+    }
+  }
+  std::vector<key_t> get_keys() const override { return model_keys(energy_.kpoints()); }
+
+private:
+  ModelEnergy& energy_;
+};
+
+int
+main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+
+  int nk = 4;
+  int npw = 100;
+  int nbands = 16;
+  int nel = -1;
+  double temp = 3000;
+  double tol = 1e-9;
+  int maxiter = 100;
+  int nproj = 0;
+  bool nc = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    auto next = [&]() {
+      if (i + 1 >= argc) {
+        std::cerr << "missing value for " << arg << "\n";
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      return std::string(argv[++i]);
+    };
+    if (arg == "--nk") nk = std::stoi(next());
+    else if (arg == "--npw") npw = std::stoi(next());
+    else if (arg == "--nbands") nbands = std::stoi(next());
+    else if (arg == "--nel") nel = std::stoi(next());
+    else if (arg == "--temp") temp = std::stod(next());
+    else if (arg == "--tol") tol = std::stod(next());
+    else if (arg == "--maxiter") maxiter = std::stoi(next());
+    else if (arg == "--nproj") nproj = std::stoi(next());
+    else if (arg == "--nc") nc = true;
+    else {
+      std::cerr << "unknown argument " << arg << "\n";
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+  // default: a bit less than half filled
+  if (nel < 0) nel = nbands - 2;
+
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  if (nk < nranks) {
+    if (rank == 0) std::cerr << "need at least one k-point per rank\n";
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  nlcglib::initialize();
+  {
+    if (nc && nproj > 0) {
+      if (rank == 0) std::cerr << "--nproj requires the ultrasoft solver\n";
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    ModelEnergy energy(nk, npw, nbands, nel, nproj);
+    ModelOverlap S(energy);
+    ModelPrecond P(energy);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto t0 = std::chrono::high_resolution_clock::now();
+    nlcg_info info;
+    if (nc) {
+      info = nlcg_mvp2_cpu(energy, smearing_type::FERMI_DIRAC, temp, tol, 0.3, 0.1, maxiter, 10);
+    } else {
+      info = nlcg_us_cpu(
+          energy, P, S, smearing_type::FERMI_DIRAC, temp, tol, 0.3, 0.1, maxiter, 10);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    double time = std::chrono::duration_cast<std::chrono::duration<double>>(t1 - t0).count();
+
+    const char* threads = std::getenv("OMP_NUM_THREADS");
+    if (rank == 0) {
+      std::cout << "model_solver ranks " << nranks << " threads " << (threads ? threads : "0")
+                << " nk " << nk << " npw " << npw << " nbands " << nbands << " iter " << info.iter
+                << " converged " << info.converged << " F " << std::setprecision(13) << info.F
+                << " time " << std::setprecision(6) << time << " evaluations "
+                << info.stats.evaluations << "\n";
+    }
+  }
+  nlcglib::finalize();
+  MPI_Finalize();
+  return 0;
+}
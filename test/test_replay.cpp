@@ -0,0 +1,69 @@
+/**
+ * Replays a recording written with NLCGLIB_RECORD=<prefix> (see src/record_replay.hpp), runs the
+ * solver on the recorded responses without the electronic structure code.
+ *
+ * usage: mpirun -np <recorded ranks> test_replay <prefix>
+ */
+#include <mpi.h>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include "nlcglib.hpp"
+#include "record_replay.hpp"
+
+using namespace nlcglib;
+
+int
+main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <prefix>\n";
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  // never overwrite the recording that is replayed
+  unsetenv("NLCGLIB_RECORD");
+
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  nlcglib::initialize();
+  {
+    record::replay_state state(argv[1]);
+    ReplayEnergy energy(state);
+    ReplayOp<OverlapBase> S(state, record::op_id::overlap);
+    ReplayOp<UltrasoftPrecondBase> P(state, record::op_id::precond);
+    auto& p = state.params;
+    auto smearing = static_cast<smearing_type>(p.smearing);
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    nlcg_info info;
+    if (p.solver == 0) {
+      info = nlcg_us_cpu(energy, P, S, smearing, p.T, p.tol, p.kappa, p.tau, p.maxiter, p.restart);
+    } else {
+      info = nlcg_mvp2_cpu(energy, smearing, p.T, p.tol, p.kappa, p.tau, p.maxiter, p.restart);
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    double time = std::chrono::duration_cast<std::chrono::duration<double>>(t1 - t0).count();
+
+    nlcg_info recorded;
+    bool complete = state.result(recorded);
+    if (rank == 0) {
+      std::cout << std::setprecision(13) << "replay: F " << info.F << " iter " << info.iter
+                << " evaluations " << state.ncompute << " applications " << state.napply
+                << " time " << std::setprecision(6) << time << "\n";
+      if (complete) {
+        std::cout << std::setprecision(13) << "recorded: F " << recorded.F << " iter "
+                  << recorded.iter << "\n";
+      } else {
+        std::cout << "recorded: incomplete recording\n";
+      }
+      std::cout << "max. deviation of the wave-functions: " << std::setprecision(3)
+                << state.max_deviation << "\n";
+    }
+  }
+  nlcglib::finalize();
+  MPI_Finalize();
+  return 0;
+}
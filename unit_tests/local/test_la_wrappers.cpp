@@ -5,6 +5,7 @@
 #include "la/lapack.hpp"
 #include "la/magma.hpp"
 #include <iomanip>
+#include <vector>
 
 using namespace nlcglib;
 
@@ -112,6 +113,138 @@ TEST_F(CPUKokkosVectors, TransformCPU)
   std::cout << "\n";
 }
 
+TEST(EigenValues, EigJacobiCPU)
+{
+  // diagonal + sparse Hermitian perturbation, compare Jacobi sweeps with zheevd
+  typedef KokkosDVector<Kokkos::complex<double> **, SlabLayoutV, Kokkos::LayoutLeft, Kokkos::HostSpace>
+      vector_t;
+  int n = 12;
+  vector_t A(Map<>(Communicator(), SlabLayoutV({{0, 0, n, n}})));
+  vector_t U(Map<>(Communicator(), SlabLayoutV({{0, 0, n, n}})));
+  vector_t Uref(Map<>(Communicator(), SlabLayoutV({{0, 0, n, n}})));
+  auto A_array = A.array();
+  for (int i = 0; i < n; ++i) {
+    A_array(i, i) = (i * 7) % n;  // unsorted diagonal
+  }
+  for (int i = 0; i + 3 < n; i += 2) {
+    A_array(i, i + 3) = Kokkos::complex<double>(1e-3 * i, -2e-3);
+    A_array(i + 3, i) = Kokkos::conj(A_array(i, i + 3));
+  }
+
+  Kokkos::View<double *, Kokkos::HostSpace> w("w", n);
+  Kokkos::View<double *, Kokkos::HostSpace> wref("wref", n);
+  ASSERT_TRUE(eigh_jacobi(U, w, A));
+  eigh(Uref, wref, A);
+
+  auto U_array = U.array();
+  for (int j = 0; j < n; ++j) {
+    EXPECT_NEAR(w(j), wref(j), 1e-12);
+    // A u_j = w_j u_j
+    for (int i = 0; i < n; ++i) {
+      Kokkos::complex<double> r = -w(j) * U_array(i, j);
+      for (int k = 0; k < n; ++k) r += A_array(i, k) * U_array(k, j);
+      EXPECT_NEAR(Kokkos::abs(r), 0, 1e-12);
+    }
+  }
+
+  // dense perturbation is rejected
+  for (int i = 0; i < n; ++i)
+    for (int j = 0; j < n; ++j)
+      if (i != j) A_array(i, j) = 1e-4;
+  EXPECT_FALSE(eigh_jacobi(U, w, A));
+}
+
+TEST(SmallKernels, CholeskyCPU)
+{
+  // fixed size kernels against the residual, n = 5, 12, 40 are padded to the next kernel size,
+  // max_n = 64 forces the kernels independent of the default size limits
+  typedef Kokkos::complex<double> cplx;
+  typedef KokkosDVector<cplx **, SlabLayoutV, Kokkos::LayoutLeft, Kokkos::HostSpace> vector_t;
+  for (int n : {5, 8, 12, 16, 32, 40, 64}) {
+    vector_t A(Map<>(Communicator(), SlabLayoutV({{0, 0, n, n}})));
+    vector_t B(Map<>(Communicator(), SlabLayoutV({{0, 0, n, n}})));
+    vector_t C(Map<>(Communicator(), SlabLayoutV({{0, 0, n, n}})));
+    auto a = A.array();
+    auto b = B.array();
+    auto c = C.array();
+    for (int i = 0; i < n; ++i) {
+      for (int j = 0; j < n; ++j) {
+        a(i, j) = cplx(std::sin(i + 2 * j), std::cos(3 * i - j));
+        b(i, j) = cplx(std::cos(i * j + 1), std::sin(i - 2 * j));
+      }
+    }
+
+    // Hermitian positive definite S = A^H A + n I, solve S X = B
+    vector_t S(Map<>(Communicator(), SlabLayoutV({{0, 0, n, n}})));
+    inner(S, A, A);
+    auto s = S.array();
+    for (int i = 0; i < n; ++i) s(i, i) += n;
+    auto s0 = Kokkos::create_mirror(s);
+    Kokkos::deep_copy(s0, s);
+    Kokkos::deep_copy(c, b);
+    int info{-1};
+    ASSERT_TRUE(small_kernels::potrf(n, s.data(), n, info, 64));
+    EXPECT_EQ(info, 0);
+    ASSERT_TRUE(small_kernels::potrs(n, n, s.data(), n, c.data(), n, 64));
+    for (int i = 0; i < n; ++i)
+      for (int j = 0; j < n; ++j) {
+        cplx r = -b(i, j);
+        for (int l = 0; l < n; ++l) r += s0(i, l) * c(l, j);
+        EXPECT_NEAR(Kokkos::abs(r), 0, 1e-10) << "n = " << n;
+      }
+  }
+
+  // not positive definite: info as LAPACK, the padding does not hide it
+  std::vector<cplx> d(12 * 12, cplx(0));
+  for (int i = 0; i < 12; ++i) d[i + 12 * i] = i == 10 ? -1 : 1;
+  int info{0};
+  ASSERT_TRUE(small_kernels::potrf(12, d.data(), 12, info, 64));
+  EXPECT_EQ(info, 11);
+}
+
+TEST(ElementwiseKernels, ColumnsCPU)
+{
+  // host kernels run by columns, innerh_tr in partial sums of 8 rows, m is not a multiple of 8
+  typedef Kokkos::complex<double> cplx;
+  typedef KokkosDVector<cplx **, SlabLayoutV, Kokkos::LayoutLeft, Kokkos::HostSpace> vector_t;
+  int m = 37;
+  int n = 5;
+  vector_t A(Map<>(Communicator(), SlabLayoutV({{0, 0, m, n}})));
+  vector_t B(Map<>(Communicator(), SlabLayoutV({{0, 0, m, n}})));
+  vector_t C(Map<>(Communicator(), SlabLayoutV({{0, 0, m, n}})));
+  auto a = A.array();
+  auto b = B.array();
+  auto c = C.array();
+  Kokkos::View<double *, Kokkos::HostSpace> x("x", n);
+  for (int j = 0; j < n; ++j) {
+    x(j) = 1.0 / (j + 1);
+    for (int i = 0; i < m; ++i) {
+      a(i, j) = cplx(std::sin(i + 2 * j), std::cos(3 * i - j));
+      b(i, j) = cplx(std::cos(i * j + 1), std::sin(i - 2 * j));
+    }
+  }
+
+  cplx ref{0};
+  for (int i = 0; i < m; ++i)
+    for (int j = 0; j < n; ++j) ref += a(i, j) * Kokkos::conj(b(i, j));
+  EXPECT_NEAR(Kokkos::abs(innerh_tr()(A, B) - ref), 0, 1e-12);
+
+  Kokkos::deep_copy(c, a);
+  scale(C, B, x, 0.5, 2);
+  for (int i = 0; i < m; ++i)
+    for (int j = 0; j < n; ++j)
+      EXPECT_NEAR(Kokkos::abs(c(i, j) - (2. * a(i, j) + 0.5 * x(j) * b(i, j))), 0, 1e-14);
+
+  // real coefficients (as streams of doubles) and complex coefficients
+  for (cplx alpha : {cplx(0.5, 0), cplx(0.5, 1)}) {
+    Kokkos::deep_copy(c, a);
+    add(C, B, alpha, cplx(-1, 0));
+    for (int i = 0; i < m; ++i)
+      for (int j = 0; j < n; ++j)
+        EXPECT_NEAR(Kokkos::abs(c(i, j) - (-1. * a(i, j) + alpha * b(i, j))), 0, 1e-14);
+  }
+}
+
 #if defined(__NLCGLIB__ROCM) || defined(__NLCGLIB__CUDA)
 
 #ifdef __NLCGLIB__ROCM
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <complex>
+#include <memory>
+#include <random>
+#include <vector>
+#include "la/dvector.hpp"
+#include "overlap.hpp"
+
+using namespace nlcglib;
+
+/// a single k-point matrix in host memory, column major
+class HostMatrix : public MatrixBaseZ
+{
+public:
+  HostMatrix(int m, int n)
+      : m_(m)
+      , n_(n)
+      , data_(m * n)
+  {
+  }
+
+  buffer_t get(int) override
+  {
+    return buffer_t({1, m_}, {m_, n_}, data_.data(), memory_type::host);
+  }
+  const buffer_t get(int) const override
+  {
+    return buffer_t({1, m_}, {m_, n_}, const_cast<std::complex<double>*>(data_.data()),
+                    memory_type::host);
+  }
+  int size() const override { return 1; }
+  MPI_Comm mpicomm(int) const override { return MPI_COMM_SELF; }
+  MPI_Comm mpicomm() const override { return MPI_COMM_SELF; }
+  kindex_t kpoint_index(int) const override { return {0, 0}; }
+
+  std::complex<double>& operator()(int i, int j) { return data_[i + m_ * j]; }
+
+private:
+  int m_;
+  int n_;
+  std::vector<std::complex<double>> data_;
+};
+
+/// exports B and Q only, S is never applied through the callback
+class LowRankOverlapBase : public OverlapBase
+{
+public:
+  LowRankOverlapBase(std::shared_ptr<HostMatrix> B, std::shared_ptr<HostMatrix> Q)
+      : B(B)
+      , Q(Q)
+  {
+  }
+
+  void apply(const key_t&, MatrixBaseZ::buffer_t&, MatrixBaseZ::buffer_t&) const override
+  {
+    throw std::runtime_error("not implemented");
+  }
+  std::vector<key_t> get_keys() const override { return {{0, 0}}; }
+  std::shared_ptr<MatrixBaseZ> get_projectors(memory_type) const override { return B; }
+  std::shared_ptr<MatrixBaseZ> get_q(memory_type) const override { return Q; }
+
+private:
+  std::shared_ptr<HostMatrix> B;
+  std::shared_ptr<HostMatrix> Q;
+};
+
+TEST(LowRankOverlap, WoodburyInverse)
+{
+  typedef Kokkos::complex<double> cplx;
+  typedef lowrank_matrix_t<Kokkos::HostSpace> matrix_t;
+  int npw = 60;
+  int nproj = 7;
+  int ncols = 5;
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> unif(-1, 1);
+  auto B = std::make_shared<HostMatrix>(npw, nproj);
+  auto Q = std::make_shared<HostMatrix>(nproj, nproj);
+  for (int j = 0; j < nproj; ++j) {
+    for (int i = 0; i < npw; ++i) (*B)(i, j) = {unif(gen), unif(gen)};
+  }
+  // Hermitian, indefinite
+  for (int j = 0; j < nproj; ++j) {
+    (*Q)(j, j) = unif(gen);
+    for (int i = 0; i < j; ++i) {
+      (*Q)(i, j) = {0.1 * unif(gen), 0.1 * unif(gen)};
+      (*Q)(j, i) = std::conj((*Q)(i, j));
+    }
+  }
+  LowRankOverlapBase overlap_base(B, Q);
+  LowRankOverlap<Kokkos::HostSpace> S(overlap_base);
+  auto Sinv = S.inverse();
+  std::pair<int, int> key{0, 0};
+
+  Map<> map(Communicator(), SlabLayoutV({{0, 0, npw, ncols}}));
+  matrix_t X(map);
+  for (int j = 0; j < ncols; ++j) {
+    for (int i = 0; i < npw; ++i) X.array()(i, j) = cplx(unif(gen), unif(gen));
+  }
+
+  // dense S = 1 + B Q B^H
+  std::vector<std::complex<double>> BQ(npw * nproj, 0);
+  for (int j = 0; j < nproj; ++j)
+    for (int l = 0; l < nproj; ++l)
+      for (int i = 0; i < npw; ++i) BQ[i + npw * j] += (*B)(i, l) * (*Q)(l, j);
+  std::vector<std::complex<double>> Sd(npw * npw, 0);
+  for (int j = 0; j < npw; ++j) {
+    Sd[j + npw * j] = 1;
+    for (int l = 0; l < nproj; ++l)
+      for (int i = 0; i < npw; ++i) Sd[i + npw * j] += BQ[i + npw * l] * std::conj((*B)(j, l));
+  }
+
+  auto SX = S.at(key)(X);
+  auto SinvX = Sinv.at(key)(X);
+  auto SSinvX = S.at(key)(SinvX);
+  auto SinvSX = Sinv.at(key)(SX);
+  for (int j = 0; j < ncols; ++j) {
+    for (int i = 0; i < npw; ++i) {
+      std::complex<double> ref{0};
+      std::complex<double> ref_inv{0};
+      for (int l = 0; l < npw; ++l) {
+        auto s = Sd[i + npw * l];
+        ref += s * std::complex<double>(X.array()(l, j).real(), X.array()(l, j).imag());
+        ref_inv += s * std::complex<double>(SinvX.array()(l, j).real(), SinvX.array()(l, j).imag());
+      }
+      auto x = X.array()(i, j);
+      EXPECT_NEAR(Kokkos::abs(SX.array()(i, j) - cplx(ref.real(), ref.imag())), 0, 1e-10);
+      // the dense S inverts S^-1 as well
+      EXPECT_NEAR(Kokkos::abs(x - cplx(ref_inv.real(), ref_inv.imag())), 0, 1e-10);
+      EXPECT_NEAR(Kokkos::abs(SSinvX.array()(i, j) - x), 0, 1e-10);
+      EXPECT_NEAR(Kokkos::abs(SinvSX.array()(i, j) - x), 0, 1e-10);
+    }
+  }
+}